@@ -0,0 +1,162 @@
+#include "auto_exposure.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock.h"
+#include "image_stats.h"
+#include "log.h"
+#include "trace.h"
+
+// Errors smaller than this (in stops) are left alone, so the loop settles
+// instead of hunting on noise
+#define AE_DEADBAND_STOPS 0.05
+// Largest correction per step
+#define AE_MAX_STEP_STOPS 3.0
+// After this many frames without one showing the last change, assume the
+// source reports exposure differently from how it was set and carry on
+#define AE_MAX_WAIT_FRAMES 8
+
+bool AutoExposureInit(
+    AutoExposure* ae, const AutoExposureConfig* cfg, const FrameSource* src) {
+    memset(ae, 0, sizeof(*ae));
+    if (src->set_exposure == NULL) {
+        return false;
+    }
+    ae->cfg = *cfg;
+    if (ae->cfg.damping <= 0.0 || ae->cfg.damping > 1.0) {
+        ae->cfg.damping = 1.0;
+    }
+    ae->min_exposure_us = src->exposure_min_us > 0 ? src->exposure_min_us : 1;
+    int ceiling = cfg->max_exposure_us;
+    if (ceiling <= 0) {
+        ceiling = src->rate_hz > 0.0 ? (int)(1e6 / src->rate_hz)
+                                     : src->exposure_max_us;
+    }
+    ceiling = ceiling < src->exposure_max_us ? ceiling : src->exposure_max_us;
+    ae->max_exposure_us =
+        ceiling > ae->min_exposure_us ? ceiling : ae->min_exposure_us;
+    ae->min_gain_db = src->gain_min_db;
+    ae->max_gain_db =
+        cfg->max_gain_db < src->gain_max_db ? cfg->max_gain_db
+                                            : src->gain_max_db;
+    if (ae->max_gain_db < ae->min_gain_db) {
+        ae->max_gain_db = ae->min_gain_db;
+    }
+    Log(INFO,
+        "Auto exposure: target %.0f, damping %.2f, exposure %d-%d us, "
+        "gain %.1f-%.1f dB\n",
+        ae->cfg.target,
+        ae->cfg.damping,
+        ae->min_exposure_us,
+        ae->max_exposure_us,
+        ae->min_gain_db,
+        ae->max_gain_db);
+    return true;
+}
+
+// Mean and median luma of the metering region
+static bool Meter(AutoExposure* ae, const Frame* frame) {
+    const AutoExposureConfig* cfg = &ae->cfg;
+    SourceRoi region = {
+        .x = (int)(cfg->region_x * frame->width),
+        .y = (int)(cfg->region_y * frame->height),
+        .width = (int)(cfg->region_w * frame->width),
+        .height = (int)(cfg->region_h * frame->height),
+    };
+    uint32_t n = ImageStatsGather(
+        frame,
+        &region,
+        AUTO_EXPOSURE_SAMPLES,
+        ae->samples[0],
+        ae->samples[1],
+        ae->samples[2]);
+    if (n == 0) {
+        return false;
+    }
+    uint32_t hist[256] = {0};
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        int luma = (77 * ae->samples[0][i] + 150 * ae->samples[1][i] +
+                    29 * ae->samples[2][i] + 128) >>
+                   8;
+        hist[luma] += 1;
+        sum += luma;
+    }
+    uint32_t seen = 0;
+    int median = 0;
+    while (median < 255 && (seen += hist[median]) < (n + 1) / 2) {
+        median += 1;
+    }
+    ae->luma = (double)sum / n;
+    ae->median = median;
+    return true;
+}
+
+static void Steer(AutoExposure* ae, FrameSource* src) {
+    double error = log2(ae->cfg.target / fmax(ae->luma, 0.5));
+    // Mostly clipped (or black) frames understate how far off they are
+    if (ae->median >= 254 && error > -1.0) {
+        error = -1.0;
+    } else if (ae->median == 0 && error < 1.0) {
+        error = 1.0;
+    }
+    error = fmax(-AE_MAX_STEP_STOPS, fmin(AE_MAX_STEP_STOPS, error));
+    if (fabs(error) < AE_DEADBAND_STOPS) {
+        return;
+    }
+    double total = ae->exposure_us * pow(10.0, ae->gain_db / 20.0);
+    double wanted = total * exp2(error * ae->cfg.damping);
+    int exposure = wanted < ae->min_exposure_us   ? ae->min_exposure_us
+                   : wanted > ae->max_exposure_us ? ae->max_exposure_us
+                                                  : (int)wanted;
+    double gain = 20.0 * log10(wanted / exposure);
+    gain = fmax(ae->min_gain_db, fmin(ae->max_gain_db, gain));
+    if (exposure == ae->exposure_us && fabs(gain - ae->gain_db) < 0.01) {
+        // Pinned at a limit
+        return;
+    }
+    float gain_db = (float)gain;
+    if (!src->set_exposure(src, &exposure, &gain_db)) {
+        return;
+    }
+    Log(TRACE,
+        "Auto exposure: luma %.1f, %d us, %.2f dB\n",
+        ae->luma,
+        exposure,
+        gain_db);
+    ae->exposure_us = exposure;
+    ae->gain_db = gain_db;
+    ae->waited = 0;
+    atomic_fetch_add(&ae->steps, 1);
+}
+
+void AutoExposureUpdate(
+    AutoExposure* ae, FrameSource* src, const Frame* frame) {
+    TraceBegin("auto exposure");
+    uint64_t t0 = NowNs();
+    if (ae->exposure_us == 0) {
+        ae->exposure_us =
+            frame->exposure_us > 0 ? frame->exposure_us : src->exposure_us;
+        ae->gain_db = frame->gain_db;
+    }
+    if (Meter(ae, frame)) {
+        // Sources that don't report exposure per frame count as showing it
+        bool shows =
+            frame->exposure_us == 0 ||
+            (abs(frame->exposure_us - ae->exposure_us) <=
+                 1 + ae->exposure_us / 100 &&
+             fabsf(frame->gain_db - ae->gain_db) < 0.1f);
+        ae->waited += 1;
+        if (shows || ae->waited > AE_MAX_WAIT_FRAMES) {
+            Steer(ae, src);
+        }
+        atomic_store(&ae->shown_luma, (int)(ae->luma + 0.5));
+    }
+    atomic_store(&ae->shown_exposure_us, ae->exposure_us);
+    atomic_store(&ae->shown_gain_cdb, (int)lroundf(ae->gain_db * 100.0f));
+    atomic_fetch_add(&ae->meter_ns, NowNs() - t0);
+    atomic_fetch_add(&ae->metered, 1);
+    TraceEnd("auto exposure");
+}
@@ -0,0 +1,59 @@
+#ifndef XICLOPS_AUTO_EXPOSURE_H
+#define XICLOPS_AUTO_EXPOSURE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "frame.h"
+#include "frame_source.h"
+
+// Closed-loop exposure control on the capture thread. Every frame is metered
+// on a sparse grid (a few thousand samples, tens of microseconds at 4K) and
+// the source is steered toward a target mean luma in the log domain:
+// exposure time first, gain only once exposure is at its ceiling. A change is
+// only followed by another once a frame taken with it comes back, which keeps
+// the loop stable however many frames the sensor lags.
+#define AUTO_EXPOSURE_SAMPLES 4096
+
+typedef struct AutoExposureConfig {
+    double target;   // mean luma to settle on, 0-255
+    double damping;  // share of the error (in stops) corrected per step, 0-1
+    // Metering region as fractions of the frame
+    float region_x;
+    float region_y;
+    float region_w;
+    float region_h;
+    int max_exposure_us;  // 0 for the frame period, so the rate holds
+    float max_gain_db;
+} AutoExposureConfig;
+
+typedef struct AutoExposure {
+    AutoExposureConfig cfg;
+    int min_exposure_us;
+    int max_exposure_us;
+    float min_gain_db;
+    float max_gain_db;
+    // Capture thread only
+    int exposure_us;  // last applied, 0 until the first frame
+    float gain_db;
+    int waited;    // frames metered since the last change without showing it
+    double luma;   // mean of the last metered frame
+    int median;    // of the same; pinned at 0 or 255 the mean says little
+    uint8_t samples[3][AUTO_EXPOSURE_SAMPLES];
+    // For display
+    atomic_int shown_exposure_us;
+    atomic_int shown_gain_cdb;  // hundredths of a dB
+    atomic_int shown_luma;
+    atomic_uint_least64_t steps;  // changes sent to the source
+    atomic_uint_least64_t meter_ns;
+    atomic_uint_least64_t metered;
+} AutoExposure;
+
+// False if the source can't change exposure while acquiring
+bool AutoExposureInit(
+    AutoExposure* ae, const AutoExposureConfig* cfg, const FrameSource* src);
+// Capture thread, once per frame
+void AutoExposureUpdate(AutoExposure* ae, FrameSource* src, const Frame* frame);
+
+#endif  // XICLOPS_AUTO_EXPOSURE_H
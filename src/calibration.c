@@ -0,0 +1,652 @@
+#include "calibration.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "frame_pool.h"
+#include "log.h"
+#include "trace.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// A flat pixel this far below its site's mean (less the dark) is taken as
+// dead rather than dim, and left uncorrected instead of amplified
+#define CALIBRATION_MIN_FLAT_SHARE 0.0625
+#define CALIBRATION_MAX_GAIN 65535
+
+typedef struct CalibrationFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint32_t bit_depth;
+    uint32_t has_dark;
+    uint32_t has_flat;
+} CalibrationFileHeader;
+
+static size_t Pixels(const Calibration* cal) {
+    return (size_t)cal->width * cal->height;
+}
+
+static int SampleMax(const Calibration* cal) {
+    int depth = cal->bit_depth < 1    ? 8
+                : cal->bit_depth > 16 ? 16
+                                      : cal->bit_depth;
+    return (1 << depth) - 1;
+}
+
+bool CalibrationAlloc(
+    Calibration* cal,
+    int width,
+    int height,
+    FrameFormat format,
+    int bit_depth) {
+    memset(cal, 0, sizeof(*cal));
+    if (format == FRAME_RGB32 || width <= 0 || height <= 0) {
+        return false;
+    }
+    cal->width = width;
+    cal->height = height;
+    cal->format = format;
+    cal->bit_depth = bit_depth;
+    cal->dark = calloc(Pixels(cal), sizeof(*cal->dark));
+    cal->gain = malloc(Pixels(cal) * sizeof(*cal->gain));
+    if (cal->dark == NULL || cal->gain == NULL) {
+        CalibrationFree(cal);
+        return false;
+    }
+    for (size_t i = 0; i < Pixels(cal); ++i) {
+        cal->gain[i] = CALIBRATION_GAIN_ONE;
+    }
+    return true;
+}
+
+void CalibrationFree(Calibration* cal) {
+    free(cal->dark);
+    free(cal->gain);
+    cal->dark = NULL;
+    cal->gain = NULL;
+}
+
+Calibration* CalibrationCreate(
+    int width, int height, FrameFormat format, int bit_depth) {
+    Calibration* cal = malloc(sizeof(*cal));
+    if (cal == NULL) {
+        return NULL;
+    }
+    if (!CalibrationAlloc(cal, width, height, format, bit_depth)) {
+        free(cal);
+        return NULL;
+    }
+    atomic_init(&cal->refs, 1);
+    return cal;
+}
+
+Calibration* CalibrationCopy(const Calibration* cal) {
+    Calibration* copy = CalibrationCreate(
+        cal->width, cal->height, cal->format, cal->bit_depth);
+    if (copy == NULL) {
+        return NULL;
+    }
+    memcpy(copy->dark, cal->dark, Pixels(cal) * sizeof(*cal->dark));
+    memcpy(copy->gain, cal->gain, Pixels(cal) * sizeof(*cal->gain));
+    copy->has_dark = cal->has_dark;
+    copy->has_flat = cal->has_flat;
+    copy->version = cal->version;
+    return copy;
+}
+
+void CalibrationRetain(Calibration* cal) {
+    if (cal != NULL) {
+        atomic_fetch_add(&cal->refs, 1);
+    }
+}
+
+void CalibrationRelease(Calibration* cal) {
+    if (cal != NULL && atomic_fetch_sub(&cal->refs, 1) == 1) {
+        CalibrationFree(cal);
+        free(cal);
+    }
+}
+
+bool CalibrationLoad(Calibration* cal, const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        Log(ERROR, "Failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    CalibrationFileHeader h;
+    bool ok = fread(&h, sizeof(h), 1, f) == 1 &&
+              memcmp(h.magic, CALIBRATION_MAGIC, sizeof(CALIBRATION_MAGIC)) ==
+                  0 &&
+              h.version == CALIBRATION_VERSION;
+    if (!ok) {
+        Log(ERROR, "%s is not a calibration file\n", path);
+        fclose(f);
+        return false;
+    }
+    if (h.width != (uint32_t)cal->width || h.height != (uint32_t)cal->height ||
+        h.format != (uint32_t)cal->format ||
+        h.bit_depth != (uint32_t)cal->bit_depth) {
+        Log(ERROR,
+            "%s was taken at %ux%u %s %u-bit, not %dx%d %s %d-bit\n",
+            path,
+            h.width,
+            h.height,
+            h.format == FRAME_RAW16 ? "RAW16" : "RAW8",
+            h.bit_depth,
+            cal->width,
+            cal->height,
+            cal->format == FRAME_RAW16 ? "RAW16" : "RAW8",
+            cal->bit_depth);
+        fclose(f);
+        return false;
+    }
+    // Read aside, so a truncated file leaves the references as they were
+    Calibration loaded;
+    if (!CalibrationAlloc(
+            &loaded, cal->width, cal->height, cal->format, cal->bit_depth)) {
+        fclose(f);
+        return false;
+    }
+    ok = fread(loaded.dark, sizeof(*loaded.dark), Pixels(cal), f) ==
+             Pixels(cal) &&
+         fread(loaded.gain, sizeof(*loaded.gain), Pixels(cal), f) ==
+             Pixels(cal);
+    fclose(f);
+    if (!ok) {
+        Log(ERROR, "%s is truncated\n", path);
+        CalibrationFree(&loaded);
+        return false;
+    }
+    // Swap the planes rather than the whole struct, which may be shared
+    uint16_t* dark = cal->dark;
+    uint16_t* gain = cal->gain;
+    cal->dark = loaded.dark;
+    cal->gain = loaded.gain;
+    loaded.dark = dark;
+    loaded.gain = gain;
+    CalibrationFree(&loaded);
+    cal->has_dark = h.has_dark != 0;
+    cal->has_flat = h.has_flat != 0;
+    return true;
+}
+
+bool CalibrationSave(const Calibration* cal, const char* path) {
+    CalibrationFileHeader h = {
+        .version = CALIBRATION_VERSION,
+        .width = (uint32_t)cal->width,
+        .height = (uint32_t)cal->height,
+        .format = (uint32_t)cal->format,
+        .bit_depth = (uint32_t)cal->bit_depth,
+        .has_dark = cal->has_dark,
+        .has_flat = cal->has_flat,
+    };
+    memcpy(h.magic, CALIBRATION_MAGIC, sizeof(CALIBRATION_MAGIC));
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        Log(ERROR, "Failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(cal->dark, sizeof(*cal->dark), Pixels(cal), f) ==
+                  Pixels(cal) &&
+              fwrite(cal->gain, sizeof(*cal->gain), Pixels(cal), f) ==
+                  Pixels(cal);
+    ok = fclose(f) == 0 && ok;
+    if (!ok) {
+        Log(ERROR, "Failed to write %s\n", path);
+    }
+    return ok;
+}
+
+bool CalibrationLoadRecording(Calibration* cal, const Recording* rec) {
+    const RecordingHeader* h = &rec->header;
+    size_t bytes = Pixels(cal) * sizeof(uint16_t);
+    bool stored = (h->calibration & (RECORDING_DARK | RECORDING_FLAT)) != 0;
+    if (!stored) {
+        return false;
+    }
+    // Both planes sit between the header block and the first frame
+    bool fits = h->width == (uint32_t)cal->width &&
+                h->height == (uint32_t)cal->height &&
+                h->format == (uint32_t)cal->format &&
+                h->bit_depth == (uint32_t)cal->bit_depth;
+    fits = fits && h->dark_offset >= RECORDING_HEADER_BYTES &&
+           h->gain_offset >= RECORDING_HEADER_BYTES &&
+           h->dark_offset <= h->header_bytes &&
+           h->gain_offset <= h->header_bytes &&
+           bytes <= h->header_bytes - h->dark_offset &&
+           bytes <= h->header_bytes - h->gain_offset;
+    if (!fits) {
+        Log(WARN,
+            "The recording's calibration references don't match its "
+            "frames, not applying them\n");
+        return false;
+    }
+    memcpy(cal->dark, rec->map + h->dark_offset, bytes);
+    memcpy(cal->gain, rec->map + h->gain_offset, bytes);
+    cal->has_dark = (h->calibration & RECORDING_DARK) != 0;
+    cal->has_flat = (h->calibration & RECORDING_FLAT) != 0;
+    return true;
+}
+
+static uint32_t SumAt(const uint32_t* sums, size_t i, int frames) {
+    return (sums[i] + (uint32_t)frames / 2) / (uint32_t)frames;
+}
+
+void CalibrationSetReference(
+    Calibration* cal, CalibrationKind kind, const uint32_t* sums, int frames) {
+    size_t n = Pixels(cal);
+    if (kind == CALIBRATION_DARK) {
+        for (size_t i = 0; i < n; ++i) {
+            cal->dark[i] = (uint16_t)SumAt(sums, i, frames);
+        }
+        cal->has_dark = true;
+        return;
+    }
+    // Each of the four sites of the 2x2 tile is normalised to its own mean,
+    // which keeps the colour of the light (and the white balance) as it was
+    double mean[4] = {0.0, 0.0, 0.0, 0.0};
+    double count[4] = {0.0, 0.0, 0.0, 0.0};
+    for (int y = 0; y < cal->height; ++y) {
+        for (int x = 0; x < cal->width; ++x) {
+            size_t i = (size_t)y * cal->width + x;
+            int site = (y & 1) * 2 + (x & 1);
+            mean[site] += (double)sums[i] / frames - cal->dark[i];
+            count[site] += 1.0;
+        }
+    }
+    for (int site = 0; site < 4; ++site) {
+        mean[site] = count[site] > 0.0 ? mean[site] / count[site] : 0.0;
+    }
+    for (int y = 0; y < cal->height; ++y) {
+        for (int x = 0; x < cal->width; ++x) {
+            size_t i = (size_t)y * cal->width + x;
+            double site = mean[(y & 1) * 2 + (x & 1)];
+            double level = (double)sums[i] / frames - cal->dark[i];
+            double gain = 1.0;
+            if (site > 0.0 && level >= site * CALIBRATION_MIN_FLAT_SHARE) {
+                gain = site / level;
+            }
+            double g = gain * CALIBRATION_GAIN_ONE + 0.5;
+            cal->gain[i] = (uint16_t)(g < CALIBRATION_MAX_GAIN
+                                          ? g
+                                          : CALIBRATION_MAX_GAIN);
+        }
+    }
+    cal->has_flat = true;
+}
+
+static inline int CorrectSample(int raw, int dark, int gain, int max) {
+    uint32_t v = raw > dark ? (uint32_t)(raw - dark) : 0u;
+    uint32_t half = 1u << (CALIBRATION_GAIN_BITS - 1);
+    uint32_t out = (v * (uint32_t)gain + half) >> CALIBRATION_GAIN_BITS;
+    return out > (uint32_t)max ? max : (int)out;
+}
+
+static void Raw8RowScalar(
+    const uint8_t* in,
+    const uint16_t* dark,
+    const uint16_t* gain,
+    int x,
+    int n,
+    uint8_t* out) {
+    for (; x < n; ++x) {
+        out[x] = (uint8_t)CorrectSample(in[x], dark[x], gain[x], 255);
+    }
+}
+
+static void Raw16RowScalar(
+    const uint16_t* in,
+    const uint16_t* dark,
+    const uint16_t* gain,
+    int x,
+    int n,
+    int max,
+    uint16_t* out) {
+    for (; x < n; ++x) {
+        out[x] = (uint16_t)CorrectSample(in[x], dark[x], gain[x], max);
+    }
+}
+
+#ifdef __SSE2__
+// (v * g + half) >> GAIN_BITS for eight 16-bit lanes, through the 32-bit
+// products, saturated back to signed 16 bits. Exact as long as v < 2^15.
+static inline __m128i Scale(__m128i v, __m128i g) {
+    const __m128i half = _mm_set1_epi32(1 << (CALIBRATION_GAIN_BITS - 1));
+    __m128i lo = _mm_mullo_epi16(v, g);
+    __m128i hi = _mm_mulhi_epu16(v, g);
+    __m128i p0 = _mm_add_epi32(_mm_unpacklo_epi16(lo, hi), half);
+    __m128i p1 = _mm_add_epi32(_mm_unpackhi_epi16(lo, hi), half);
+    p0 = _mm_srli_epi32(p0, CALIBRATION_GAIN_BITS);
+    p1 = _mm_srli_epi32(p1, CALIBRATION_GAIN_BITS);
+    return _mm_packs_epi32(p0, p1);
+}
+
+// Sixteen samples per iteration; returns the first x it did not process
+static int Raw8RowSse2(
+    const uint8_t* in,
+    const uint16_t* dark,
+    const uint16_t* gain,
+    int n,
+    uint8_t* out) {
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m128i raw = _mm_loadu_si128((const __m128i*)(in + x));
+        __m128i v0 = _mm_subs_epu16(
+            _mm_unpacklo_epi8(raw, zero),
+            _mm_loadu_si128((const __m128i*)(dark + x)));
+        __m128i v1 = _mm_subs_epu16(
+            _mm_unpackhi_epi8(raw, zero),
+            _mm_loadu_si128((const __m128i*)(dark + x + 8)));
+        __m128i r0 = Scale(v0, _mm_loadu_si128((const __m128i*)(gain + x)));
+        __m128i r1 =
+            Scale(v1, _mm_loadu_si128((const __m128i*)(gain + x + 8)));
+        _mm_storeu_si128((__m128i*)(out + x), _mm_packus_epi16(r0, r1));
+    }
+    return x;
+}
+
+// Eight samples per iteration; `max` below 2^15
+static int Raw16RowSse2(
+    const uint16_t* in,
+    const uint16_t* dark,
+    const uint16_t* gain,
+    int n,
+    int max,
+    uint16_t* out) {
+    const __m128i top = _mm_set1_epi16((short)max);
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m128i v = _mm_subs_epu16(
+            _mm_loadu_si128((const __m128i*)(in + x)),
+            _mm_loadu_si128((const __m128i*)(dark + x)));
+        __m128i r = Scale(v, _mm_loadu_si128((const __m128i*)(gain + x)));
+        _mm_storeu_si128((__m128i*)(out + x), _mm_min_epi16(r, top));
+    }
+    return x;
+}
+#endif
+
+// Every sample is read before its own output is written, so the pixels may
+// already be in storage. SSE2 is part of x86-64, so no runtime dispatch.
+static bool Correct(const Calibration* cal, Frame* frame, bool simd) {
+    size_t bytes = (size_t)frame->width * frame->height *
+                   FrameBytesPerPixel(frame->format);
+    bool fits = frame->format == cal->format && frame->roi_x >= 0 &&
+                frame->roi_y >= 0 &&
+                frame->roi_x + frame->width <= cal->width &&
+                frame->roi_y + frame->height <= cal->height &&
+                frame->size >= bytes && frame->capacity >= bytes;
+    if (!fits) {
+        return false;
+    }
+    int max = SampleMax(cal);
+    // Lanes are signed 16 bits past the products
+    simd = simd && (frame->format == FRAME_RAW8 || max < 32768);
+    for (int y = 0; y < frame->height; ++y) {
+        size_t at = (size_t)(frame->roi_y + y) * cal->width + frame->roi_x;
+        size_t row = (size_t)y * frame->width;
+        const uint16_t* dark = cal->dark + at;
+        const uint16_t* gain = cal->gain + at;
+        int x = 0;
+        if (frame->format == FRAME_RAW8) {
+            const uint8_t* in = frame->data + row;
+            uint8_t* out = frame->storage + row;
+#ifdef __SSE2__
+            x = simd ? Raw8RowSse2(in, dark, gain, frame->width, out) : 0;
+#endif
+            Raw8RowScalar(in, dark, gain, x, frame->width, out);
+        } else {
+            const uint16_t* in = (const uint16_t*)frame->data + row;
+            uint16_t* out = (uint16_t*)frame->storage + row;
+#ifdef __SSE2__
+            x = simd ? Raw16RowSse2(in, dark, gain, frame->width, max, out)
+                     : 0;
+#endif
+            Raw16RowScalar(in, dark, gain, x, frame->width, max, out);
+        }
+    }
+    frame->data = frame->storage;
+    frame->transient = false;
+    return true;
+}
+
+bool CalibrationCorrect(const Calibration* cal, Frame* frame) {
+    return Correct(cal, frame, true);
+}
+
+bool CalibrationCorrectScalar(const Calibration* cal, Frame* frame) {
+    return Correct(cal, frame, false);
+}
+
+static unsigned References(const Calibration* cal) {
+    return (cal->has_dark ? RECORDING_DARK : 0) |
+           (cal->has_flat ? RECORDING_FLAT : 0);
+}
+
+// Builds the set the capture thread handed sums for: a copy of the set in
+// effect with the new reference, saved before the capture thread gets it
+static Calibration* Build(Calibrator* c) {
+    const char* name = c->kind == CALIBRATION_DARK ? "dark" : "flat";
+    Calibration* cal = CalibrationCopy(c->job_base);
+    if (cal != NULL) {
+        TraceBegin("calibration build");
+        CalibrationSetReference(cal, c->kind, c->job_sums, c->job_frames);
+        TraceEnd("calibration build");
+        cal->version = c->job_base->version + 1;
+        Log(INFO,
+            "Calibration: %s reference from %d frames, set %u\n",
+            name,
+            c->job_frames,
+            cal->version);
+    } else {
+        Log(ERROR, "Calibration: out of memory for the %s reference\n", name);
+    }
+    CalibrationRelease(c->job_base);
+    c->job_base = NULL;
+    free(c->job_sums);
+    c->job_sums = NULL;
+    if (cal != NULL && c->path != NULL) {
+        TraceBegin("calibration save");
+        if (CalibrationSave(cal, c->path)) {
+            Log(INFO, "Calibration: saved to %s\n", c->path);
+        }
+        TraceEnd("calibration save");
+    }
+    return cal;
+}
+
+static void* BuildThread(void* arg) {
+    Calibrator* c = arg;
+    TraceSetThreadName("calibration");
+    FramePoolPinThread();
+    for (;;) {
+        pthread_mutex_lock(&c->lock);
+        while (!atomic_load(&c->building) && !c->stopping) {
+            pthread_cond_wait(&c->wake, &c->lock);
+        }
+        bool stopping = c->stopping;
+        pthread_mutex_unlock(&c->lock);
+        if (!atomic_load(&c->building) && stopping) {
+            break;
+        }
+        c->built = Build(c);
+        atomic_store(&c->building, false);
+    }
+    return NULL;
+}
+
+bool CalibratorInit(
+    Calibrator* c,
+    const FrameSource* src,
+    const char* path,
+    const Recording* played,
+    int frames) {
+    memset(c, 0, sizeof(*c));
+    atomic_store(&c->progress, -1);
+    if (src->format == FRAME_RGB32) {
+        return false;
+    }
+    c->current = CalibrationCreate(
+        src->width, src->height, src->format, src->bit_depth);
+    if (c->current == NULL) {
+        return false;
+    }
+    Calibration* cal = c->current;
+    cal->version = 1;
+    c->path = path;
+    c->frames = frames > 0 ? frames : 1;
+    if (path != NULL && access(path, F_OK) == 0) {
+        if (CalibrationLoad(cal, path)) {
+            Log(INFO,
+                "Calibration: %s%s%s from %s\n",
+                cal->has_dark ? "dark" : "",
+                cal->has_dark && cal->has_flat ? " and " : "",
+                cal->has_flat ? "flat" : "",
+                path);
+        }
+    } else if (played != NULL &&
+               (played->header.calibration & RECORDING_CORRECTED) == 0 &&
+               CalibrationLoadRecording(cal, played)) {
+        Log(INFO, "Calibration: applying the references of the recording\n");
+    }
+    atomic_store(&c->references, References(cal));
+    atomic_store(&c->version, cal->version);
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->wake, NULL);
+    if (pthread_create(&c->thread, NULL, BuildThread, c) != 0) {
+        pthread_cond_destroy(&c->wake);
+        pthread_mutex_destroy(&c->lock);
+        CalibrationRelease(c->current);
+        c->current = NULL;
+        return false;
+    }
+    return true;
+}
+
+void CalibratorFree(Calibrator* c) {
+    pthread_mutex_lock(&c->lock);
+    c->stopping = true;
+    pthread_cond_signal(&c->wake);
+    pthread_mutex_unlock(&c->lock);
+    pthread_join(c->thread, NULL);
+    pthread_cond_destroy(&c->wake);
+    pthread_mutex_destroy(&c->lock);
+    CalibrationRelease(c->built);
+    CalibrationRelease(c->current);
+    c->built = NULL;
+    c->current = NULL;
+    free(c->sums);
+    c->sums = NULL;
+}
+
+void CalibratorRequest(Calibrator* c, CalibrationKind kind) {
+    if (c->fixed) {
+        Log(WARN,
+            "Calibration: the raw recording relies on the references it "
+            "started with, not taking new ones\n");
+        return;
+    }
+    atomic_store(&c->request, (int)kind + 1);
+}
+
+static void Accumulate(uint32_t* sums, const Frame* frame) {
+    size_t n = (size_t)frame->width * frame->height;
+    if (frame->format == FRAME_RAW8) {
+        const uint8_t* in = frame->data;
+        for (size_t i = 0; i < n; ++i) {
+            sums[i] += in[i];
+        }
+    } else {
+        const uint16_t* in = (const uint16_t*)frame->data;
+        for (size_t i = 0; i < n; ++i) {
+            sums[i] += in[i];
+        }
+    }
+}
+
+void CalibratorAverage(Calibrator* c, const Frame* frame) {
+    // The builder is done with the sums; the old set stays with any frame
+    // that still holds it
+    if (c->handed && !atomic_load(&c->building)) {
+        c->handed = false;
+        if (c->built != NULL) {
+            CalibrationRelease(c->current);
+            c->current = c->built;
+            c->built = NULL;
+            atomic_store(&c->references, References(c->current));
+            atomic_store(&c->version, c->current->version);
+        }
+        atomic_store(&c->progress, -1);
+    }
+    if (c->averaging == 0) {
+        if (c->handed) {
+            return;
+        }
+        int kind = atomic_exchange(&c->request, 0);
+        if (kind == 0) {
+            return;
+        }
+        c->sums = calloc(Pixels(c->current), sizeof(*c->sums));
+        if (c->sums == NULL) {
+            Log(ERROR, "Calibration: out of memory for the averages\n");
+            return;
+        }
+        c->averaging = kind;
+        c->taken = 0;
+        atomic_store(&c->progress, 0);
+    }
+    // Cropped frames don't cover the references
+    const Calibration* cal = c->current;
+    bool full = frame->roi_x == 0 && frame->roi_y == 0 &&
+                frame->width == cal->width && frame->height == cal->height &&
+                frame->format == cal->format;
+    if (!full) {
+        return;
+    }
+    TraceBegin("calibration average");
+    Accumulate(c->sums, frame);
+    TraceEnd("calibration average");
+    c->taken += 1;
+    atomic_store(&c->progress, c->taken);
+    if (c->taken < c->frames) {
+        return;
+    }
+    // Averaging and saving take longer than a frame, so the builder does it
+    c->kind = (CalibrationKind)(c->averaging - 1);
+    c->job_sums = c->sums;
+    c->job_frames = c->taken;
+    c->job_base = c->current;
+    CalibrationRetain(c->job_base);
+    c->sums = NULL;
+    c->averaging = 0;
+    c->handed = true;
+    pthread_mutex_lock(&c->lock);
+    atomic_store(&c->building, true);
+    pthread_cond_signal(&c->wake);
+    pthread_mutex_unlock(&c->lock);
+}
+
+void CalibratorCorrect(Calibrator* c, Frame* frame) {
+    if (References(c->current) == 0) {
+        return;
+    }
+    TraceBegin("calibrate");
+    uint64_t t0 = NowNs();
+    bool corrected = CalibrationCorrect(c->current, frame);
+    TraceEnd("calibrate");
+    if (corrected) {
+        atomic_fetch_add(&c->correct_ns, NowNs() - t0);
+        atomic_fetch_add(&c->corrected, 1);
+    }
+}
@@ -0,0 +1,139 @@
+#ifndef XICLOPS_CALIBRATION_H
+#define XICLOPS_CALIBRATION_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "frame.h"
+#include "frame_source.h"
+#include "recording.h"
+
+// Dark-frame and flat-field correction of raw mosaics, on the capture thread
+// ahead of the recorder:
+//
+//   out = (raw - dark) * gain
+//
+// per pixel, rounded and clamped to the sample range. `dark` is the average
+// of frames taken with the lens capped, `gain` scales the average of frames
+// of an evenly lit target (less the dark) to its mean, per Bayer site so the
+// colour balance is kept. Both only hold for the exposure and gain they were
+// taken at. Gains are fixed point, CALIBRATION_GAIN_ONE being 1.0.
+#define CALIBRATION_GAIN_BITS 12
+#define CALIBRATION_GAIN_ONE (1 << CALIBRATION_GAIN_BITS)
+#define CALIBRATION_MAGIC "XICLCAL"
+#define CALIBRATION_VERSION 1
+
+typedef enum CalibrationKind {
+    CALIBRATION_DARK,
+    CALIBRATION_FLAT,
+} CalibrationKind;
+
+typedef struct Calibration {
+    int width;  // the source's full frame
+    int height;
+    FrameFormat format;  // RAW8 or RAW16
+    int bit_depth;
+    bool has_dark;  // else `dark` is all zeros
+    bool has_flat;  // else `gain` is all CALIBRATION_GAIN_ONE
+    uint16_t* dark;  // width * height, in sample units
+    uint16_t* gain;  // width * height
+    uint32_t version;  // sets a calibrator has applied, counting this one
+    atomic_int refs;   // holders of a shared set, see CalibrationCreate()
+} Calibration;
+
+// Neutral references for frames of the given geometry
+bool CalibrationAlloc(
+    Calibration* cal, int width, int height, FrameFormat format, int bit_depth);
+void CalibrationFree(Calibration* cal);
+// Sets shared between threads live on the heap and aren't changed once
+// another thread can see them; new references make a new set. Each holder
+// counts itself in with CalibrationRetain() and the last one to release the
+// set frees it. Both take NULL. Created with one holder, NULL if out of
+// memory.
+Calibration* CalibrationCreate(
+    int width, int height, FrameFormat format, int bit_depth);
+// A new set with the same references, one holder
+Calibration* CalibrationCopy(const Calibration* cal);
+void CalibrationRetain(Calibration* cal);
+void CalibrationRelease(Calibration* cal);
+// Reference files hold a small header followed by the dark and gain planes.
+// Loading fails, leaving `cal` alone, if the file was made for a different
+// geometry.
+bool CalibrationLoad(Calibration* cal, const char* path);
+bool CalibrationSave(const Calibration* cal, const char* path);
+// The references a recording carries (see recording.h), if any
+bool CalibrationLoadRecording(Calibration* cal, const Recording* rec);
+
+// Sets the dark or flat reference from per-pixel sums over `frames` frames.
+// A flat uses the dark in effect, so take the dark first.
+void CalibrationSetReference(
+    Calibration* cal, CalibrationKind kind, const uint32_t* sums, int frames);
+
+// Corrects `frame`, a full frame or a ROI of one, into `frame->storage`,
+// which may be where the pixels already are; like DownsampleFrame() it stops
+// being transient. False, leaving it alone, if it isn't a mosaic of the
+// references' geometry.
+bool CalibrationCorrect(const Calibration* cal, Frame* frame);
+// Same with the SIMD kernels turned off, for checking them
+bool CalibrationCorrectScalar(const Calibration* cal, Frame* frame);
+
+// Applies the references on the capture thread and averages new ones when
+// asked. Only the summing happens there: a builder thread turns the sums into
+// a new set and saves it, and the capture thread switches to that set between
+// frames. Frames kept for later (the pre-trigger ring) hold on to the set
+// they were taken with.
+typedef struct Calibrator {
+    const char* path;  // references are saved here once taken, NULL for none
+    int frames;        // averaged per reference
+    bool fixed;  // a raw recording relies on the references, take no others
+    atomic_int request;  // CalibrationKind + 1 asked for, 0 if none
+    // Capture thread only
+    Calibration* current;  // applied to frames, never NULL
+    int averaging;  // CalibrationKind + 1 being averaged, 0 if none
+    int taken;
+    uint32_t* sums;
+    bool handed;  // sums with the builder, its set not yet switched to
+
+    // The handed sums, written by the capture thread while not `building`
+    CalibrationKind kind;
+    uint32_t* job_sums;
+    int job_frames;
+    Calibration* job_base;  // the set to change, held for the builder
+    Calibration* built;  // NULL if building failed, taken by capture thread
+    atomic_bool building;  // set by the capture thread, cleared once built
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool stopping;  // guarded by lock
+
+    // For display
+    atomic_int progress;  // frames averaged so far, -1 when idle
+    atomic_uint references;  // RECORDING_DARK | RECORDING_FLAT in effect
+    atomic_uint version;     // of the set in effect
+    atomic_uint_least64_t correct_ns;
+    atomic_uint_least64_t corrected;
+} Calibrator;
+
+// For the source's full frame, starting from the references in `path` if it
+// exists, else from those `played` was recorded raw with (NULL if not playing
+// back), else from none, and starts the builder. False for RGB32 sources.
+bool CalibratorInit(
+    Calibrator* c,
+    const FrameSource* src,
+    const char* path,
+    const Recording* played,
+    int frames);
+// Waits for a set being built, which is still saved
+void CalibratorFree(Calibrator* c);
+// Any thread: averages the next `frames` full frames into a new reference,
+// once the previous one is built
+void CalibratorRequest(Calibrator* c, CalibrationKind kind);
+// Capture thread, once per frame before CalibratorCorrect(): switches to a
+// newly built set, then sums the frame if averaging
+void CalibratorAverage(Calibrator* c, const Frame* frame);
+// Capture thread: corrects the frame with `current` once it has references
+void CalibratorCorrect(Calibrator* c, Frame* frame);
+
+#endif  // XICLOPS_CALIBRATION_H
@@ -0,0 +1,334 @@
+#include "capture.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "clock.h"
+#include "downsample.h"
+#include "log.h"
+#include "trace.h"
+
+// Short enough that CaptureStop() never waits long on a silent camera
+static const int CAPTURE_TIMEOUT_MS = 100;
+
+// Frame counter and timestamp bookkeeping, owned by the capture thread.
+// Intervals that span a drop are left out of the jitter statistics so one
+// lost frame doesn't read as a timing spike.
+typedef struct HealthTracker {
+    bool primed;
+    uint32_t last_nframe;
+    uint64_t last_ts_us;
+    uint64_t window_start_ns;
+    uint64_t frames;
+    uint64_t dropped;
+    uint64_t gaps;
+    uint64_t window_frames;
+    uint64_t window_dropped;
+    uint64_t intervals;
+    double sum_us;
+    double sum_sq_us;
+    double min_us;
+    double max_us;
+} HealthTracker;
+
+static void HealthTrack(HealthTracker* t, const Frame* frame) {
+    t->frames += 1;
+    t->window_frames += 1;
+    if (t->primed) {
+        // Unsigned difference handles counter wrap; a step backwards means
+        // the camera restarted its counter rather than dropped 4 billion
+        uint32_t step = frame->nframe - t->last_nframe;
+        if (step > 1 && step < (1u << 31)) {
+            Log(DEBUG,
+                "Sensor dropped %u frames before %u\n",
+                step - 1,
+                frame->nframe);
+            t->dropped += step - 1;
+            t->window_dropped += step - 1;
+            t->gaps += 1;
+        } else if (step == 1 && frame->timestamp_us >= t->last_ts_us) {
+            double dt = (double)(frame->timestamp_us - t->last_ts_us);
+            if (t->intervals == 0 || dt < t->min_us) {
+                t->min_us = dt;
+            }
+            if (dt > t->max_us) {
+                t->max_us = dt;
+            }
+            t->sum_us += dt;
+            t->sum_sq_us += dt * dt;
+            t->intervals += 1;
+        }
+    }
+    t->primed = true;
+    t->last_nframe = frame->nframe;
+    t->last_ts_us = frame->timestamp_us;
+}
+
+static void HealthPublish(Capture* cap, HealthTracker* t, uint64_t now) {
+    CaptureHealth h = {
+        .frames = t->frames,
+        .dropped = t->dropped,
+        .gaps = t->gaps,
+        .window_frames = t->window_frames,
+        .window_dropped = t->window_dropped,
+    };
+    if (t->intervals > 0) {
+        double n = (double)t->intervals;
+        double mean = t->sum_us / n;
+        double var = t->sum_sq_us / n - mean * mean;
+        h.interval_us = mean;
+        h.jitter_us = var > 0.0 ? sqrt(var) : 0.0;
+        h.interval_min_us = t->min_us;
+        h.interval_max_us = t->max_us;
+    }
+    pthread_mutex_lock(&cap->health_lock);
+    cap->health = h;
+    pthread_mutex_unlock(&cap->health_lock);
+
+    t->window_start_ns = now;
+    t->window_frames = 0;
+    t->window_dropped = 0;
+    t->intervals = 0;
+    t->sum_us = 0.0;
+    t->sum_sq_us = 0.0;
+    t->min_us = 0.0;
+    t->max_us = 0.0;
+}
+
+// Makes sure nobody reads the source's lent memory once it is asked for the
+// next frame: an offered frame is taken back at `offer_end`, a held one
+// waited for
+static void CaptureReclaim(Capture* cap, uint64_t offer_end) {
+    uint64_t wait_t0 = 0;
+    for (;;) {
+        uint64_t v = atomic_load(&cap->lease);
+        unsigned state = v & CAPTURE_LEASE_MASK;
+        if (state == CAPTURE_LEASE_NONE) {
+            break;
+        }
+        if (state == CAPTURE_LEASE_OFFERED) {
+            if (NowNs() < offer_end && atomic_load(&cap->running)) {
+                SleepUntilNs(NowNs() + 20000);
+                continue;
+            }
+            if (atomic_compare_exchange_strong(
+                    &cap->lease, &v, v & ~(uint64_t)CAPTURE_LEASE_MASK)) {
+                atomic_fetch_add(&cap->revoked, 1);
+                break;
+            }
+            continue;
+        }
+        // Held for the length of one upload; the driver queues meanwhile
+        if (!atomic_load(&cap->running)) {
+            break;
+        }
+        if (wait_t0 == 0) {
+            wait_t0 = NowNs();
+        }
+        SleepUntilNs(NowNs() + 20000);
+    }
+    if (wait_t0 != 0) {
+        atomic_fetch_add(&cap->lease_wait_ns, NowNs() - wait_t0);
+    }
+}
+
+static void CaptureApplyRoi(Capture* cap) {
+    pthread_mutex_lock(&cap->roi_lock);
+    SourceRoi roi = cap->roi_request;
+    atomic_store(&cap->roi_pending, false);
+    pthread_mutex_unlock(&cap->roi_lock);
+    FrameSource* src = cap->source;
+    if (src->set_roi == NULL) {
+        return;
+    }
+    TraceBegin("set roi");
+    bool applied = src->set_roi(src, &roi);
+    TraceEnd("set roi");
+    // A newer request supersedes this one anyway
+    pthread_mutex_lock(&cap->roi_lock);
+    if (!applied && !atomic_load(&cap->roi_pending)) {
+        cap->roi_refused = true;
+        cap->roi_applied = roi;
+    }
+    pthread_mutex_unlock(&cap->roi_lock);
+}
+
+static void* CaptureThread(void* arg) {
+    Capture* cap = arg;
+    FrameSource* src = cap->source;
+    TraceSetThreadName("capture");
+    FramePoolPinThread();
+    HealthTracker tracker = {.window_start_ns = NowNs()};
+    uint64_t period_ns =
+        src->rate_hz > 0.0 ? (uint64_t)(1e9 / src->rate_hz) : 0;
+    uint64_t offer_end = 0;
+    uint64_t last_arrival = 0;
+
+    while (atomic_load(&cap->running)) {
+        Frame* frame = TripleBufferWriteSlot(&cap->handoff);
+        CaptureReclaim(cap, offer_end);
+        if (atomic_load(&cap->roi_pending)) {
+            // Restarting acquisition releases the driver's buffers, which
+            // is why it waits for the lease above
+            CaptureApplyRoi(cap);
+            period_ns = src->rate_hz > 0.0 ? (uint64_t)(1e9 / src->rate_hz) : 0;
+        }
+        TraceBegin("acquire");
+        SourceStatus status = src->next(src, frame, CAPTURE_TIMEOUT_MS);
+        TraceEnd("acquire");
+        uint64_t now = NowNs();
+        if (now - tracker.window_start_ns >=
+            CAPTURE_HEALTH_WINDOW_MS * 1000000ull) {
+            if (src->feedback != NULL) {
+                src->feedback(
+                    src, tracker.window_frames, tracker.window_dropped);
+            }
+            HealthPublish(cap, &tracker, now);
+        }
+        if (status == SOURCE_TIMEOUT) {
+            continue;
+        }
+        if (status != SOURCE_OK) {
+            Log(ERROR, "%s source stopped delivering frames\n", src->name);
+            atomic_store(&cap->failed, true);
+            break;
+        }
+        HealthTrack(&tracker, frame);
+        // References are averaged from raw frames; the correction also
+        // copies lent memory out, so no lease either
+        if (cap->calibrator != NULL) {
+            CalibratorAverage(cap->calibrator, frame);
+            if (!cap->record_raw) {
+                CalibratorCorrect(cap->calibrator, frame);
+            }
+        }
+        if (cap->recorder != NULL) {
+            RecorderWrite(cap->recorder, frame);
+        }
+        if (cap->pretrigger != NULL) {
+            PreTriggerPush(
+                cap->pretrigger,
+                frame,
+                cap->calibrator != NULL ? cap->calibrator->current : NULL);
+        }
+        if (cap->calibrator != NULL && cap->record_raw) {
+            CalibratorCorrect(cap->calibrator, frame);
+        }
+        if (cap->auto_exposure != NULL) {
+            AutoExposureUpdate(cap->auto_exposure, src, frame);
+        }
+        if (cap->preview > 1) {
+            // Copies out of lent memory as a side effect, so no lease
+            TraceBegin("downsample");
+            DownsampleFrame(frame, cap->preview);
+            TraceEnd("downsample");
+        }
+        if (frame->transient) {
+            cap->lease_seq += 1;
+            cap->slot_lease[frame - cap->handoff.slots] = cap->lease_seq;
+            atomic_store(
+                &cap->lease, cap->lease_seq << 2 | CAPTURE_LEASE_OFFERED);
+            atomic_fetch_add(&cap->lent_bytes, frame->size);
+            // Keep it on offer until shortly before the next one is due, so
+            // the render loop finds a frame as often as it would with copies.
+            // Frames arriving much faster than the nominal rate mean the
+            // driver queue is backlogged (or the source unpaced): no slack.
+            bool paced = now - last_arrival > period_ns / 2;
+            offer_end = paced ? now + period_ns * 9 / 10 : 0;
+        }
+        last_arrival = now;
+        TripleBufferPublish(&cap->handoff);
+        TraceInstant("publish", frame->nframe);
+        atomic_fetch_add(&cap->frames, 1);
+    }
+    HealthPublish(cap, &tracker, NowNs());
+    return NULL;
+}
+
+bool CaptureStart(
+    Capture* cap,
+    FrameSource* source,
+    Recorder* recorder,
+    PreTrigger* pretrigger,
+    AutoExposure* auto_exposure,
+    Calibrator* calibrator,
+    bool record_raw,
+    int preview) {
+    memset(cap, 0, sizeof(*cap));
+    cap->source = source;
+    cap->recorder = recorder;
+    cap->pretrigger = pretrigger;
+    cap->auto_exposure = auto_exposure;
+    cap->calibrator = calibrator;
+    cap->record_raw = record_raw;
+    cap->preview = preview;
+    if (!TripleBufferInit(&cap->handoff, source->frame_bytes)) {
+        return false;
+    }
+    pthread_mutex_init(&cap->health_lock, NULL);
+    pthread_mutex_init(&cap->roi_lock, NULL);
+    atomic_store(&cap->running, true);
+    if (pthread_create(&cap->thread, NULL, CaptureThread, cap) != 0) {
+        pthread_mutex_destroy(&cap->roi_lock);
+        pthread_mutex_destroy(&cap->health_lock);
+        TripleBufferFree(&cap->handoff);
+        return false;
+    }
+    return true;
+}
+
+void CaptureStop(Capture* cap) {
+    atomic_store(&cap->running, false);
+    pthread_join(cap->thread, NULL);
+    pthread_mutex_destroy(&cap->roi_lock);
+    pthread_mutex_destroy(&cap->health_lock);
+    TripleBufferFree(&cap->handoff);
+}
+
+const Frame* CaptureLatest(Capture* cap) {
+    const Frame* frame = TripleBufferLatest(&cap->handoff);
+    if (frame == NULL || !frame->transient) {
+        return frame;
+    }
+    // Only the newest transient frame can be leased, and only while offered
+    uint64_t seq = cap->slot_lease[frame - cap->handoff.slots];
+    uint64_t offered = seq << 2 | CAPTURE_LEASE_OFFERED;
+    if (atomic_compare_exchange_strong(
+            &cap->lease, &offered, seq << 2 | CAPTURE_LEASE_HELD)) {
+        return frame;
+    }
+    return NULL;
+}
+
+void CaptureRelease(Capture* cap) {
+    uint64_t v = atomic_load(&cap->lease);
+    if ((v & CAPTURE_LEASE_MASK) == CAPTURE_LEASE_HELD) {
+        atomic_store(&cap->lease, v & ~(uint64_t)CAPTURE_LEASE_MASK);
+    }
+}
+
+void CaptureRequestRoi(Capture* cap, const SourceRoi* roi) {
+    pthread_mutex_lock(&cap->roi_lock);
+    cap->roi_request = *roi;
+    cap->roi_refused = false;
+    atomic_store(&cap->roi_pending, true);
+    pthread_mutex_unlock(&cap->roi_lock);
+}
+
+bool CaptureRoiRefused(Capture* cap, SourceRoi* roi) {
+    pthread_mutex_lock(&cap->roi_lock);
+    bool refused = cap->roi_refused;
+    if (refused) {
+        *roi = cap->roi_applied;
+        cap->roi_refused = false;
+    }
+    pthread_mutex_unlock(&cap->roi_lock);
+    return refused;
+}
+
+CaptureHealth CaptureGetHealth(Capture* cap) {
+    pthread_mutex_lock(&cap->health_lock);
+    CaptureHealth h = cap->health;
+    pthread_mutex_unlock(&cap->health_lock);
+    return h;
+}
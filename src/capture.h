@@ -0,0 +1,112 @@
+#ifndef XICLOPS_CAPTURE_H
+#define XICLOPS_CAPTURE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "auto_exposure.h"
+#include "calibration.h"
+#include "frame_source.h"
+#include "pretrigger.h"
+#include "recorder.h"
+#include "triple_buffer.h"
+
+// Sensor-side delivery health derived from the frame counter (acq_nframe)
+// and the hardware timestamps. Totals cover the whole run; the window fields
+// describe the frames received in the last CAPTURE_HEALTH_WINDOW_MS.
+typedef struct CaptureHealth {
+    uint64_t frames;   // frames received from the source
+    uint64_t dropped;  // frame numbers that never arrived
+    uint64_t gaps;     // runs of consecutive missing frames
+    uint64_t window_frames;
+    uint64_t window_dropped;
+    double interval_us;  // mean interval between consecutive frames
+    double jitter_us;    // standard deviation of that interval
+    double interval_min_us;
+    double interval_max_us;
+} CaptureHealth;
+
+#define CAPTURE_HEALTH_WINDOW_MS 1000
+
+// Transient frames are handed to the consumer under a lease kept in
+// Capture.lease: the sequence number of the newest transient frame shifted
+// left by two, plus one of these states. Before asking the source for the
+// next frame, which overwrites the lent memory, the capture thread takes back
+// an offered lease, once the next frame is nearly due, or waits for a held
+// one to be released.
+#define CAPTURE_LEASE_NONE 0u
+#define CAPTURE_LEASE_OFFERED 1u
+#define CAPTURE_LEASE_HELD 2u
+#define CAPTURE_LEASE_MASK 3u
+
+// Acquisition thread that drains a frame source at its full rate,
+// independent of the render loop's frame pacing.
+typedef struct Capture {
+    FrameSource* source;
+    Recorder* recorder;  // optional, fed every frame on the capture thread
+    PreTrigger* pretrigger;  // optional, likewise
+    AutoExposure* auto_exposure;  // optional, steers the source per frame
+    Calibrator* calibrator;  // optional, corrects frames before the recorder
+    bool record_raw;  // or after it and the pre-trigger ring
+    int preview;  // frames are downsampled by this for the handoff only
+    TripleBuffer handoff;
+    pthread_t thread;
+    atomic_bool running;
+    atomic_bool failed;
+    atomic_uint_least64_t frames;
+    pthread_mutex_t health_lock;
+    CaptureHealth health;  // guarded by health_lock
+
+    atomic_uint_least64_t lease;
+    uint64_t lease_seq;      // capture thread only
+    uint64_t slot_lease[3];  // sequence number per handoff slot
+    atomic_uint_least64_t lent_bytes;  // handed over without a copy
+    atomic_uint_least64_t revoked;     // taken back before the consumer came
+    atomic_uint_least64_t lease_wait_ns;
+
+    // Sensor ROI change requested by another thread, applied between frames
+    atomic_bool roi_pending;
+    pthread_mutex_t roi_lock;
+    SourceRoi roi_request;  // guarded by roi_lock
+    bool roi_refused;       // guarded by roi_lock
+    SourceRoi roi_applied;  // guarded by roi_lock: the crop after a refusal
+} Capture;
+
+// Starts the capture thread on an opened source. The source, the recorder,
+// the pre-trigger ring, the exposure controller and the calibrator, if any,
+// must outlive the capture. With `preview` 2 or 4 the consumer gets frames
+// downsampled by that factor (see downsample.h) while the recorder and the
+// pre-trigger ring still get full ones. The calibrator's correction reaches
+// them too unless `record_raw`; the exposure controller and the consumer
+// always see corrected frames.
+bool CaptureStart(
+    Capture* cap,
+    FrameSource* source,
+    Recorder* recorder,
+    PreTrigger* pretrigger,
+    AutoExposure* auto_exposure,
+    Calibrator* calibrator,
+    bool record_raw,
+    int preview);
+void CaptureStop(Capture* cap);
+
+// Newest frame since the previous call, or NULL if none arrived. The frame
+// remains valid until the next call; a transient one only until
+// CaptureRelease(), which must follow as soon as its data has been used
+// because the capture thread waits for it.
+const Frame* CaptureLatest(Capture* cap);
+void CaptureRelease(Capture* cap);
+
+// Asks the capture thread to crop the source to `roi` before its next frame;
+// ignored by sources without ROI support. Frames report the ROI they have.
+void CaptureRequestRoi(Capture* cap, const SourceRoi* roi);
+// Any thread: true once after the source refused the last ROI requested,
+// setting `roi` to the crop it was left with instead
+bool CaptureRoiRefused(Capture* cap, SourceRoi* roi);
+
+// Snapshot of the delivery health, refreshed once per window. After
+// CaptureStop() `cap->health` holds the final totals.
+CaptureHealth CaptureGetHealth(Capture* cap);
+
+#endif  // XICLOPS_CAPTURE_H
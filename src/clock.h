@@ -0,0 +1,22 @@
+#ifndef XICLOPS_CLOCK_H
+#define XICLOPS_CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+static inline uint64_t NowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Sleeps until the absolute CLOCK_MONOTONIC time `deadline_ns`
+static inline void SleepUntilNs(uint64_t deadline_ns) {
+    struct timespec ts = {
+        .tv_sec = deadline_ns / 1000000000ull,
+        .tv_nsec = deadline_ns % 1000000000ull,
+    };
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+#endif  // XICLOPS_CLOCK_H
@@ -0,0 +1,352 @@
+#include "demosaic.h"
+
+#include <immintrin.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Everything below works on 8-bit rows. Interior pixels go through the SIMD
+// kernels; the first column and whatever tail does not fill a full vector use
+// the scalar path, with out-of-image neighbours mirrored so the Bayer parity
+// is preserved.
+
+typedef struct RowCtx {
+    const uint8_t* up;
+    const uint8_t* cur;
+    const uint8_t* down;
+    int width;
+    int colour_parity;  // x & 1 of the red (or blue) sites in this row
+    bool red_row;
+    DemosaicMethod method;
+    uint8_t* out;
+} RowCtx;
+
+// Returns the first x it did not process
+typedef int (*RowKernel)(const RowCtx* r, int x);
+
+static inline void PixelScalar(const RowCtx* r, int x) {
+    int xl = x > 0 ? x - 1 : 1;
+    int xr = x < r->width - 1 ? x + 1 : r->width - 2;
+    int c = r->cur[x];
+    int l = r->cur[xl];
+    int rr = r->cur[xr];
+    int u = r->up[x];
+    int d = r->down[x];
+    int h = (l + rr + 1) >> 1;
+    int v = (u + d + 1) >> 1;
+    int a, g, o;
+    if ((x & 1) == r->colour_parity) {
+        g = (l + rr + u + d + 2) >> 2;
+        if (r->method == DEMOSAIC_EDGE_AWARE) {
+            int dh = abs(l - rr);
+            int dv = abs(u - d);
+            if (dh < dv) {
+                g = h;
+            } else if (dv < dh) {
+                g = v;
+            }
+        }
+        a = c;
+        o = (r->up[xl] + r->up[xr] + r->down[xl] + r->down[xr] + 2) >> 2;
+    } else {
+        a = h;
+        g = c;
+        o = v;
+    }
+    uint8_t* px = r->out + 4 * x;
+    px[0] = r->red_row ? a : o;
+    px[1] = g;
+    px[2] = r->red_row ? o : a;
+    px[3] = 255;
+}
+
+static int RowScalar(const RowCtx* r, int x) {
+    for (; x < r->width; ++x) {
+        PixelScalar(r, x);
+    }
+    return x;
+}
+
+__attribute__((target("sse4.1"))) static inline __m128i Load8x16(
+    const uint8_t* p) {
+    return _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)p));
+}
+
+__attribute__((target("sse4.1"))) static int RowSse41(const RowCtx* r, int x) {
+    int m[8];
+    for (int i = 0; i < 8; ++i) {
+        m[i] = ((x + i) & 1) == r->colour_parity ? -1 : 0;
+    }
+    const __m128i colour =
+        _mm_setr_epi16(m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7]);
+    const __m128i two = _mm_set1_epi16(2);
+    const __m128i alpha = _mm_set1_epi16((short)0xff00);
+    const bool edge = r->method == DEMOSAIC_EDGE_AWARE;
+
+    // 8 pixels per step, reading one byte either side
+    for (; x + 9 <= r->width; x += 8) {
+        __m128i c = Load8x16(r->cur + x);
+        __m128i l = Load8x16(r->cur + x - 1);
+        __m128i rr = Load8x16(r->cur + x + 1);
+        __m128i u = Load8x16(r->up + x);
+        __m128i d = Load8x16(r->down + x);
+        __m128i ul = Load8x16(r->up + x - 1);
+        __m128i ur = Load8x16(r->up + x + 1);
+        __m128i dl = Load8x16(r->down + x - 1);
+        __m128i dr = Load8x16(r->down + x + 1);
+
+        __m128i h = _mm_avg_epu16(l, rr);
+        __m128i v = _mm_avg_epu16(u, d);
+        __m128i g = _mm_srli_epi16(
+            _mm_add_epi16(
+                _mm_add_epi16(_mm_add_epi16(l, rr), _mm_add_epi16(u, d)), two),
+            2);
+        __m128i diag = _mm_srli_epi16(
+            _mm_add_epi16(
+                _mm_add_epi16(_mm_add_epi16(ul, ur), _mm_add_epi16(dl, dr)),
+                two),
+            2);
+        if (edge) {
+            __m128i dh = _mm_abs_epi16(_mm_sub_epi16(l, rr));
+            __m128i dv = _mm_abs_epi16(_mm_sub_epi16(u, d));
+            g = _mm_blendv_epi8(g, h, _mm_cmpgt_epi16(dv, dh));
+            g = _mm_blendv_epi8(g, v, _mm_cmpgt_epi16(dh, dv));
+        }
+
+        __m128i a = _mm_blendv_epi8(h, c, colour);
+        g = _mm_blendv_epi8(c, g, colour);
+        __m128i o = _mm_blendv_epi8(v, diag, colour);
+        __m128i red = r->red_row ? a : o;
+        __m128i blue = r->red_row ? o : a;
+
+        __m128i rg = _mm_or_si128(red, _mm_slli_epi16(g, 8));
+        __m128i ba = _mm_or_si128(blue, alpha);
+        __m128i* out = (__m128i*)(r->out + 4 * x);
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rg, ba));
+    }
+    return x;
+}
+
+__attribute__((target("avx2"))) static inline __m256i Load16x16(
+    const uint8_t* p) {
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)p));
+}
+
+__attribute__((target("avx2"))) static int RowAvx2(const RowCtx* r, int x) {
+    short m[16];
+    for (int i = 0; i < 16; ++i) {
+        m[i] = ((x + i) & 1) == r->colour_parity ? -1 : 0;
+    }
+    const __m256i colour = _mm256_loadu_si256((const __m256i*)m);
+    const __m256i two = _mm256_set1_epi16(2);
+    const __m256i alpha = _mm256_set1_epi16((short)0xff00);
+    const bool edge = r->method == DEMOSAIC_EDGE_AWARE;
+
+    // 16 pixels per step, reading one byte either side
+    for (; x + 17 <= r->width; x += 16) {
+        __m256i c = Load16x16(r->cur + x);
+        __m256i l = Load16x16(r->cur + x - 1);
+        __m256i rr = Load16x16(r->cur + x + 1);
+        __m256i u = Load16x16(r->up + x);
+        __m256i d = Load16x16(r->down + x);
+        __m256i ul = Load16x16(r->up + x - 1);
+        __m256i ur = Load16x16(r->up + x + 1);
+        __m256i dl = Load16x16(r->down + x - 1);
+        __m256i dr = Load16x16(r->down + x + 1);
+
+        __m256i h = _mm256_avg_epu16(l, rr);
+        __m256i v = _mm256_avg_epu16(u, d);
+        __m256i g = _mm256_srli_epi16(
+            _mm256_add_epi16(
+                _mm256_add_epi16(
+                    _mm256_add_epi16(l, rr), _mm256_add_epi16(u, d)),
+                two),
+            2);
+        __m256i diag = _mm256_srli_epi16(
+            _mm256_add_epi16(
+                _mm256_add_epi16(
+                    _mm256_add_epi16(ul, ur), _mm256_add_epi16(dl, dr)),
+                two),
+            2);
+        if (edge) {
+            __m256i dh = _mm256_abs_epi16(_mm256_sub_epi16(l, rr));
+            __m256i dv = _mm256_abs_epi16(_mm256_sub_epi16(u, d));
+            g = _mm256_blendv_epi8(g, h, _mm256_cmpgt_epi16(dv, dh));
+            g = _mm256_blendv_epi8(g, v, _mm256_cmpgt_epi16(dh, dv));
+        }
+
+        __m256i a = _mm256_blendv_epi8(h, c, colour);
+        g = _mm256_blendv_epi8(c, g, colour);
+        __m256i o = _mm256_blendv_epi8(v, diag, colour);
+        __m256i red = r->red_row ? a : o;
+        __m256i blue = r->red_row ? o : a;
+
+        // unpack works per 128-bit lane: lo = px 0-3 | 8-11, hi = 4-7 | 12-15
+        __m256i rg = _mm256_or_si256(red, _mm256_slli_epi16(g, 8));
+        __m256i ba = _mm256_or_si256(blue, alpha);
+        __m256i lo = _mm256_unpacklo_epi16(rg, ba);
+        __m256i hi = _mm256_unpackhi_epi16(rg, ba);
+        __m256i* out = (__m256i*)(r->out + 4 * x);
+        _mm256_storeu_si256(out, _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    return x;
+}
+
+DemosaicIsa DemosaicBestIsa(void) {
+    static int best = -1;
+    if (best < 0) {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            best = DEMOSAIC_AVX2;
+        } else if (__builtin_cpu_supports("sse4.1")) {
+            best = DEMOSAIC_SSE41;
+        } else {
+            best = DEMOSAIC_SCALAR;
+        }
+    }
+    return best;
+}
+
+const char* DemosaicIsaName(DemosaicIsa isa) {
+    switch (isa) {
+        case DEMOSAIC_SCALAR: {
+            return "scalar";
+        }
+        case DEMOSAIC_SSE41: {
+            return "sse4.1";
+        }
+        case DEMOSAIC_AVX2: {
+            return "avx2";
+        }
+    }
+    return "?";
+}
+
+static RowKernel KernelFor(DemosaicIsa isa) {
+    // Never hand out a kernel the CPU cannot run
+    if (isa > DemosaicBestIsa()) {
+        isa = DemosaicBestIsa();
+    }
+    switch (isa) {
+        case DEMOSAIC_AVX2: {
+            return RowAvx2;
+        }
+        case DEMOSAIC_SSE41: {
+            return RowSse41;
+        }
+        case DEMOSAIC_SCALAR: {
+            return RowScalar;
+        }
+    }
+    return RowScalar;
+}
+
+static int Mirror(int i, int n) {
+    if (i < 0) {
+        return 1;
+    }
+    if (i >= n) {
+        return n - 2;
+    }
+    return i;
+}
+
+static void Raw16ToRaw8(const uint16_t* src, int n, int shift, uint8_t* dst) {
+    for (int i = 0; i < n; ++i) {
+        unsigned v = src[i] >> shift;
+        dst[i] = v > 255 ? 255 : v;
+    }
+}
+
+bool DemosaicWithIsa(
+    const Frame* src, DemosaicMethod method, DemosaicIsa isa, uint8_t* rgba) {
+    if (src->format != FRAME_RAW8 && src->format != FRAME_RAW16) {
+        return false;
+    }
+    const int width = src->width;
+    const int height = src->height;
+    if (width < 2 || height < 2) {
+        return false;
+    }
+    RowKernel kernel = KernelFor(isa);
+
+    int ox = 0;
+    int oy = 0;
+    switch (src->pattern) {
+        case BAYER_NONE:
+        case BAYER_RGGB: {
+            break;
+        }
+        case BAYER_BGGR: {
+            ox = 1;
+            oy = 1;
+            break;
+        }
+        case BAYER_GRBG: {
+            ox = 1;
+            break;
+        }
+        case BAYER_GBRG: {
+            oy = 1;
+            break;
+        }
+    }
+
+    // RAW16 rows are narrowed into a three-row rolling window as we go
+    uint8_t* scratch = NULL;
+    int shift = 0;
+    int converted = -1;
+    if (src->format == FRAME_RAW16) {
+        scratch = malloc(3 * (size_t)width);
+        if (scratch == NULL) {
+            return false;
+        }
+        int bits = src->bit_depth > 8 ? src->bit_depth : 16;
+        shift = bits - 8;
+    }
+
+    RowCtx r = {
+        .width = width,
+        .method = method,
+    };
+    for (int y = 0; y < height; ++y) {
+        int ys[3] = {Mirror(y - 1, height), y, Mirror(y + 1, height)};
+        const uint8_t* rows[3];
+        if (scratch != NULL) {
+            const uint16_t* raw = (const uint16_t*)src->data;
+            for (; converted < ys[2]; ++converted) {
+                int row = converted + 1;
+                Raw16ToRaw8(
+                    raw + (size_t)row * width,
+                    width,
+                    shift,
+                    scratch + (size_t)(row % 3) * width);
+            }
+            for (int i = 0; i < 3; ++i) {
+                rows[i] = scratch + (size_t)(ys[i] % 3) * width;
+            }
+        } else {
+            for (int i = 0; i < 3; ++i) {
+                rows[i] = src->data + (size_t)ys[i] * width;
+            }
+        }
+        r.up = rows[0];
+        r.cur = rows[1];
+        r.down = rows[2];
+        r.red_row = ((y + oy) & 1) == 0;
+        // Red sits at even (x + ox), blue at odd
+        r.colour_parity = r.red_row ? ox : ox ^ 1;
+        r.out = rgba + (size_t)y * width * 4;
+
+        PixelScalar(&r, 0);
+        int x = kernel(&r, 1);
+        RowScalar(&r, x);
+    }
+    free(scratch);
+    return true;
+}
+
+bool Demosaic(const Frame* src, DemosaicMethod method, uint8_t* rgba) {
+    return DemosaicWithIsa(src, method, DemosaicBestIsa(), rgba);
+}
@@ -0,0 +1,35 @@
+#ifndef XICLOPS_DEMOSAIC_H
+#define XICLOPS_DEMOSAIC_H
+
+#include <stdint.h>
+
+#include "frame.h"
+
+// CPU demosaic of RAW8/RAW16 Bayer frames into RGBA8, for paths that have no
+// GPU (headless benchmarking, recording). The SIMD kernels are bit-exact with
+// the scalar one; the best one the CPU supports is picked at first use.
+
+typedef enum DemosaicMethod {
+    DEMOSAIC_BILINEAR,
+    // Green at red/blue sites is interpolated along the smaller gradient
+    // instead of averaging across an edge; red/blue stay bilinear
+    DEMOSAIC_EDGE_AWARE,
+} DemosaicMethod;
+
+typedef enum DemosaicIsa {
+    DEMOSAIC_SCALAR,
+    DEMOSAIC_SSE41,
+    DEMOSAIC_AVX2,
+} DemosaicIsa;
+
+DemosaicIsa DemosaicBestIsa(void);
+const char* DemosaicIsaName(DemosaicIsa isa);
+
+// Converts `src` (FRAME_RAW8 or FRAME_RAW16) into `rgba`, which must hold
+// width * height * 4 bytes. RAW16 is scaled down using `src->bit_depth`.
+// Returns false for formats that are not Bayer mosaics.
+bool Demosaic(const Frame* src, DemosaicMethod method, uint8_t* rgba);
+bool DemosaicWithIsa(
+    const Frame* src, DemosaicMethod method, DemosaicIsa isa, uint8_t* rgba);
+
+#endif  // XICLOPS_DEMOSAIC_H
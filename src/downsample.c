@@ -0,0 +1,166 @@
+#include "downsample.h"
+
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Each output row is written no further than the first input row it reads,
+// and within a row output bytes trail the input ones, so going front to back
+// works in place. SSE2 is part of x86-64, so no runtime dispatch is needed.
+
+// Row `a` and the one below it, `b`, averaged over pairs of pixels
+static void Rgb32RowScalar(
+    const uint8_t* a, const uint8_t* b, int x, int out_w, uint8_t* out) {
+    for (; x < out_w; ++x) {
+        for (int c = 0; c < 4; ++c) {
+            int i = 8 * x + c;
+            int sum = a[i] + a[i + 4] + b[i] + b[i + 4];
+            out[4 * x + c] = (uint8_t)((sum + 2) >> 2);
+        }
+    }
+}
+
+// Rows `a` and `b` two apart (same colours), averaged over same-colour
+// samples two apart
+static void Raw8RowScalar(
+    const uint8_t* a, const uint8_t* b, int x, int out_w, uint8_t* out) {
+    for (; x < out_w; ++x) {
+        int i = 2 * (x & ~1) + (x & 1);
+        out[x] = (uint8_t)((a[i] + a[i + 2] + b[i] + b[i + 2] + 2) >> 2);
+    }
+}
+
+static void Raw16RowScalar(
+    const uint16_t* a, const uint16_t* b, int x, int out_w, uint16_t* out) {
+    for (; x < out_w; ++x) {
+        int i = 2 * (x & ~1) + (x & 1);
+        out[x] = (uint16_t)((a[i] + a[i + 2] + b[i] + b[i + 2] + 2) >> 2);
+    }
+}
+
+#ifdef __SSE2__
+// Two output pixels per iteration; returns the first x it did not process
+static int Rgb32RowSse2(
+    const uint8_t* a, const uint8_t* b, int out_w, uint8_t* out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    int x = 0;
+    for (; x + 2 <= out_w; x += 2) {
+        __m128i ra = _mm_loadu_si128((const __m128i*)(a + 8 * x));
+        __m128i rb = _mm_loadu_si128((const __m128i*)(b + 8 * x));
+        // Input pixels 0-1 and 2-3 as 16-bit channels, rows summed
+        __m128i lo = _mm_add_epi16(
+            _mm_unpacklo_epi8(ra, zero), _mm_unpacklo_epi8(rb, zero));
+        __m128i hi = _mm_add_epi16(
+            _mm_unpackhi_epi8(ra, zero), _mm_unpackhi_epi8(rb, zero));
+        lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+        hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+        __m128i sum = _mm_unpacklo_epi64(lo, hi);
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        _mm_storel_epi64(
+            (__m128i*)(out + 4 * x), _mm_packus_epi16(sum, sum));
+    }
+    return x;
+}
+
+// Eight output samples (four Bayer tiles' worth of one row) per iteration
+static int Raw8RowSse2(
+    const uint8_t* a, const uint8_t* b, int out_w, uint8_t* out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    int x = 0;
+    for (; x + 8 <= out_w; x += 8) {
+        __m128i ra = _mm_loadu_si128((const __m128i*)(a + 2 * x));
+        __m128i rb = _mm_loadu_si128((const __m128i*)(b + 2 * x));
+        __m128i lo = _mm_add_epi16(
+            _mm_unpacklo_epi8(ra, zero), _mm_unpacklo_epi8(rb, zero));
+        __m128i hi = _mm_add_epi16(
+            _mm_unpackhi_epi8(ra, zero), _mm_unpackhi_epi8(rb, zero));
+        // Sample i plus sample i + 2; lanes 0, 1, 4 and 5 are the outputs
+        lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 4));
+        hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 4));
+        lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+        hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+        __m128i sum = _mm_unpacklo_epi64(lo, hi);
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        _mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(sum, sum));
+    }
+    return x;
+}
+#endif
+
+static void Halve(Frame* frame, bool simd) {
+    bool mosaic = frame->format != FRAME_RGB32;
+    int bpp = FrameBytesPerPixel(frame->format);
+    int out_w = mosaic ? frame->width / 4 * 2 : frame->width / 2;
+    int out_h = mosaic ? frame->height / 4 * 2 : frame->height / 2;
+    size_t in_stride = (size_t)frame->width * bpp;
+    size_t out_stride = (size_t)out_w * bpp;
+    const uint8_t* src = frame->data;
+    uint8_t* dst = frame->storage;
+    for (int y = 0; y < out_h; ++y) {
+        int in_y = mosaic ? 2 * (y & ~1) + (y & 1) : 2 * y;
+        const uint8_t* a = src + (size_t)in_y * in_stride;
+        const uint8_t* b = a + (mosaic ? 2 : 1) * in_stride;
+        uint8_t* out = dst + (size_t)y * out_stride;
+        int x = 0;
+        switch (frame->format) {
+            case FRAME_RGB32: {
+#ifdef __SSE2__
+                x = simd ? Rgb32RowSse2(a, b, out_w, out) : 0;
+#endif
+                Rgb32RowScalar(a, b, x, out_w, out);
+                break;
+            }
+            case FRAME_RAW8: {
+#ifdef __SSE2__
+                x = simd ? Raw8RowSse2(a, b, out_w, out) : 0;
+#endif
+                Raw8RowScalar(a, b, x, out_w, out);
+                break;
+            }
+            case FRAME_RAW16: {
+                Raw16RowScalar(
+                    (const uint16_t*)a,
+                    (const uint16_t*)b,
+                    x,
+                    out_w,
+                    (uint16_t*)out);
+                break;
+            }
+        }
+    }
+    frame->data = dst;
+    frame->width = out_w;
+    frame->height = out_h;
+    frame->size = out_stride * out_h;
+    frame->transient = false;
+}
+
+static bool Downsample(Frame* frame, int factor, bool simd) {
+    if (factor == 1) {
+        return true;
+    }
+    if (factor != 2 && factor != 4) {
+        return false;
+    }
+    // Mosaics shrink in whole 2x2 tiles
+    int min = factor * (frame->format == FRAME_RGB32 ? 1 : 2);
+    if (frame->width < min || frame->height < min) {
+        return false;
+    }
+    for (int f = factor; f > 1; f /= 2) {
+        Halve(frame, simd);
+    }
+    return true;
+}
+
+bool DownsampleFrame(Frame* frame, int factor) {
+    return Downsample(frame, factor, true);
+}
+
+bool DownsampleFrameScalar(Frame* frame, int factor) {
+    return Downsample(frame, factor, false);
+}
@@ -0,0 +1,23 @@
+#ifndef XICLOPS_DOWNSAMPLE_H
+#define XICLOPS_DOWNSAMPLE_H
+
+#include <stdbool.h>
+
+#include "frame.h"
+
+// Box downsampling for the preview path, run on the capture thread after the
+// recorder has had the full frame. RGB32 averages 2x2 pixel blocks; Bayer
+// mosaics average the four same-colour samples of each 4x4 block into one 2x2
+// tile, so the result is still a mosaic with the same pattern, like sensor
+// binning. A factor of 4 is two 2x passes.
+
+// Downsamples `frame` by `factor` (1, 2 or 4) into `frame->storage`, which may
+// be where the pixels already are, and updates its size and data pointer. The
+// frame no longer refers to source memory afterwards, so it stops being
+// transient. Returns false for unsupported factors.
+bool DownsampleFrame(Frame* frame, int factor);
+
+// Same with the SIMD kernels turned off, for checking them
+bool DownsampleFrameScalar(Frame* frame, int factor);
+
+#endif  // XICLOPS_DOWNSAMPLE_H
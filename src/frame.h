@@ -0,0 +1,65 @@
+#ifndef XICLOPS_FRAME_H
+#define XICLOPS_FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum FrameFormat {
+    FRAME_RGB32,  // xiAPI-converted BGRA, alpha set by the camera
+    FRAME_RAW8,   // Bayer mosaic, one byte per pixel
+    FRAME_RAW16,  // Bayer mosaic, one little-endian 16-bit word per pixel
+} FrameFormat;
+
+// Position of the red sample in the 2x2 Bayer tile
+typedef enum BayerPattern {
+    BAYER_NONE,
+    BAYER_RGGB,
+    BAYER_BGGR,
+    BAYER_GRBG,
+    BAYER_GBRG,
+} BayerPattern;
+
+// A single camera frame plus the sensor metadata we care about downstream.
+// `storage` is owned by whoever allocated the slot. `data` points at it,
+// unless the source lent memory of its own for this frame (playback hands out
+// its mapping); either way it stays valid until the slot is refilled, except
+// for `transient` frames, whose memory the source reuses on its next call
+// (see CaptureLatest()). `size` is the number of valid bytes written by the
+// last acquisition.
+typedef struct Frame {
+    unsigned char* data;
+    unsigned char* storage;
+    size_t capacity;  // of storage
+    size_t size;
+    int width;
+    int height;
+    int roi_x;  // position within the source's full width x height
+    int roi_y;
+    FrameFormat format;
+    BayerPattern pattern;
+    int bit_depth;  // significant bits per sample for RAW16
+    uint32_t nframe;        // XI_IMG.acq_nframe
+    uint64_t timestamp_us;  // XI_IMG.tsSec/tsUSec
+    uint32_t gpi_level;     // XI_IMG.GPI_level, bit n is input n + 1
+    int exposure_us;        // XI_IMG.exposure_time_us
+    float gain_db;          // XI_IMG.gain_db
+    bool transient;
+} Frame;
+
+static inline int FrameBytesPerPixel(FrameFormat format) {
+    switch (format) {
+        case FRAME_RGB32: {
+            return 4;
+        }
+        case FRAME_RAW8: {
+            return 1;
+        }
+        case FRAME_RAW16: {
+            return 2;
+        }
+    }
+    return 0;
+}
+
+#endif  // XICLOPS_FRAME_H
@@ -0,0 +1,50 @@
+#include "frame_pool.h"
+
+#include <string.h>
+
+#include "log.h"
+
+static int FRAME_POOL_NODE = -1;
+
+void FramePoolSetNode(int node) {
+    FRAME_POOL_NODE = node;
+}
+
+int FramePoolNode(void) {
+    return FRAME_POOL_NODE;
+}
+
+void FramePoolPinThread(void) {
+    if (FRAME_POOL_NODE >= 0) {
+        NumaPinThread(FRAME_POOL_NODE);
+    }
+}
+
+bool FramePoolInit(FramePool* pool, size_t count, size_t frame_bytes) {
+    memset(pool, 0, sizeof(*pool));
+    pool->count = count;
+    pool->slot_bytes = (frame_bytes + FRAME_POOL_ALIGN - 1) /
+                       FRAME_POOL_ALIGN * FRAME_POOL_ALIGN;
+    pool->bytes = count * pool->slot_bytes;
+    pool->node = FRAME_POOL_NODE;
+    pool->base = HugeAlloc(pool->bytes, pool->node, &pool->kind);
+    if (pool->base == NULL) {
+        Log(ERROR,
+            "Failed to allocate %zu frames of %zu bytes\n",
+            count,
+            frame_bytes);
+        return false;
+    }
+    Log(DEBUG,
+        "Frame pool: %zu x %zu bytes, %s, node %d\n",
+        count,
+        pool->slot_bytes,
+        HugeKindName(pool->kind),
+        pool->node >= 0 ? pool->node : NumaCurrentNode());
+    return true;
+}
+
+void FramePoolFree(FramePool* pool) {
+    HugeFree(pool->base, pool->bytes);
+    pool->base = NULL;
+}
@@ -0,0 +1,41 @@
+#ifndef XICLOPS_FRAME_POOL_H
+#define XICLOPS_FRAME_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "huge_alloc.h"
+
+// Slots start on a page boundary, which also keeps them cache line aligned
+// for SIMD and satisfies O_DIRECT
+#define FRAME_POOL_ALIGN 4096
+
+// A fixed set of equally sized frame buffers carved out of one hugepage
+// mapping. Every large per-frame buffer on the capture side (triple buffer,
+// recorder queue, pre-trigger ring) comes from one of these, allocated and
+// faulted in up front so acquisition never touches the heap.
+typedef struct FramePool {
+    unsigned char* base;
+    size_t bytes;
+    size_t slot_bytes;  // frame_bytes rounded up to FRAME_POOL_ALIGN
+    size_t count;
+    HugeKind kind;
+    int node;  // NUMA node the memory is bound to, -1 if not bound
+} FramePool;
+
+// NUMA node pools are bound to and capture threads run on, -1 (default) to
+// leave placement to the kernel. Set before opening any stream.
+void FramePoolSetNode(int node);
+int FramePoolNode(void);
+// Called by threads that fill pool memory; no-op unless a node is set
+void FramePoolPinThread(void);
+
+bool FramePoolInit(FramePool* pool, size_t count, size_t frame_bytes);
+// Safe on a zeroed or already freed pool
+void FramePoolFree(FramePool* pool);
+
+static inline unsigned char* FramePoolSlot(const FramePool* pool, size_t i) {
+    return pool->base + i * pool->slot_bytes;
+}
+
+#endif  // XICLOPS_FRAME_POOL_H
@@ -0,0 +1,133 @@
+#ifndef XICLOPS_FRAME_SOURCE_H
+#define XICLOPS_FRAME_SOURCE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame.h"
+
+typedef enum SourceStatus {
+    SOURCE_OK,
+    SOURCE_TIMEOUT,  // nothing arrived in time, try again
+    SOURCE_ERROR,
+} SourceStatus;
+
+// What the caller asks for. Backends may round the size to what the device
+// supports; the result is in FrameSource.width/height.
+typedef struct SourceConfig {
+    int width;
+    int height;
+    FrameFormat format;
+    int exposure_us;
+    float wb_kr;
+    float wb_kg;
+    float wb_kb;
+    double rate_hz;  // synthetic only
+    // Lend the driver's own buffers (XI_BP_UNSAFE) instead of having them
+    // copied into ours; frames come out transient. Synthetic emulates it.
+    bool zero_copy;
+    // Ximea transport limit per camera in Mbit/s; 0 to measure the
+    // controller's available bandwidth and split it between `peers` cameras
+    int bandwidth_mbps;
+    int peers;
+    // Ximea only: bin (or skip) 2x2 or 4x4 pixels on the sensor; the size
+    // above stays in full-resolution pixels
+    int downsampling;
+} SourceConfig;
+
+// Sensor region of interest in full-frame pixels
+typedef struct SourceRoi {
+    int x;
+    int y;
+    int width;
+    int height;
+} SourceRoi;
+
+typedef enum PlaybackMode {
+    PLAYBACK_REALTIME,  // paced by the recorded sensor timestamps
+    PLAYBACK_FAST,      // as fast as the pipeline takes frames
+    PLAYBACK_STEP,      // one frame per FrameSourceStep()
+} PlaybackMode;
+
+// A camera-like producer of frames. Everything the capture thread needs goes
+// through `next`; backends keep their own state behind `impl`.
+typedef struct FrameSource {
+    const char* name;
+    int width;  // full frame; frames are smaller while cropped to a ROI
+    int height;
+    int downsampling;  // sensor pixels per frame pixel on each axis
+    FrameFormat format;
+    BayerPattern pattern;
+    int bit_depth;
+    size_t frame_bytes;
+    // Settings in effect; playback reports the ones it was recorded with
+    double rate_hz;  // nominal frame rate, 0 if unknown
+    int exposure_us;
+    float wb_kr;
+    float wb_kg;
+    float wb_kb;
+    atomic_int bandwidth_mbps;  // transport limit in effect, 0 if none
+    // Range set_exposure() accepts
+    int exposure_min_us;
+    int exposure_max_us;
+    float gain_min_db;
+    float gain_max_db;
+
+    // Fills `frame->data` (at least frame_bytes) and the frame metadata
+    SourceStatus (*next)(struct FrameSource* src, Frame* frame, int timeout_ms);
+    void (*close)(struct FrameSource* src);
+    // Optional, callable from any thread: moves a stepping source by `frames`
+    void (*step)(struct FrameSource* src, int frames);
+    // Optional, called by the capture thread once per health window with
+    // the frames received and lost in it
+    void (*feedback)(struct FrameSource* src, uint64_t frames, uint64_t lost);
+    // Optional, capture thread: crops acquisition to `roi`, rounded to what
+    // the sensor accepts and updated to what was applied. False if it wasn't,
+    // with `roi` updated to the crop the source was left with.
+    bool (*set_roi)(struct FrameSource* src, SourceRoi* roi);
+    // Optional, capture thread: changes exposure and gain while acquiring,
+    // clamped to the range above and updated to what was applied. Frames
+    // taken with the new values report them, a few frames later.
+    bool (*set_exposure)(
+        struct FrameSource* src, int* exposure_us, float* gain_db);
+    // Optional, callable from any thread: white balance gains the source
+    // applies when it converts to RGB32, picked up a frame or two later
+    bool (*set_white_balance)(
+        struct FrameSource* src, float kr, float kg, float kb);
+    void* impl;
+} FrameSource;
+
+// Opens, configures and starts acquisition on Ximea camera `cam_id`
+bool FrameSourceOpenXimea(
+    FrameSource* src, int cam_id, const SourceConfig* cfg);
+
+// How many of `cam_ids` are attached to the same controller as `cam_id`,
+// itself included; 1 if the device location can't be read
+int FrameSourceXimeaPeers(int cam_id, const int* cam_ids, int count);
+
+// Generates a scrolling test pattern at cfg->rate_hz without any hardware.
+// `seed` varies the pattern so several synthetic sources look different.
+bool FrameSourceOpenSynthetic(
+    FrameSource* src, int seed, const SourceConfig* cfg);
+
+// Replays a recording (see recording.h). Realtime and fast playback loop at
+// the end; stepping stops at either end.
+bool FrameSourceOpenPlayback(
+    FrameSource* src, const char* path, PlaybackMode mode);
+
+static inline void FrameSourceStep(FrameSource* src, int frames) {
+    if (src->step != NULL) {
+        src->step(src, frames);
+    }
+}
+
+static inline void FrameSourceClose(FrameSource* src) {
+    if (src->close != NULL) {
+        src->close(src);
+        src->close = NULL;
+    }
+}
+
+#endif  // XICLOPS_FRAME_SOURCE_H
@@ -0,0 +1,151 @@
+// MAP_HUGETLB, MADV_HUGEPAGE, getcpu(), CPU_SET
+#define _GNU_SOURCE
+#include "huge_alloc.h"
+
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "log.h"
+
+#define HUGE_PAGE_BYTES (2u << 20)
+#define NUMA_MAX_NODES 64
+
+static size_t RoundUp(size_t bytes) {
+    return (bytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+}
+
+// No libnuma dependency for one call
+static bool Bind(void* p, size_t size, int node) {
+    if (node < 0) {
+        return true;
+    }
+    if (node >= NUMA_MAX_NODES) {
+        return false;
+    }
+    unsigned long mask = 1ul << node;
+    long r = syscall(
+        SYS_mbind, p, size, MPOL_BIND, &mask, NUMA_MAX_NODES + 1, 0);
+    if (r != 0) {
+        Log(WARN, "Failed to bind memory to NUMA node %d\n", node);
+        return false;
+    }
+    return true;
+}
+
+// Faults every page in now, after the policy is set, so the first frames
+// don't pay for it. Kernels before 5.14 lack MADV_POPULATE_WRITE.
+static void Populate(unsigned char* p, size_t size, size_t page) {
+    if (madvise(p, size, MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
+    for (size_t off = 0; off < size; off += page) {
+        p[off] = 0;
+    }
+}
+
+void* HugeAlloc(size_t bytes, int node, HugeKind* kind) {
+    size_t size = RoundUp(bytes);
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    void* p =
+        mmap(NULL, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        // A hugetlb fault that can't be satisfied is SIGBUS, not ENOMEM, so
+        // only keep the mapping if it could be populated up front
+        Bind(p, size, node);
+        if (madvise(p, size, MADV_POPULATE_WRITE) == 0) {
+            *kind = HUGE_EXPLICIT;
+            return p;
+        }
+        munmap(p, size);
+    }
+    // Without a hugetlbfs reservation, ask for THP before faulting in
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+    *kind = madvise(p, size, MADV_HUGEPAGE) == 0 ? HUGE_TRANSPARENT : HUGE_NONE;
+    Bind(p, size, node);
+    Populate(p, size, (size_t)sysconf(_SC_PAGESIZE));
+    return p;
+}
+
+void HugeFree(void* p, size_t bytes) {
+    if (p != NULL) {
+        munmap(p, RoundUp(bytes));
+    }
+}
+
+const char* HugeKindName(HugeKind kind) {
+    switch (kind) {
+        case HUGE_NONE: {
+            return "4k pages";
+        }
+        case HUGE_TRANSPARENT: {
+            return "transparent huge pages";
+        }
+        case HUGE_EXPLICIT: {
+            return "hugetlb pages";
+        }
+    }
+    return "?";
+}
+
+int NumaCurrentNode(void) {
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (getcpu(&cpu, &node) != 0) {
+        return 0;
+    }
+    return (int)node;
+}
+
+bool NumaPinThread(int node) {
+    char path[128];
+    snprintf(
+        path,
+        sizeof(path),
+        "/sys/devices/system/node/node%d/cpulist",
+        node);
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        Log(WARN, "NUMA node %d not found\n", node);
+        return false;
+    }
+    // "0-7,16-23"
+    char list[1024] = {0};
+    bool read = fgets(list, sizeof(list), f) != NULL;
+    fclose(f);
+    if (!read) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    char* save = NULL;
+    for (char* tok = strtok_r(list, ",\n", &save); tok != NULL;
+         tok = strtok_r(NULL, ",\n", &save)) {
+        int lo = 0;
+        int hi = 0;
+        int n = sscanf(tok, "%d-%d", &lo, &hi);
+        if (n < 1) {
+            continue;
+        }
+        if (n == 1) {
+            hi = lo;
+        }
+        for (int cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; ++cpu) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    if (CPU_COUNT(&set) == 0 ||
+        sched_setaffinity(0, sizeof(set), &set) != 0) {
+        Log(WARN, "Failed to pin thread to NUMA node %d\n", node);
+        return false;
+    }
+    return true;
+}
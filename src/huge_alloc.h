@@ -0,0 +1,27 @@
+#ifndef XICLOPS_HUGE_ALLOC_H
+#define XICLOPS_HUGE_ALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum HugeKind {
+    HUGE_NONE,         // plain 4 KiB pages
+    HUGE_TRANSPARENT,  // THP requested with madvise
+    HUGE_EXPLICIT,     // reserved hugetlbfs pages
+} HugeKind;
+
+// Page-aligned, pre-faulted anonymous memory for large frame buffers. Tries
+// reserved 2 MiB pages first, then transparent huge pages, so walking a few
+// GiB of frames doesn't thrash the TLB. With `node` >= 0 the pages are bound
+// to that NUMA node before they are faulted in; otherwise they land on the
+// node of the calling thread. Returns NULL on failure.
+void* HugeAlloc(size_t bytes, int node, HugeKind* kind);
+void HugeFree(void* p, size_t bytes);
+const char* HugeKindName(HugeKind kind);
+
+// NUMA node of the CPU the calling thread runs on, 0 on a single-node box
+int NumaCurrentNode(void);
+// Restricts the calling thread to the CPUs of `node`
+bool NumaPinThread(int node);
+
+#endif  // XICLOPS_HUGE_ALLOC_H
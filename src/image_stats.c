@@ -0,0 +1,328 @@
+#include "image_stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock.h"
+#include "trace.h"
+
+// Sample planes: red, green, blue, then luma filled in by the worker
+#define PLANE(w, i) ((w)->samples + (size_t)(i) * IMAGE_STATS_SAMPLES)
+
+// Smallest grid step that keeps the sample count within `max_samples`. A
+// mosaic is sampled a whole 2x2 tile at a time, at even steps to stay in
+// phase.
+static int GridStep(int width, int height, int tile, uint32_t max_samples) {
+    int step = tile;
+    for (;;) {
+        uint64_t nx = (uint64_t)(width - tile) / step + 1;
+        uint64_t ny = (uint64_t)(height - tile) / step + 1;
+        if (nx * ny <= max_samples) {
+            return step;
+        }
+        step += tile;
+    }
+}
+
+static uint32_t GatherRgb32(
+    const Frame* frame,
+    const SourceRoi* region,
+    uint32_t max_samples,
+    uint8_t* r,
+    uint8_t* g,
+    uint8_t* b) {
+    int step = GridStep(region->width, region->height, 1, max_samples);
+    size_t stride = (size_t)frame->width * 4;
+    int x1 = region->x + region->width;
+    int y1 = region->y + region->height;
+    uint32_t n = 0;
+    for (int y = region->y; y < y1; y += step) {
+        const uint8_t* row = frame->data + (size_t)y * stride;
+        for (int x = region->x; x < x1; x += step) {
+            // BGRA
+            b[n] = row[4 * x + 0];
+            g[n] = row[4 * x + 1];
+            r[n] = row[4 * x + 2];
+            n += 1;
+        }
+    }
+    return n;
+}
+
+static inline int MosaicAt(const Frame* frame, int x, int y, int shift) {
+    if (frame->format == FRAME_RAW8) {
+        return frame->data[(size_t)y * frame->width + x];
+    }
+    const uint16_t* px = (const uint16_t*)frame->data;
+    int v = px[(size_t)y * frame->width + x] >> shift;
+    return v > 255 ? 255 : v;
+}
+
+static uint32_t GatherMosaic(
+    const Frame* frame,
+    const SourceRoi* region,
+    uint32_t max_samples,
+    uint8_t* r,
+    uint8_t* g,
+    uint8_t* b) {
+    int step = GridStep(region->width, region->height, 2, max_samples);
+    int shift = frame->format == FRAME_RAW16 && frame->bit_depth > 8
+                    ? frame->bit_depth - 8
+                    : 0;
+    // Red site within the tile; blue is diagonal to it
+    int rx = 0;
+    int ry = 0;
+    switch (frame->pattern) {
+        case BAYER_NONE:
+        case BAYER_RGGB: {
+            break;
+        }
+        case BAYER_BGGR: {
+            rx = 1;
+            ry = 1;
+            break;
+        }
+        case BAYER_GRBG: {
+            rx = 1;
+            break;
+        }
+        case BAYER_GBRG: {
+            ry = 1;
+            break;
+        }
+    }
+    int x1 = region->x + region->width;
+    int y1 = region->y + region->height;
+    uint32_t n = 0;
+    for (int y = region->y; y + 1 < y1; y += step) {
+        for (int x = region->x; x + 1 < x1; x += step) {
+            if (frame->pattern == BAYER_NONE) {
+                // Monochrome sensor
+                int v = MosaicAt(frame, x, y, shift);
+                r[n] = g[n] = b[n] = (uint8_t)v;
+            } else {
+                int bx = x + 1 - rx;
+                int by = y + 1 - ry;
+                r[n] = (uint8_t)MosaicAt(frame, x + rx, y + ry, shift);
+                b[n] = (uint8_t)MosaicAt(frame, bx, by, shift);
+                int g0 = MosaicAt(frame, bx, y + ry, shift);
+                int g1 = MosaicAt(frame, x + rx, by, shift);
+                g[n] = (uint8_t)((g0 + g1 + 1) >> 1);
+            }
+            n += 1;
+        }
+    }
+    return n;
+}
+
+uint32_t ImageStatsGather(
+    const Frame* frame,
+    const SourceRoi* region,
+    uint32_t max_samples,
+    uint8_t* r,
+    uint8_t* g,
+    uint8_t* b) {
+    SourceRoi whole = {.width = frame->width, .height = frame->height};
+    if (region == NULL) {
+        region = &whole;
+    }
+    // Mosaic regions start on a tile
+    SourceRoi clipped = *region;
+    if (frame->format != FRAME_RGB32) {
+        clipped.x &= ~1;
+        clipped.y &= ~1;
+    }
+    clipped.x = clipped.x < 0 ? 0 : clipped.x;
+    clipped.y = clipped.y < 0 ? 0 : clipped.y;
+    int x1 = region->x + region->width;
+    int y1 = region->y + region->height;
+    x1 = x1 > frame->width ? frame->width : x1;
+    y1 = y1 > frame->height ? frame->height : y1;
+    clipped.width = x1 - clipped.x;
+    clipped.height = y1 - clipped.y;
+    if (clipped.width < 2 || clipped.height < 2 || max_samples == 0) {
+        return 0;
+    }
+    if (frame->format == FRAME_RGB32) {
+        return GatherRgb32(frame, &clipped, max_samples, r, g, b);
+    }
+    return GatherMosaic(frame, &clipped, max_samples, r, g, b);
+}
+
+static void Bin(const ImageStatsWorker* w, ImageStats* out) {
+    const uint8_t* r = PLANE(w, 0);
+    const uint8_t* g = PLANE(w, 1);
+    const uint8_t* b = PLANE(w, 2);
+    uint8_t* luma = PLANE(w, 3);
+    uint32_t n = w->count;
+    memset(out, 0, sizeof(*out));
+    // Kept separate from the binning so it vectorizes
+    for (uint32_t i = 0; i < n; ++i) {
+        luma[i] = (uint8_t)((77 * r[i] + 150 * g[i] + 29 * b[i] + 128) >> 8);
+    }
+    uint64_t luma_sum = 0;
+    uint32_t clipped = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        out->bins[IMAGE_STATS_LUMA][luma[i]] += 1;
+        out->bins[IMAGE_STATS_RED][r[i]] += 1;
+        out->bins[IMAGE_STATS_GREEN][g[i]] += 1;
+        out->bins[IMAGE_STATS_BLUE][b[i]] += 1;
+        luma_sum += luma[i];
+        clipped += (r[i] == 255) | (g[i] == 255) | (b[i] == 255);
+    }
+    uint32_t dark = 0;
+    for (int v = 0; v < 8; ++v) {
+        dark += out->bins[IMAGE_STATS_LUMA][v];
+    }
+    for (int c = 0; c < IMAGE_STATS_CHANNELS; ++c) {
+        for (int v = 0; v < IMAGE_STATS_BINS; ++v) {
+            if (out->bins[c][v] > out->peak) {
+                out->peak = out->bins[c][v];
+            }
+        }
+    }
+    out->samples = n;
+    out->nframe = w->nframe;
+    if (n > 0) {
+        out->mean_luma = (double)luma_sum / n;
+        out->clipped = (double)clipped / n;
+        out->dark = (double)dark / n;
+    }
+}
+
+static void* StatsThread(void* arg) {
+    ImageStatsWorker* w = arg;
+    TraceSetThreadName("image stats");
+    ImageStats stats;
+    for (;;) {
+        pthread_mutex_lock(&w->lock);
+        while (!atomic_load(&w->busy) && !w->stopping) {
+            pthread_cond_wait(&w->wake, &w->lock);
+        }
+        bool stopping = w->stopping;
+        pthread_mutex_unlock(&w->lock);
+        if (stopping) {
+            break;
+        }
+        if (w->histogram) {
+            TraceBegin("bin");
+            uint64_t t0 = NowNs();
+            Bin(w, &stats);
+            atomic_fetch_add(&w->bin_ns, NowNs() - t0);
+            atomic_fetch_add(&w->binned, 1);
+            TraceEnd("bin");
+            pthread_mutex_lock(&w->lock);
+            w->stats = stats;
+            w->fresh = true;
+            pthread_mutex_unlock(&w->lock);
+        }
+        if (w->awb_wanted) {
+            TraceBegin("white balance");
+            uint64_t t0 = NowNs();
+            float correction[3];
+            bool ok = WhiteBalanceEstimate(
+                w->awb,
+                PLANE(w, 0),
+                PLANE(w, 1),
+                PLANE(w, 2),
+                w->count,
+                correction);
+            atomic_fetch_add(&w->awb_ns, NowNs() - t0);
+            atomic_fetch_add(&w->awb_estimates, 1);
+            TraceEnd("white balance");
+            if (ok) {
+                pthread_mutex_lock(&w->lock);
+                memcpy(w->awb_correction, correction, sizeof(correction));
+                w->awb_fresh = true;
+                pthread_mutex_unlock(&w->lock);
+            }
+        }
+        atomic_store(&w->busy, false);
+    }
+    return NULL;
+}
+
+bool ImageStatsStart(
+    ImageStatsWorker* w, bool histogram, AwbMethod awb, double awb_period_s) {
+    memset(w, 0, sizeof(*w));
+    w->histogram = histogram;
+    w->awb = awb;
+    w->awb_period_ns = (uint64_t)(awb_period_s * 1e9);
+    w->samples = malloc(4 * (size_t)IMAGE_STATS_SAMPLES);
+    if (w->samples == NULL) {
+        return false;
+    }
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->wake, NULL);
+    if (pthread_create(&w->thread, NULL, StatsThread, w) != 0) {
+        pthread_cond_destroy(&w->wake);
+        pthread_mutex_destroy(&w->lock);
+        free(w->samples);
+        w->samples = NULL;
+        return false;
+    }
+    return true;
+}
+
+void ImageStatsStop(ImageStatsWorker* w) {
+    pthread_mutex_lock(&w->lock);
+    w->stopping = true;
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+    pthread_cond_destroy(&w->wake);
+    pthread_mutex_destroy(&w->lock);
+    free(w->samples);
+    w->samples = NULL;
+}
+
+bool ImageStatsSubmit(ImageStatsWorker* w, const Frame* frame) {
+    if (atomic_load(&w->busy)) {
+        return false;
+    }
+    uint64_t now = NowNs();
+    w->awb_wanted = w->awb != AWB_OFF && now >= w->awb_due_ns;
+    if (!w->histogram && !w->awb_wanted) {
+        return false;
+    }
+    if (w->awb_wanted) {
+        w->awb_due_ns = now + w->awb_period_ns;
+    }
+    TraceBegin("stats gather");
+    w->count = ImageStatsGather(
+        frame,
+        NULL,
+        IMAGE_STATS_SAMPLES,
+        PLANE(w, 0),
+        PLANE(w, 1),
+        PLANE(w, 2));
+    w->nframe = frame->nframe;
+    TraceEnd("stats gather");
+    pthread_mutex_lock(&w->lock);
+    atomic_store(&w->busy, true);
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+    return true;
+}
+
+bool ImageStatsLatest(ImageStatsWorker* w, ImageStats* out) {
+    pthread_mutex_lock(&w->lock);
+    bool fresh = w->fresh;
+    if (fresh) {
+        *out = w->stats;
+        w->fresh = false;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return fresh;
+}
+
+bool ImageStatsLatestAwb(ImageStatsWorker* w, float correction[3]) {
+    pthread_mutex_lock(&w->lock);
+    bool fresh = w->awb_fresh;
+    if (fresh) {
+        memcpy(correction, w->awb_correction, sizeof(w->awb_correction));
+        w->awb_fresh = false;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return fresh;
+}
@@ -0,0 +1,95 @@
+#ifndef XICLOPS_IMAGE_STATS_H
+#define XICLOPS_IMAGE_STATS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "frame.h"
+#include "frame_source.h"
+#include "white_balance.h"
+
+// Luminance and per-channel histograms for the exposure overlay. Binning a
+// whole 4K frame per display frame would cost more than the rest of the
+// pipeline, so the render thread only gathers a fixed number of samples on a
+// regular grid (whole Bayer tiles for mosaics) and a worker thread bins them.
+// The cost is the same at any resolution. The same samples feed the auto
+// white balance estimate when one is due.
+#define IMAGE_STATS_BINS 256
+#define IMAGE_STATS_SAMPLES (1 << 14)
+
+typedef enum ImageStatsChannel {
+    IMAGE_STATS_LUMA,  // Rec. 601 weights
+    IMAGE_STATS_RED,
+    IMAGE_STATS_GREEN,
+    IMAGE_STATS_BLUE,
+    IMAGE_STATS_CHANNELS,
+} ImageStatsChannel;
+
+typedef struct ImageStats {
+    uint32_t bins[IMAGE_STATS_CHANNELS][IMAGE_STATS_BINS];
+    uint32_t peak;  // tallest bin of any channel, for scaling the plot
+    uint32_t samples;
+    uint32_t nframe;  // frame the samples came from
+    double mean_luma;  // 0-255
+    double clipped;    // fraction of samples with a channel at 255
+    double dark;       // fraction of samples with luma below 8
+} ImageStats;
+
+typedef struct ImageStatsWorker {
+    // Planes of IMAGE_STATS_SAMPLES red, green and blue 8-bit samples,
+    // written by ImageStatsSubmit() while the worker is idle
+    uint8_t* samples;
+    uint32_t count;
+    uint32_t nframe;
+    bool histogram;  // bin every sample set, not just the white balance ones
+    AwbMethod awb;
+    uint64_t awb_period_ns;
+    uint64_t awb_due_ns;  // submitter only
+    bool awb_wanted;      // this sample set is due for an estimate
+    atomic_bool busy;  // set by the submitter, cleared once binned
+    atomic_uint_least64_t bin_ns;  // worker time spent binning, total
+    atomic_uint_least64_t binned;  // sample sets binned
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool stopping;  // guarded by lock
+    bool fresh;     // guarded by lock: `stats` changed since ImageStatsLatest()
+    ImageStats stats;  // guarded by lock
+    bool awb_fresh;    // guarded by lock: `awb_correction` not yet taken
+    float awb_correction[3];  // guarded by lock, see WhiteBalanceEstimate()
+    atomic_uint_least64_t awb_ns;  // worker time spent estimating, total
+    atomic_uint_least64_t awb_estimates;
+} ImageStatsWorker;
+
+// Samples at most `max_samples` points of `region` (the whole frame if NULL)
+// on a regular grid into 8-bit red, green and blue arrays. Mosaic points are
+// whole Bayer tiles, with the greens averaged. Returns the number taken.
+uint32_t ImageStatsGather(
+    const Frame* frame,
+    const SourceRoi* region,
+    uint32_t max_samples,
+    uint8_t* r,
+    uint8_t* g,
+    uint8_t* b);
+
+// Bins every sample set if `histogram`, and estimates white balance with
+// `awb` every `awb_period_s`, unless AWB_OFF
+bool ImageStatsStart(
+    ImageStatsWorker* w, bool histogram, AwbMethod awb, double awb_period_s);
+void ImageStatsStop(ImageStatsWorker* w);
+
+// Samples `frame` for the worker, unless it is still busy with the previous
+// one or has nothing due. Returns whether the frame was taken; cheap enough
+// for the render thread at any frame size.
+bool ImageStatsSubmit(ImageStatsWorker* w, const Frame* frame);
+// Copies the newest statistics into `out`; false if none arrived since the
+// previous call
+bool ImageStatsLatest(ImageStatsWorker* w, ImageStats* out);
+// Newest white balance correction, relative to the gains of the frame it was
+// sampled from; false if none arrived since the previous call
+bool ImageStatsLatestAwb(ImageStatsWorker* w, float correction[3]);
+
+#endif  // XICLOPS_IMAGE_STATS_H
@@ -0,0 +1,31 @@
+#include "log.h"
+
+#include <stdarg.h>
+
+enum LEVEL VERBOSITY = INFO;
+
+static FILE* LOG_OUT = NULL;
+
+static const char* LEVEL_STR[] = {"ERROR", "WARN", "INFO", "DEBUG", "TRACE"};
+
+// Long enough for every message we emit; longer ones are truncated
+#define LOG_LINE_MAX 512
+
+void LogSetOutput(FILE* out) {
+    LOG_OUT = out;
+}
+
+void LogWrite(enum LEVEL lvl, const char* fmt, ...) {
+    static _Thread_local char line[LOG_LINE_MAX];
+    int n = snprintf(line, sizeof(line), "[XICLOPS %s] ", LEVEL_STR[lvl]);
+    va_list args;
+    va_start(args, fmt);
+    int m = vsnprintf(line + n, sizeof(line) - n, fmt, args);
+    va_end(args);
+    size_t len = n + m;
+    if (m < 0 || len >= sizeof(line)) {
+        len = sizeof(line) - 1;
+    }
+    // One fwrite per message keeps lines from different threads whole
+    fwrite(line, 1, len, LOG_OUT != NULL ? LOG_OUT : stdout);
+}
@@ -0,0 +1,39 @@
+#ifndef XICLOPS_LOG_H
+#define XICLOPS_LOG_H
+
+#include <stdio.h>
+
+enum LEVEL {
+    ERROR,
+    WARN,
+    INFO,
+    DEBUG,
+    TRACE,
+};
+
+// Highest level compiled into the binary. Statements above it are constant
+// false and disappear, arguments included. Set with -DLOG_MAX_LEVEL=DEBUG
+// (see the XICLOPS_TRACE_LOGS CMake option).
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL TRACE
+#endif
+
+// Runtime verbosity; only read by the Log() macro before formatting
+extern enum LEVEL VERBOSITY;
+
+// Formats into a fixed thread-local buffer, so enabled levels never allocate
+// and disabled levels cost a compare. Messages carry their own newline.
+#define Log(lvl, ...)                                           \
+    do {                                                        \
+        if ((lvl) <= LOG_MAX_LEVEL && (lvl) <= VERBOSITY) {     \
+            LogWrite((lvl), __VA_ARGS__);                       \
+        }                                                       \
+    } while (0)
+
+void LogWrite(enum LEVEL lvl, const char* fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Where messages go, stdout by default
+void LogSetOutput(FILE* out);
+
+#endif  // XICLOPS_LOG_H
@@ -1,290 +1,1446 @@
 #include <memory.h>
+#include <signal.h>
 #include <raylib.h>
 #include <raymath.h>
 #include <stdio.h>
-#include <xiApi.h>
+#include <stdlib.h>
+
+#include "capture.h"
+#include "clock.h"
+#include "demosaic.h"
+#include "frame_pool.h"
+#include "frame_source.h"
+#include "log.h"
+#include "microbench.h"
+#include "stats.h"
+#include "stream.h"
+#include "trace.h"
 
 // #include "nob.h"
 
 static const Color BACKGROUND_COLOR = {18, 18, 18, 255};
-static const int WIN_W = 3840;
-static const int WIN_H = 2160;
+static int SOURCE_W = 3840;
+static int SOURCE_H = 2160;
 static float ZOOM = 1.0;
 static int FONT_SIZE = 20;
-
-enum LEVEL {
-    ERROR,
-    WARN,
-    INFO,
-    DEBUG,
-    TRACE,
+static FrameFormat FORMAT = FRAME_RGB32;
+static bool SYNTHETIC = false;
+static double SYNTH_RATE = 150.0;
+static bool GPU_DEBAYER = true;
+static DemosaicMethod CPU_DEMOSAIC = DEMOSAIC_BILINEAR;
+static bool PBO_UPLOAD = true;
+static const int PBO_DEPTH = 3;
+#define MAX_STREAMS 8
+static int CAM_IDS[MAX_STREAMS] = {0};
+static int CAM_COUNT = 1;
+static Stream STREAMS[MAX_STREAMS];
+static const char* PLAY_PATHS[MAX_STREAMS] = {NULL};
+static int PLAY_COUNT = 0;
+static PlaybackMode PLAY_MODE = PLAYBACK_REALTIME;
+static uint64_t BENCH_FRAMES = 0;
+static const char* RECORD_PATH = NULL;
+static int RECORD_DEPTH = 8;
+static bool RECORD_BLOCK = false;
+static bool RECORD_RAW = false;
+static const char* CALIBRATION_PATH = NULL;
+static int CALIBRATION_FRAMES = 32;
+static const char* PRETRIGGER_PATH = NULL;
+static double PRETRIGGER_PRE = 5.0;
+static double PRETRIGGER_POST = 5.0;
+static int TRIGGER_GPI = 0;
+static int NUMA_NODE = -1;
+static bool ZERO_COPY = false;
+static int BANDWIDTH = 0;
+static bool ROI_FOLLOW = false;
+static int PREVIEW = 1;  // 0 picks the factor from the zoom
+static bool IMAGE_STATS = false;
+static bool AUTO_EXPOSURE = false;
+static AutoExposureConfig AE_CONFIG = {
+    .target = 110.0,
+    .damping = 0.5,
+    .region_w = 1.0f,
+    .region_h = 1.0f,
+    .max_gain_db = 12.0f,
+};
+static AwbConfig AWB_CONFIG = {
+    .method = AWB_OFF,
+    .period_s = 1.0,
+    .damping = 0.5,
+};
+static bool FOCUS = false;
+static FocusConfig FOCUS_CONFIG = {
+    .threshold = 24.0f,
+    .region_x = 0.25f,
+    .region_y = 0.25f,
+    .region_w = 0.5f,
+    .region_h = 0.5f,
 };
+static double STATS_PERIOD = 10.0;
+static const char* TRACE_PATH = NULL;
+static const uint64_t TRACE_EVENTS_PER_THREAD = 1 << 20;
+static volatile sig_atomic_t QUIT = 0;
 
-static enum LEVEL VERBOSITY = INFO;
+static void OnQuitSignal(int sig) {
+    (void)sig;
+    QUIT = 1;
+}
 
-const char* LevelStr(enum LEVEL lvl) {
-    switch (lvl) {
-        case ERROR: {
-            return "ERROR";
-        }
-        case WARN: {
-            return "WARN";
-        }
-        case INFO: {
-            return "INFO";
-        }
-        case DEBUG: {
-            return "DEBUG";
-        }
-        case TRACE: {
-            return "TRACE";
-        }
-    }
+static void OnDumpSignal(int sig) {
+    (void)sig;
+    TraceRequestDump();
+}
+static const float WB_KR = 1.29f;
+static const float WB_KG = 1.0f;
+static const float WB_KB = 3.04f;
+
+static void LogHealth(int cam_id, const CaptureHealth* h) {
+    Log(INFO,
+        "Camera %d: %lu frames, %lu dropped in %lu gaps (%lu in last %d ms), "
+        "interval %.3f ms, jitter %.3f ms (min %.3f, max %.3f)\n",
+        cam_id,
+        h->frames,
+        h->dropped,
+        h->gaps,
+        h->window_dropped,
+        CAPTURE_HEALTH_WINDOW_MS,
+        h->interval_us / 1e3,
+        h->jitter_us / 1e3,
+        h->interval_min_us / 1e3,
+        h->interval_max_us / 1e3);
 }
 
-void Log(enum LEVEL v, char* msg) {
-    if (v <= VERBOSITY) {
-        printf("[XICLOPS %s] %s", LevelStr(v), msg);
+// Histogram panel, 256 pixels wide: RGB and luma bins as overlaid columns
+// scaled to the tallest bin, with the summary underneath
+static void DrawImageStats(const ImageStats* st, int x, int y, int font_size) {
+    int plot_h = 4 * font_size;
+    DrawRectangle(x, y, IMAGE_STATS_BINS, plot_h, Fade(BLACK, 0.6f));
+    if (st->samples == 0) {
+        return;
+    }
+    static const Color COLORS[IMAGE_STATS_CHANNELS] = {
+        [IMAGE_STATS_LUMA] = LIGHTGRAY,
+        [IMAGE_STATS_RED] = RED,
+        [IMAGE_STATS_GREEN] = GREEN,
+        [IMAGE_STATS_BLUE] = BLUE,
+    };
+    int base = y + plot_h;
+    for (int c = IMAGE_STATS_RED; c < IMAGE_STATS_CHANNELS; ++c) {
+        for (int v = 0; v < IMAGE_STATS_BINS; ++v) {
+            int h = (int)((uint64_t)st->bins[c][v] * plot_h / st->peak);
+            DrawLine(x + v, base, x + v, base - h, Fade(COLORS[c], 0.45f));
+        }
     }
+    // Luma as an outline on top
+    for (int v = 0; v < IMAGE_STATS_BINS; ++v) {
+        int h = (int)((uint64_t)st->bins[IMAGE_STATS_LUMA][v] * plot_h /
+                      st->peak);
+        DrawPixel(x + v, base - h, COLORS[IMAGE_STATS_LUMA]);
+    }
+    const char* msg = TextFormat(
+        "Exposure: mean %.0f, %.1f%% clipped, %.1f%% dark",
+        st->mean_luma,
+        st->clipped * 100.0,
+        st->dark * 100.0);
+    DrawText(
+        msg, x, base + 4, font_size, st->clipped > 0.01 ? ORANGE : LIGHTGRAY);
 }
 
 void help() {
     printf("xiclops [options]\n");
     printf("  options:\n");
     printf("    -h      \tShow this message\n");
-    printf("    -c int  \tCamera ID (default = 0)\n");
+    printf("    -c list \tCamera IDs, comma separated (default = 0)\n");
+    printf("    -s str  \tSource: ximea or synthetic (default = ximea)\n");
+    printf("    --size WxH\tRequested frame size (default = 3840x2160)\n");
+    printf("    --rate float\tSynthetic fps, 0 = unpaced (default = 150)\n");
     printf("    -v int  \tVerbosity level (default = 2 a.k.a INFO)\n");
-    printf("    -z float\tZoom level (new/original) (default = 1.0)\n");
+    printf("    -z float\tZoom level (new/original) (default = 1.0);\n");
+    printf("            \tthe wheel zooms, dragging pans and R resets\n");
+    printf("    --roi\tCrop the sensor to the visible part of the view\n");
+    printf("    --preview str\tDownsample the display 1, 2, 4 or auto from\n");
+    printf("            \tthe zoom, on the sensor unless recording\n");
+    printf("            \t(default = 1)\n");
+    printf("    --histogram\tShow luma and RGB histograms of each camera\n");
+    printf("    --auto-exposure float\n");
+    printf("            \tSteer exposure, then gain, to this mean luma\n");
+    printf("            \t(0-255, typically 110)\n");
+    printf("    --ae-damping float\tShare of the error corrected per step,\n");
+    printf("            \t0-1 (default = 0.5)\n");
+    printf("    --ae-region x,y,w,h\n");
+    printf("            \tMetering region as fractions of the frame\n");
+    printf("            \t(default = 0,0,1,1)\n");
+    printf("    --awb str\tAuto white balance: gray (gray world) or white\n");
+    printf("            \t(white patch), in the camera for rgb32 and the\n");
+    printf("            \tshader for raw8 with -d gpu (default = off)\n");
+    printf("    --awb-period float\tSeconds between white balance\n");
+    printf("            \testimates (default = 1)\n");
+    printf("    --focus\tFocus peaking overlay (F toggles it) and a\n");
+    printf("            \tsharpness score of the focus region\n");
+    printf("    --focus-threshold float\n");
+    printf("            \tLuma step per pixel that counts as an edge\n");
+    printf("            \t(default = 24)\n");
+    printf("    --focus-region x,y,w,h\n");
+    printf("            \tScored region as fractions of the frame\n");
+    printf("            \t(default = 0.25,0.25,0.5,0.5)\n");
+    printf("    -f str  \tPixel format: rgb32/raw8/raw16 (default = rgb32)\n");
+    printf("    -d str  \tDebayer: gpu, bilinear or edge (default = gpu)\n");
+    printf("    -u str  \tTexture upload: sync or pbo (default = pbo)\n");
+    printf("    --trace path\n");
+    printf("            \tRecord stage timings as Chrome trace JSON,\n");
+    printf("            \twritten on exit or SIGUSR1\n");
+    printf("    --play path[,path]\n");
+    printf("            \tReplay recordings instead of cameras\n");
+    printf("    --play-mode str\n");
+    printf("            \tPlayback: realtime, fast or step (default =\n");
+    printf("            \trealtime); step with Right/Space and Left\n");
+    printf("    --record path\n");
+    printf("            \tWrite every frame to path (path.<id> with several\n");
+    printf("            \tcameras) with O_DIRECT and io_uring\n");
+    printf("    --record-depth int\n");
+    printf("            \tFrames queued for the disk (default = 8)\n");
+    printf("    --record-block\tWait for the disk instead of dropping\n");
+    printf("    --record-raw\tRecord frames uncorrected, with the dark and\n");
+    printf("            \tflat references for playback to apply\n");
+    printf("    --calibration path\n");
+    printf("            \tDark and flat correction of raw frames with the\n");
+    printf("            \treferences in path (path.<id> with several\n");
+    printf("            \tcameras); D takes a dark, L a flat, saved there\n");
+    printf("    --calibration-frames int\n");
+    printf("            \tFrames averaged per reference (default = 32)\n");
+    printf("    --pretrigger path\n");
+    printf("            \tKeep recent frames in RAM and save them to\n");
+    printf("            \tpath.<n> (path.<id>.<n>) when T is pressed\n");
+    printf("    --pre float\tSeconds kept before a trigger (default = 5)\n");
+    printf("    --post float\tSeconds saved after a trigger (default = 5)\n");
+    printf("    --trigger-gpi int\n");
+    printf("            \tAlso trigger on a rising edge of this camera\n");
+    printf("            \tinput, 0 = off (default = 0)\n");
+    printf("    --bandwidth int\tPer-camera transport limit in Mbit/s, 0 =\n");
+    printf("            \tsplit the measured controller bandwidth\n");
+    printf("            \tbetween its cameras and adapt (default = 0)\n");
+    printf("    --zero-copy\tPass the driver's buffers down the pipeline\n");
+    printf("            \tinstead of copying them (XI_BP_UNSAFE)\n");
+    printf("    --numa-node int\tBind frame buffers and capture threads to\n");
+    printf("            \tthis node, -1 = kernel default (default = -1)\n");
+    printf("    --stats float\tSeconds between sensor health log lines,\n");
+    printf("            \t0 = off (default = 10)\n");
+    printf("    --bench int\tRender N frames in a hidden window, print\n");
+    printf("            \tstage latencies and exit\n");
+    printf("    --microbench name [args]\n");
+    printf("            \tRun a named microbenchmark and exit\n");
 }
 
 int main(int argc, char** argv) {
-    int cam_id = 0;
-    char* log_msg;
     for (size_t i = 1; i < argc; ++i) {
         if (strcmp(argv[i], "-z") == 0) {
             if (i + 1 >= argc) {
-                asprintf(
-                    &log_msg, "No valid value given for option -z (zoom)\n");
-                Log(WARN, log_msg);
+                Log(WARN, "No valid value given for option -z (zoom)\n");
                 help();
                 break;
             }
             ZOOM = atof(argv[i + 1]);
-            asprintf(&log_msg, "ZOOM updated to %f\n", ZOOM);
-            Log(DEBUG, log_msg);
+            Log(DEBUG, "ZOOM updated to %f\n", ZOOM);
+            i += 1;
+        } else if (strcmp(argv[i], "--roi") == 0) {
+            ROI_FOLLOW = true;
+        } else if (strcmp(argv[i], "--histogram") == 0) {
+            IMAGE_STATS = true;
+        } else if (strcmp(argv[i], "--auto-exposure") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN,
+                    "No valid value given for option --auto-exposure "
+                    "(luma)\n");
+                help();
+                break;
+            }
+            AUTO_EXPOSURE = true;
+            AE_CONFIG.target = atof(argv[i + 1]);
+            Log(DEBUG, "AE target updated to %f\n", AE_CONFIG.target);
+            i += 1;
+        } else if (strcmp(argv[i], "--ae-damping") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN, "No valid value given for option --ae-damping\n");
+                help();
+                break;
+            }
+            AE_CONFIG.damping = atof(argv[i + 1]);
+            Log(DEBUG, "AE damping updated to %f\n", AE_CONFIG.damping);
+            i += 1;
+        } else if (strcmp(argv[i], "--ae-region") == 0) {
+            if (i + 1 >= argc ||
+                sscanf(
+                    argv[i + 1],
+                    "%f,%f,%f,%f",
+                    &AE_CONFIG.region_x,
+                    &AE_CONFIG.region_y,
+                    &AE_CONFIG.region_w,
+                    &AE_CONFIG.region_h) != 4) {
+                Log(WARN,
+                    "No valid value given for option --ae-region "
+                    "(x,y,w,h)\n");
+                help();
+                break;
+            }
+            Log(DEBUG,
+                "AE region updated to %.2f,%.2f %.2fx%.2f\n",
+                AE_CONFIG.region_x,
+                AE_CONFIG.region_y,
+                AE_CONFIG.region_w,
+                AE_CONFIG.region_h);
+            i += 1;
+        } else if (strcmp(argv[i], "--awb") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN, "No valid value given for option --awb\n");
+                help();
+                break;
+            }
+            if (strcmp(argv[i + 1], "gray") == 0) {
+                AWB_CONFIG.method = AWB_GRAY_WORLD;
+            } else if (strcmp(argv[i + 1], "white") == 0) {
+                AWB_CONFIG.method = AWB_WHITE_PATCH;
+            } else {
+                Log(WARN, "Unknown white balance method %s\n", argv[i + 1]);
+                help();
+                break;
+            }
+            Log(DEBUG, "AWB updated to %s\n", argv[i + 1]);
+            i += 1;
+        } else if (strcmp(argv[i], "--awb-period") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN, "No valid value given for option --awb-period\n");
+                help();
+                break;
+            }
+            AWB_CONFIG.period_s = atof(argv[i + 1]);
+            Log(DEBUG, "AWB period updated to %f\n", AWB_CONFIG.period_s);
+            i += 1;
+        } else if (strcmp(argv[i], "--focus") == 0) {
+            FOCUS = true;
+        } else if (strcmp(argv[i], "--focus-threshold") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN,
+                    "No valid value given for option --focus-threshold\n");
+                help();
+                break;
+            }
+            FOCUS_CONFIG.threshold = atof(argv[i + 1]);
+            Log(DEBUG,
+                "Focus threshold updated to %f\n",
+                FOCUS_CONFIG.threshold);
+            i += 1;
+        } else if (strcmp(argv[i], "--focus-region") == 0) {
+            if (i + 1 >= argc ||
+                sscanf(
+                    argv[i + 1],
+                    "%f,%f,%f,%f",
+                    &FOCUS_CONFIG.region_x,
+                    &FOCUS_CONFIG.region_y,
+                    &FOCUS_CONFIG.region_w,
+                    &FOCUS_CONFIG.region_h) != 4) {
+                Log(WARN,
+                    "No valid value given for option --focus-region "
+                    "(x,y,w,h)\n");
+                help();
+                break;
+            }
+            Log(DEBUG,
+                "Focus region updated to %.2f,%.2f %.2fx%.2f\n",
+                FOCUS_CONFIG.region_x,
+                FOCUS_CONFIG.region_y,
+                FOCUS_CONFIG.region_w,
+                FOCUS_CONFIG.region_h);
+            i += 1;
+        } else if (strcmp(argv[i], "--preview") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN, "No valid value given for option --preview\n");
+                help();
+                break;
+            }
+            if (strcmp(argv[i + 1], "auto") == 0) {
+                PREVIEW = 0;
+            } else {
+                PREVIEW = atoi(argv[i + 1]);
+                if (PREVIEW != 1 && PREVIEW != 2 && PREVIEW != 4) {
+                    Log(WARN, "Preview factor must be 1, 2 or 4\n");
+                    PREVIEW = 1;
+                }
+            }
+            Log(DEBUG, "PREVIEW updated to %d\n", PREVIEW);
             i += 1;
         } else if (strcmp(argv[i], "-v") == 0) {
             if (i + 1 >= argc) {
-                asprintf(
-                    &log_msg,
-                    "No valid value given for option -v (verbosity)\n");
-                Log(WARN, log_msg);
+                Log(WARN, "No valid value given for option -v (verbosity)\n");
                 help();
                 break;
             }
             VERBOSITY = atoi(argv[i + 1]);
-            asprintf(&log_msg, "VERBOSITY updated to %d\n", VERBOSITY);
-            Log(DEBUG, log_msg);
+            Log(DEBUG, "VERBOSITY updated to %d\n", VERBOSITY);
             i += 1;
         } else if (strcmp(argv[i], "-c") == 0) {
             if (i + 1 >= argc) {
-                asprintf(
-                    &log_msg,
-                    "No valid value given for option -c (camera ID)\n");
-                Log(WARN, log_msg);
+                Log(WARN, "No valid value given for option -c (camera ID)\n");
                 help();
                 break;
             }
-            cam_id = atoi(argv[i + 1]);
-            asprintf(&log_msg, "cam_id updated to %d\n", cam_id);
-            Log(DEBUG, log_msg);
+            CAM_COUNT = 0;
+            for (char* id = strtok(argv[i + 1], ","); id != NULL;
+                 id = strtok(NULL, ",")) {
+                if (CAM_COUNT == MAX_STREAMS) {
+                    Log(WARN,
+                        "Only the first %d cameras are used\n",
+                        CAM_COUNT);
+                    break;
+                }
+                CAM_IDS[CAM_COUNT++] = atoi(id);
+                Log(DEBUG, "Camera %d added\n", CAM_IDS[CAM_COUNT - 1]);
+            }
+            if (CAM_COUNT == 0) {
+                CAM_IDS[CAM_COUNT++] = 0;
+            }
             i += 1;
+        } else if (strcmp(argv[i], "-s") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN, "No valid value given for option -s (source)\n");
+                help();
+                break;
+            }
+            if (strcmp(argv[i + 1], "synthetic") == 0) {
+                SYNTHETIC = true;
+            } else if (strcmp(argv[i + 1], "ximea") == 0) {
+                SYNTHETIC = false;
+            } else {
+                Log(WARN, "Unknown frame source: %s\n", argv[i + 1]);
+            }
+            i += 1;
+        } else if (strcmp(argv[i], "--size") == 0) {
+            if (i + 1 >= argc ||
+                sscanf(argv[i + 1], "%dx%d", &SOURCE_W, &SOURCE_H) != 2) {
+                Log(WARN, "No valid value given for option --size (WxH)\n");
+                help();
+                break;
+            }
+            Log(DEBUG, "Size updated to %dx%d\n", SOURCE_W, SOURCE_H);
+            i += 1;
+        } else if (strcmp(argv[i], "--rate") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN, "No valid value given for option --rate (Hz)\n");
+                help();
+                break;
+            }
+            SYNTH_RATE = atof(argv[i + 1]);
+            Log(DEBUG, "SYNTH_RATE updated to %f\n", SYNTH_RATE);
+            i += 1;
+        } else if (strcmp(argv[i], "-f") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN,
+                    "No valid value given for option -f (pixel format)\n");
+                help();
+                break;
+            }
+            if (strcmp(argv[i + 1], "raw8") == 0) {
+                FORMAT = FRAME_RAW8;
+            } else if (strcmp(argv[i + 1], "raw16") == 0) {
+                FORMAT = FRAME_RAW16;
+            } else if (strcmp(argv[i + 1], "rgb32") == 0) {
+                FORMAT = FRAME_RGB32;
+            } else {
+                Log(WARN, "Unknown pixel format: %s\n", argv[i + 1]);
+            }
+            Log(DEBUG, "FORMAT updated to %d\n", FORMAT);
+            i += 1;
+        } else if (strcmp(argv[i], "-d") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN, "No valid value given for option -d (debayer)\n");
+                help();
+                break;
+            }
+            if (strcmp(argv[i + 1], "gpu") == 0) {
+                GPU_DEBAYER = true;
+            } else if (strcmp(argv[i + 1], "bilinear") == 0) {
+                GPU_DEBAYER = false;
+                CPU_DEMOSAIC = DEMOSAIC_BILINEAR;
+            } else if (strcmp(argv[i + 1], "edge") == 0) {
+                GPU_DEBAYER = false;
+                CPU_DEMOSAIC = DEMOSAIC_EDGE_AWARE;
+            } else {
+                Log(WARN, "Unknown debayer: %s\n", argv[i + 1]);
+            }
+            i += 1;
+        } else if (strcmp(argv[i], "-u") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN, "No valid value given for option -u (upload)\n");
+                help();
+                break;
+            }
+            if (strcmp(argv[i + 1], "sync") == 0) {
+                PBO_UPLOAD = false;
+            } else if (strcmp(argv[i + 1], "pbo") == 0) {
+                PBO_UPLOAD = true;
+            } else {
+                Log(WARN, "Unknown upload mode: %s\n", argv[i + 1]);
+            }
+            i += 1;
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN, "No valid value given for option --trace (path)\n");
+                help();
+                break;
+            }
+            TRACE_PATH = argv[i + 1];
+            Log(DEBUG, "TRACE_PATH updated to %s\n", TRACE_PATH);
+            i += 1;
+        } else if (strcmp(argv[i], "--play") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN, "No valid value given for option --play (path)\n");
+                help();
+                break;
+            }
+            PLAY_COUNT = 0;
+            for (char* path = strtok(argv[i + 1], ","); path != NULL;
+                 path = strtok(NULL, ",")) {
+                if (PLAY_COUNT == MAX_STREAMS) {
+                    Log(WARN,
+                        "Only the first %d recordings are played\n",
+                        PLAY_COUNT);
+                    break;
+                }
+                PLAY_PATHS[PLAY_COUNT++] = path;
+                Log(DEBUG, "Recording %s added\n", path);
+            }
+            i += 1;
+        } else if (strcmp(argv[i], "--play-mode") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN,
+                    "No valid value given for option --play-mode (mode)\n");
+                help();
+                break;
+            }
+            if (strcmp(argv[i + 1], "realtime") == 0) {
+                PLAY_MODE = PLAYBACK_REALTIME;
+            } else if (strcmp(argv[i + 1], "fast") == 0) {
+                PLAY_MODE = PLAYBACK_FAST;
+            } else if (strcmp(argv[i + 1], "step") == 0) {
+                PLAY_MODE = PLAYBACK_STEP;
+            } else {
+                Log(WARN, "Unknown playback mode: %s\n", argv[i + 1]);
+            }
+            i += 1;
+        } else if (strcmp(argv[i], "--record") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN, "No valid value given for option --record (path)\n");
+                help();
+                break;
+            }
+            RECORD_PATH = argv[i + 1];
+            Log(DEBUG, "RECORD_PATH updated to %s\n", RECORD_PATH);
+            i += 1;
+        } else if (strcmp(argv[i], "--record-depth") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN,
+                    "No valid value given for option --record-depth "
+                    "(frames)\n");
+                help();
+                break;
+            }
+            RECORD_DEPTH = atoi(argv[i + 1]);
+            Log(DEBUG, "RECORD_DEPTH updated to %d\n", RECORD_DEPTH);
+            i += 1;
+        } else if (strcmp(argv[i], "--record-block") == 0) {
+            RECORD_BLOCK = true;
+        } else if (strcmp(argv[i], "--record-raw") == 0) {
+            RECORD_RAW = true;
+        } else if (strcmp(argv[i], "--calibration") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN,
+                    "No valid value given for option --calibration (path)\n");
+                help();
+                break;
+            }
+            CALIBRATION_PATH = argv[i + 1];
+            Log(DEBUG, "CALIBRATION_PATH updated to %s\n", CALIBRATION_PATH);
+            i += 1;
+        } else if (strcmp(argv[i], "--calibration-frames") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN,
+                    "No valid value given for option --calibration-frames "
+                    "(frames)\n");
+                help();
+                break;
+            }
+            CALIBRATION_FRAMES = atoi(argv[i + 1]);
+            Log(DEBUG,
+                "CALIBRATION_FRAMES updated to %d\n",
+                CALIBRATION_FRAMES);
+            i += 1;
+        } else if (strcmp(argv[i], "--pretrigger") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN,
+                    "No valid value given for option --pretrigger (path)\n");
+                help();
+                break;
+            }
+            PRETRIGGER_PATH = argv[i + 1];
+            Log(DEBUG, "PRETRIGGER_PATH updated to %s\n", PRETRIGGER_PATH);
+            i += 1;
+        } else if (strcmp(argv[i], "--pre") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN, "No valid value given for option --pre (s)\n");
+                help();
+                break;
+            }
+            PRETRIGGER_PRE = atof(argv[i + 1]);
+            Log(DEBUG, "PRETRIGGER_PRE updated to %f\n", PRETRIGGER_PRE);
+            i += 1;
+        } else if (strcmp(argv[i], "--post") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN, "No valid value given for option --post (s)\n");
+                help();
+                break;
+            }
+            PRETRIGGER_POST = atof(argv[i + 1]);
+            Log(DEBUG, "PRETRIGGER_POST updated to %f\n", PRETRIGGER_POST);
+            i += 1;
+        } else if (strcmp(argv[i], "--trigger-gpi") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN,
+                    "No valid value given for option --trigger-gpi "
+                    "(input)\n");
+                help();
+                break;
+            }
+            TRIGGER_GPI = atoi(argv[i + 1]);
+            Log(DEBUG, "TRIGGER_GPI updated to %d\n", TRIGGER_GPI);
+            i += 1;
+        } else if (strcmp(argv[i], "--bandwidth") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN,
+                    "No valid value given for option --bandwidth (Mbit/s)\n");
+                help();
+                break;
+            }
+            BANDWIDTH = atoi(argv[i + 1]);
+            Log(DEBUG, "BANDWIDTH updated to %d\n", BANDWIDTH);
+            i += 1;
+        } else if (strcmp(argv[i], "--zero-copy") == 0) {
+            ZERO_COPY = true;
+        } else if (strcmp(argv[i], "--numa-node") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN,
+                    "No valid value given for option --numa-node (node)\n");
+                help();
+                break;
+            }
+            NUMA_NODE = atoi(argv[i + 1]);
+            Log(DEBUG, "NUMA_NODE updated to %d\n", NUMA_NODE);
+            i += 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN, "No valid value given for option --stats (s)\n");
+                help();
+                break;
+            }
+            STATS_PERIOD = atof(argv[i + 1]);
+            Log(DEBUG, "STATS_PERIOD updated to %f\n", STATS_PERIOD);
+            i += 1;
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            if (i + 1 >= argc) {
+                Log(WARN, "No valid value given for option --bench (frames)\n");
+                help();
+                break;
+            }
+            BENCH_FRAMES = strtoull(argv[i + 1], NULL, 10);
+            Log(DEBUG, "BENCH_FRAMES updated to %lu\n", BENCH_FRAMES);
+            i += 1;
+        } else if (strcmp(argv[i], "--microbench") == 0) {
+            if (i + 1 >= argc) {
+                RunMicrobench("", 0, NULL);
+                return 1;
+            }
+            return RunMicrobench(argv[i + 1], argc - i - 2, argv + i + 2);
         } else if (strcmp(argv[i], "-h") == 0) {
             help();
             return 0;
         } else {
-            asprintf(&log_msg, "Unknown option: %s\n", argv[i]);
-            Log(WARN, log_msg);
+            Log(WARN, "Unknown option: %s\n", argv[i]);
         }
     }
 
-    asprintf(&log_msg, "Opening Camera %d\n", cam_id);
-    Log(INFO, log_msg);
-
-    HANDLE handle = NULL;
-    XI_RETURN status = XI_OK;
-    status = xiOpenDevice(cam_id, &handle);
-    if (status != XI_OK) {
-        printf("Failed to open camera 0\n");
-        return 1;
+    signal(SIGINT, OnQuitSignal);
+    signal(SIGTERM, OnQuitSignal);
+    if (TRACE_PATH != NULL) {
+        TraceInit(TRACE_EVENTS_PER_THREAD);
+        TraceSetThreadName("render");
+        signal(SIGUSR1, OnDumpSignal);
     }
 
-    status += xiSetParamInt(handle, XI_PRM_EXPOSURE, 20000);
-    status += xiSetParamInt(handle, XI_PRM_IMAGE_DATA_FORMAT, XI_RGB32);
-    status += xiSetParamInt(handle, XI_PRM_OUTPUT_DATA_BIT_DEPTH, XI_BPP_8);
-    // Set width
-    int w_inc;
-    status += xiGetParamInt(handle, XI_PRM_WIDTH XI_PRM_INFO_INCREMENT, &w_inc);
-    asprintf(&log_msg, "Width inc: %d\n", w_inc);
-    Log(DEBUG, log_msg);
-    int width = (WIN_W / w_inc) * w_inc;
-    status += xiSetParamInt(handle, XI_PRM_WIDTH, width);
-    if (status != XI_OK) {
-        printf("Failed to set width: %d\n", width);
-        return 1;
+    if (PREVIEW == 0) {
+        // Coarsest factor that still has a texel per screen pixel
+        PREVIEW = ZOOM <= 0.25f ? 4 : ZOOM <= 0.5f ? 2 : 1;
+        Log(INFO, "Preview factor %d for zoom %.2f\n", PREVIEW, ZOOM);
     }
-    // Set height
-    int h_inc;
-    status +=
-        xiGetParamInt(handle, XI_PRM_HEIGHT XI_PRM_INFO_INCREMENT, &h_inc);
-    asprintf(&log_msg, "Height inc: %d\n", h_inc);
-    Log(DEBUG, log_msg);
-    int height = (WIN_H / h_inc) * h_inc;
-    status += xiSetParamInt(handle, XI_PRM_HEIGHT, height);
-    if (status != XI_OK) {
-        printf("Failed to set height: %d\n", height);
-        return 1;
-    }
-    asprintf(&log_msg, "Image size: [%d, %d]\n", width, height);
-    Log(DEBUG, log_msg);
-    // Set x-offset
-    int x_offset_inc;
-    status += xiGetParamInt(
-        handle, XI_PRM_OFFSET_X XI_PRM_INFO_INCREMENT, &x_offset_inc);
-    int x_offset = ((WIN_W - width) / 2 / x_offset_inc) * x_offset_inc;
-    status += xiSetParamInt(handle, XI_PRM_OFFSET_X, x_offset);
-    if (status != XI_OK) {
-        printf("Failed to set x-offset\n");
-        return 1;
+    StreamConfig stream_cfg = {
+        .synthetic = SYNTHETIC,
+        .play_mode = PLAY_MODE,
+        .source =
+            {
+                .width = SOURCE_W,
+                .height = SOURCE_H,
+                .format = FORMAT,
+                .exposure_us = 20000,
+                .wb_kr = WB_KR,
+                .wb_kg = WB_KG,
+                .wb_kb = WB_KB,
+                .rate_hz = SYNTH_RATE,
+                .zero_copy = ZERO_COPY,
+                .bandwidth_mbps = BANDWIDTH,
+            },
+        .gpu_debayer = GPU_DEBAYER,
+        .demosaic = CPU_DEMOSAIC,
+        .pbo_upload = PBO_UPLOAD,
+        .pbo_depth = PBO_DEPTH,
+        .record_depth = RECORD_DEPTH,
+        .record_block = RECORD_BLOCK,
+        .record_raw = RECORD_RAW,
+        .calibration_frames = CALIBRATION_FRAMES,
+        .pretrigger_pre_s = PRETRIGGER_PRE,
+        .pretrigger_post_s = PRETRIGGER_POST,
+        .trigger_gpi = TRIGGER_GPI,
+        .roi_follow = ROI_FOLLOW,
+        .preview = PREVIEW,
+        .image_stats = IMAGE_STATS,
+        .auto_exposure = AUTO_EXPOSURE ? &AE_CONFIG : NULL,
+        .awb = AWB_CONFIG.method != AWB_OFF ? &AWB_CONFIG : NULL,
+        .focus = FOCUS ? &FOCUS_CONFIG : NULL,
+    };
+    FramePoolSetNode(NUMA_NODE);
+    // Every camera gets its own capture thread; the render loop below is the
+    // only consumer and draws all of them into one window. Recordings replace
+    // the cameras one for one.
+    if (PLAY_COUNT > 0) {
+        CAM_COUNT = PLAY_COUNT;
+        for (int i = 0; i < CAM_COUNT; ++i) {
+            CAM_IDS[i] = i;
+        }
     }
-    // Set y-offset
-    int y_offset_inc;
-    status += xiGetParamInt(
-        handle, XI_PRM_OFFSET_Y XI_PRM_INFO_INCREMENT, &y_offset_inc);
-    int y_offset = ((WIN_H - height) / 2 / y_offset_inc) * y_offset_inc;
-    status += xiSetParamInt(handle, XI_PRM_OFFSET_Y, y_offset);
-    if (status != XI_OK) {
-        printf("Failed to set y-offset\n");
-        return 1;
+    int stream_count = 0;
+    for (int i = 0; i < CAM_COUNT; ++i) {
+        stream_cfg.play_path = PLAY_COUNT > 0 ? PLAY_PATHS[i] : NULL;
+        if (!SYNTHETIC && PLAY_COUNT == 0) {
+            stream_cfg.source.peers =
+                FrameSourceXimeaPeers(CAM_IDS[i], CAM_IDS, CAM_COUNT);
+        }
+        char record_path[4096];
+        if (RECORD_PATH != NULL) {
+            if (CAM_COUNT > 1) {
+                snprintf(
+                    record_path,
+                    sizeof(record_path),
+                    "%s.%d",
+                    RECORD_PATH,
+                    CAM_IDS[i]);
+            } else {
+                snprintf(record_path, sizeof(record_path), "%s", RECORD_PATH);
+            }
+            stream_cfg.record_path = record_path;
+        }
+        char pretrigger_path[4096];
+        if (PRETRIGGER_PATH != NULL) {
+            if (CAM_COUNT > 1) {
+                snprintf(
+                    pretrigger_path,
+                    sizeof(pretrigger_path),
+                    "%s.%d",
+                    PRETRIGGER_PATH,
+                    CAM_IDS[i]);
+            } else {
+                snprintf(
+                    pretrigger_path,
+                    sizeof(pretrigger_path),
+                    "%s",
+                    PRETRIGGER_PATH);
+            }
+            stream_cfg.pretrigger_path = pretrigger_path;
+        }
+        char calibration_path[4096];
+        if (CALIBRATION_PATH != NULL) {
+            if (CAM_COUNT > 1) {
+                snprintf(
+                    calibration_path,
+                    sizeof(calibration_path),
+                    "%s.%d",
+                    CALIBRATION_PATH,
+                    CAM_IDS[i]);
+            } else {
+                snprintf(
+                    calibration_path,
+                    sizeof(calibration_path),
+                    "%s",
+                    CALIBRATION_PATH);
+            }
+            stream_cfg.calibration_path = calibration_path;
+        }
+        if (!StreamOpen(&STREAMS[i], CAM_IDS[i], &stream_cfg)) {
+            printf("Failed to open camera %d\n", CAM_IDS[i]);
+            for (int j = 0; j < stream_count; ++j) {
+                StreamClose(&STREAMS[j]);
+            }
+            return 1;
+        }
+        stream_count += 1;
     }
 
-    // Set bandwidth limit to max
-    status += xiSetParamInt(handle, XI_PRM_LIMIT_BANDWIDTH_MODE, XI_ON);
-    int bw_max;
-    status += xiGetParamInt(handle, XI_PRM_HEIGHT XI_PRM_INFO_MAX, &bw_max);
-    status += xiSetParamInt(handle, XI_PRM_LIMIT_BANDWIDTH, 2664);
-
-    // Set white balance
-    status += xiSetParamFloat(handle, XI_PRM_WB_KR, 1.29);
-    status += xiSetParamFloat(handle, XI_PRM_WB_KG, 1.0);
-    status += xiSetParamFloat(handle, XI_PRM_WB_KB, 3.04);
-
-    // Set alpha default
-    status += xiSetParamInt(handle, XI_PRM_IMAGE_DATA_FORMAT_RGB32_ALPHA, 255);
-
-    int img_size_bytes = width * height * 4;
-    // status += xiGetParamInt(handle, XI_PRM_IMAGE_PAYLOAD_SIZE,
-    // &img_size_bytes);
-
-    // Start acquisition
-    status += xiStartAcquisition(handle);
-    if (status != XI_OK) {
-        printf("Failed to setup camera 0\n");
-        return 1;
+    // Streams are tiled at their full-resolution size in world space, in a
+    // grid as close to square as possible; the zoom scales the whole grid
+    int tile_w = 0;
+    int tile_h = 0;
+    for (int i = 0; i < stream_count; ++i) {
+        tile_w = STREAMS[i].view_width > tile_w ? STREAMS[i].view_width
+                                                : tile_w;
+        tile_h = STREAMS[i].view_height > tile_h ? STREAMS[i].view_height
+                                                 : tile_h;
     }
-
-    XI_IMG image;
-    memset(&image, 0, sizeof(image));
-    image.size = sizeof(XI_IMG);
-    image.bp = (unsigned char*)malloc(img_size_bytes);
-    image.bp_size = img_size_bytes;
-    asprintf(&log_msg, "Payload size: %d\n", img_size_bytes);
-    Log(DEBUG, log_msg);
+    int grid_cols = 1;
+    while (grid_cols * grid_cols < stream_count) {
+        grid_cols += 1;
+    }
+    int grid_rows = (stream_count + grid_cols - 1) / grid_cols;
 
     Camera2D camera = {
         .zoom = ZOOM,
         .offset = {.x = 0.0f, .y = 0.0f},
     };
 
-    Image rl_img = {
-        .width = width,
-        .height = height,
-        .mipmaps = 1,
-        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
-    };
-
-    Texture2D texture = {
-        .width = (int)width * ZOOM,
-        .height = (int)height * ZOOM,
-        .mipmaps = 1,
-        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
-    };
-
-    float w = WIN_W * ZOOM;
-    float h = WIN_H * ZOOM;
+    float w = grid_cols * tile_w * ZOOM;
+    float h = grid_rows * tile_h * ZOOM;
+    // Sensor ROIs follow the view once it has been still for a moment
+    double view_changed = 0.0;
+    bool view_synced = false;
 
-    bool got_first = false;
+    int exit_code = 0;
+    double cap_fps[MAX_STREAMS] = {0};
+    uint64_t cap_fps_frames[MAX_STREAMS] = {0};
+    double lent_gbs[MAX_STREAMS] = {0};
+    uint64_t lent_bytes[MAX_STREAMS] = {0};
+    double upload_avg_ms[MAX_STREAMS] = {0};
+    CaptureHealth health[MAX_STREAMS] = {0};
+    double cap_fps_time = 0.0;
+    uint64_t stats_time_ns = NowNs();
+    // Render thread latencies; conversion and upload are kept per stream
+    Histogram wait_hist, draw_hist, present_hist;
+    HistogramReset(&wait_hist);
+    HistogramReset(&draw_hist);
+    HistogramReset(&present_hist);
+    uint64_t bench_shown = 0;
+    uint64_t bench_start_ns = 0;
+    uint64_t bench_start_frames[MAX_STREAMS] = {0};
+    uint64_t bench_start_skipped[MAX_STREAMS] = {0};
+    uint64_t bench_start_lent[MAX_STREAMS] = {0};
 
-    asprintf(&log_msg, "Initializing window...\n");
-    Log(INFO, log_msg);
+    Log(INFO, "Initializing window...\n");
+    if (BENCH_FRAMES > 0) {
+        SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    }
     InitWindow(w, h, "Xiclops");
-    SetWindowPosition(100 * cam_id + 100, 200 * cam_id + 100);
-    SetTargetFPS(60);
+    // Without a display the benchmark still times acquisition and conversion
+    bool has_gl = IsWindowReady();
+    if (!has_gl) {
+        if (BENCH_FRAMES == 0) {
+            printf("Failed to open window\n");
+            for (int i = 0; i < stream_count; ++i) {
+                StreamClose(&STREAMS[i]);
+            }
+            return 1;
+        }
+        Log(WARN, "No GL context, benchmarking without upload and draw\n");
+    } else {
+        SetWindowPosition(100, 100);
+        for (int i = 0; i < stream_count; ++i) {
+            if (!StreamInitGpu(&STREAMS[i])) {
+                printf("Failed to compile debayer shader\n");
+                for (int j = 0; j < stream_count; ++j) {
+                    StreamClose(&STREAMS[j]);
+                }
+                CloseWindow();
+                return 1;
+            }
+        }
+    }
+    SetTargetFPS(BENCH_FRAMES > 0 ? 0 : 60);
     printf("Starting render loop\n");
-    while (!WindowShouldClose()) {
-        w = GetScreenWidth();
-        asprintf(&log_msg, "Screen width: %f\n", w);
-        Log(TRACE, log_msg);
-        h = GetScreenHeight();
-        asprintf(&log_msg, "Screen height: %f\n", h);
-        Log(TRACE, log_msg);
+    while (!QUIT && (!has_gl || !WindowShouldClose())) {
+        if (TraceTakeDumpRequest()) {
+            Log(INFO, "Dumping trace to %s\n", TRACE_PATH);
+            TraceDump(TRACE_PATH);
+        }
+        if (has_gl) {
+            int step = 0;
+            if (IsKeyPressed(KEY_RIGHT) || IsKeyPressedRepeat(KEY_RIGHT) ||
+                IsKeyPressed(KEY_SPACE)) {
+                step = 1;
+            } else if (IsKeyPressed(KEY_LEFT) || IsKeyPressedRepeat(KEY_LEFT)) {
+                step = -1;
+            }
+            for (int i = 0; step != 0 && i < stream_count; ++i) {
+                FrameSourceStep(&STREAMS[i].source, step);
+            }
+            if (IsKeyPressed(KEY_T)) {
+                for (int i = 0; i < stream_count; ++i) {
+                    if (STREAMS[i].pretriggering) {
+                        PreTriggerRequest(&STREAMS[i].pretrigger);
+                    }
+                }
+            }
+            if (IsKeyPressed(KEY_F)) {
+                for (int i = 0; i < stream_count; ++i) {
+                    STREAMS[i].focus_peaking = !STREAMS[i].focus_peaking;
+                }
+            }
+            // Cap the lens for D, light an even target for L
+            bool dark = IsKeyPressed(KEY_D);
+            if (dark || IsKeyPressed(KEY_L)) {
+                for (int i = 0; i < stream_count; ++i) {
+                    if (STREAMS[i].calibrating) {
+                        CalibratorRequest(
+                            &STREAMS[i].calibrator,
+                            dark ? CALIBRATION_DARK : CALIBRATION_FLAT);
+                    }
+                }
+            }
+            // The wheel zooms about the cursor, dragging pans, R resets
+            float wheel = GetMouseWheelMove();
+            if (wheel != 0.0f) {
+                Vector2 mouse = GetMousePosition();
+                camera.target = GetScreenToWorld2D(mouse, camera);
+                camera.offset = mouse;
+                camera.zoom = Clamp(
+                    camera.zoom * powf(1.25f, wheel), ZOOM / 8, ZOOM * 32);
+                view_changed = GetTime();
+                view_synced = false;
+            }
+            Vector2 drag = GetMouseDelta();
+            if (IsMouseButtonDown(MOUSE_BUTTON_LEFT) &&
+                (drag.x != 0.0f || drag.y != 0.0f)) {
+                camera.target = Vector2Subtract(
+                    camera.target, Vector2Scale(drag, 1.0f / camera.zoom));
+                view_changed = GetTime();
+                view_synced = false;
+            }
+            if (IsKeyPressed(KEY_R)) {
+                camera.target = (Vector2){0.0f, 0.0f};
+                camera.offset = (Vector2){0.0f, 0.0f};
+                camera.zoom = ZOOM;
+                view_changed = GetTime();
+                view_synced = false;
+            }
+            w = GetScreenWidth();
+            Log(TRACE, "Screen width: %f\n", w);
+            h = GetScreenHeight();
+            Log(TRACE, "Screen height: %f\n", h);
+            if (ROI_FOLLOW && !view_synced && GetTime() - view_changed > 0.25) {
+                Vector2 top_left = GetScreenToWorld2D((Vector2){0, 0}, camera);
+                Vector2 bottom_right =
+                    GetScreenToWorld2D((Vector2){w, h}, camera);
+                for (int i = 0; i < stream_count; ++i) {
+                    float x = (i % grid_cols) * tile_w;
+                    float y = (i / grid_cols) * tile_h;
+                    Rectangle visible = {
+                        .x = top_left.x - x,
+                        .y = top_left.y - y,
+                        .width = bottom_right.x - top_left.x,
+                        .height = bottom_right.y - top_left.y,
+                    };
+                    StreamFollowView(&STREAMS[i], visible);
+                }
+                view_synced = true;
+            }
+        }
         // camera.offset.x = -w / 2.0f;
         // camera.offset.y = -h / 2.0f;
 
-        asprintf(&log_msg, "Acquiring image...\n");
-        Log(TRACE, log_msg);
-        status = xiGetImage(handle, 10000, &image);
-        if (status != XI_OK) {
-            printf("Failed to get image on camera 0\n");
-            return 1;
+        // The benchmark renders only when some stream has a fresh frame, so
+        // it blocks here
+        uint64_t wait_t0 = NowNs();
+        const Frame* frames[MAX_STREAMS];
+        bool fresh = false;
+        bool failed = false;
+        for (;;) {
+            for (int i = 0; i < stream_count; ++i) {
+                frames[i] = StreamPoll(&STREAMS[i]);
+                fresh = fresh || frames[i] != NULL;
+                failed = failed || atomic_load(&STREAMS[i].capture.failed);
+            }
+            if (BENCH_FRAMES == 0 || fresh || failed || QUIT) {
+                break;
+            }
+            SleepUntilNs(NowNs() + 50000);
         }
-        asprintf(&log_msg, "Image acquired!\n");
-        Log(TRACE, log_msg);
-        unsigned char* pixels = (unsigned char*)image.bp;
-        rl_img.data = pixels;
-        if (got_first) {
-            asprintf(&log_msg, "Updating texture...\n");
-            Log(TRACE, log_msg);
-            UpdateTexture(texture, pixels);
-            asprintf(&log_msg, "Texture updated\n");
-            Log(TRACE, log_msg);
-        } else {
-            asprintf(&log_msg, "Loading texture...\n");
-            Log(TRACE, log_msg);
-            texture = LoadTextureFromImage(rl_img);
-            got_first = true;
-            asprintf(&log_msg, "Texture loaded\n");
-            Log(TRACE, log_msg);
+        if (BENCH_FRAMES > 0 && fresh) {
+            if (bench_shown == 0) {
+                // The first frame absorbs startup and texture creation
+                bench_start_ns = NowNs();
+                for (int i = 0; i < stream_count; ++i) {
+                    Capture* cap = &STREAMS[i].capture;
+                    bench_start_frames[i] = atomic_load(&cap->frames);
+                    bench_start_skipped[i] = atomic_load(&cap->handoff.skipped);
+                    bench_start_lent[i] = atomic_load(&cap->lent_bytes);
+                }
+            } else {
+                HistogramRecord(&wait_hist, NowNs() - wait_t0);
+            }
+        }
+        if (STATS_PERIOD > 0.0 &&
+            NowNs() - stats_time_ns >= (uint64_t)(STATS_PERIOD * 1e9)) {
+            for (int i = 0; i < stream_count; ++i) {
+                CaptureHealth stats = CaptureGetHealth(&STREAMS[i].capture);
+                LogHealth(STREAMS[i].cam_id, &stats);
+            }
+            stats_time_ns = NowNs();
+        }
+        if (failed) {
+            for (int i = 0; i < stream_count; ++i) {
+                if (atomic_load(&STREAMS[i].capture.failed)) {
+                    printf(
+                        "Failed to get image on camera %d\n",
+                        STREAMS[i].cam_id);
+                }
+            }
+            exit_code = 1;
+            break;
+        }
+        for (int i = 0; i < stream_count; ++i) {
+            if (frames[i] != NULL) {
+                StreamUpload(&STREAMS[i], frames[i]);
+            }
         }
 
-        asprintf(&log_msg, "Starting drawing...\n");
-        Log(TRACE, log_msg);
-        BeginDrawing();
-        BeginMode2D(camera);
-        {
+        if (has_gl) {
+            Log(TRACE, "Starting drawing...\n");
+            TraceBegin("draw");
+            uint64_t draw_t0 = NowNs();
+            BeginDrawing();
+            BeginMode2D(camera);
             ClearBackground(BACKGROUND_COLOR);
-            DrawTexture(texture, 0, 0, WHITE);
-            char* fps_msg;
-            int fps = GetFPS();
-            asprintf(&fps_msg, "FPS: %d", fps);
-            int adj_font_size = FONT_SIZE / ZOOM;
-            DrawText("Graphics: Raylib", 20, 20, adj_font_size, LIGHTGRAY);
-            DrawText(fps_msg, 20, 20 + adj_font_size, adj_font_size, LIGHTGRAY);
+            for (int i = 0; i < stream_count; ++i) {
+                StreamDraw(
+                    &STREAMS[i],
+                    (i % grid_cols) * tile_w,
+                    (i / grid_cols) * tile_h);
+            }
+            EndMode2D();
+            // The overlay is drawn in screen space at each tile's corner, or
+            // the window edge, so it stays legible however the view moves
+            {
+                double now = GetTime();
+                bool roll = now - cap_fps_time >= 1.0;
+                int font_size = FONT_SIZE;
+                for (int i = 0; i < stream_count; ++i) {
+                    Stream* st = &STREAMS[i];
+                    Vector2 corner = GetWorldToScreen2D(
+                        (Vector2){
+                            (i % grid_cols) * tile_w,
+                            (i / grid_cols) * tile_h,
+                        },
+                        camera);
+                    int x = corner.x > 0.0f ? (int)corner.x : 0;
+                    int y = corner.y > 0.0f ? (int)corner.y : 0;
+                    if (roll) {
+                        uint64_t frames = atomic_load(&st->capture.frames);
+                        cap_fps[i] =
+                            (frames - cap_fps_frames[i]) / (now - cap_fps_time);
+                        cap_fps_frames[i] = frames;
+                        uint64_t lent = atomic_load(&st->capture.lent_bytes);
+                        lent_gbs[i] =
+                            (lent - lent_bytes[i]) / 1e9 / (now - cap_fps_time);
+                        lent_bytes[i] = lent;
+                        if (st->upload_window_count > 0) {
+                            upload_avg_ms[i] = st->upload_window_ns / 1e6 /
+                                               st->upload_window_count;
+                        }
+                        st->upload_window_ns = 0;
+                        st->upload_window_count = 0;
+                        health[i] = CaptureGetHealth(&st->capture);
+                    }
+                    // Tiles along the top leave room for the window-wide lines
+                    int line_y = y + 20;
+                    if (y < 2 * font_size) {
+                        line_y += 2 * font_size;
+                    }
+                    // TextFormat() formats into raylib's static ring of
+                    // buffers
+                    int link = atomic_load(&st->source.bandwidth_mbps);
+                    const char* cap_msg =
+                        link > 0 ? TextFormat(
+                                       "Camera %d FPS: %.1f, link %d Mbit/s",
+                                       st->cam_id,
+                                       cap_fps[i],
+                                       link)
+                                 : TextFormat(
+                                       "Camera %d FPS: %.1f",
+                                       st->cam_id,
+                                       cap_fps[i]);
+                    DrawText(
+                        cap_msg, x + 20, line_y, font_size, LIGHTGRAY);
+                    const char* upload_msg = TextFormat(
+                        "Upload (%s): %.2f ms",
+                        st->pbo_ready ? "pbo" : "sync",
+                        upload_avg_ms[i]);
+                    DrawText(
+                        upload_msg,
+                        x + 20,
+                        line_y + font_size,
+                        font_size,
+                        LIGHTGRAY);
+                    const char* sensor_msg = TextFormat(
+                        "Sensor: %.2f ms, jitter %.3f ms, dropped %lu (+%lu)",
+                        health[i].interval_us / 1e3,
+                        health[i].jitter_us / 1e3,
+                        health[i].dropped,
+                        health[i].window_dropped);
+                    DrawText(
+                        sensor_msg,
+                        x + 20,
+                        line_y + 2 * font_size,
+                        font_size,
+                        health[i].window_dropped > 0 ? RED : LIGHTGRAY);
+                    if (st->recording) {
+                        Recorder* rec = &st->recorder;
+                        uint64_t rec_dropped = atomic_load(&rec->dropped);
+                        const char* record_msg = TextFormat(
+                            "Record: %lu written, %lu dropped, %d queued",
+                            atomic_load(&rec->written),
+                            rec_dropped,
+                            atomic_load(&rec->inflight));
+                        DrawText(
+                            record_msg,
+                            x + 20,
+                            line_y + 3 * font_size,
+                            font_size,
+                            rec_dropped > 0 ? RED : LIGHTGRAY);
+                    }
+                    if (st->pretriggering) {
+                        PreTrigger* pt = &st->pretrigger;
+                        bool saving =
+                            atomic_load(&pt->state) != PRETRIGGER_IDLE;
+                        uint64_t pending = atomic_load(&pt->head) -
+                                           atomic_load(&pt->cursor);
+                        const char* trigger_msg = TextFormat(
+                            "Pre-trigger: %s, %u saved, %lu lost",
+                            saving ? TextFormat("saving, %lu behind", pending)
+                                   : "armed (T)",
+                            atomic_load(&pt->triggers),
+                            atomic_load(&pt->lost));
+                        DrawText(
+                            trigger_msg,
+                            x + 20,
+                            line_y + 4 * font_size,
+                            font_size,
+                            saving ? ORANGE : LIGHTGRAY);
+                    }
+                    if (ZERO_COPY) {
+                        Capture* cap = &st->capture;
+                        const char* lent_msg = TextFormat(
+                            "Zero-copy: %.2f GB/s not copied, %lu revoked, "
+                            "%.1f ms waited",
+                            lent_gbs[i],
+                            atomic_load(&cap->revoked),
+                            atomic_load(&cap->lease_wait_ns) / 1e6);
+                        DrawText(
+                            lent_msg,
+                            x + 20,
+                            line_y + 5 * font_size,
+                            font_size,
+                            LIGHTGRAY);
+                    }
+                    if (st->auto_exposing) {
+                        AutoExposure* ae = &st->auto_exposure;
+                        const char* ae_msg = TextFormat(
+                            "Auto exposure: %.2f ms, %.1f dB, luma %d of %.0f",
+                            atomic_load(&ae->shown_exposure_us) / 1e3,
+                            atomic_load(&ae->shown_gain_cdb) / 100.0,
+                            atomic_load(&ae->shown_luma),
+                            ae->cfg.target);
+                        DrawText(
+                            ae_msg,
+                            x + 20,
+                            line_y + 6 * font_size,
+                            font_size,
+                            LIGHTGRAY);
+                    }
+                    if (st->auto_white_balance) {
+                        const char* wb_msg = TextFormat(
+                            "White balance: R %.2f, G %.2f, B %.2f (%s)",
+                            st->wb_kr,
+                            st->wb_kg,
+                            st->wb_kb,
+                            st->awb.method == AWB_WHITE_PATCH ? "white patch"
+                                                              : "gray world");
+                        DrawText(
+                            wb_msg,
+                            x + 20,
+                            line_y + 7 * font_size,
+                            font_size,
+                            LIGHTGRAY);
+                    }
+                    if (st->focus_ready) {
+                        const char* focus_msg = TextFormat(
+                            "Focus: %.1f%s",
+                            st->sharpness.score,
+                            st->focus_peaking ? ", peaking" : "");
+                        DrawText(
+                            focus_msg,
+                            x + 20,
+                            line_y + 8 * font_size,
+                            font_size,
+                            LIGHTGRAY);
+                    }
+                    if (st->calibrating) {
+                        Calibrator* cb = &st->calibrator;
+                        int progress = atomic_load(&cb->progress);
+                        uint64_t corrected = atomic_load(&cb->corrected);
+                        unsigned refs = atomic_load(&cb->references);
+                        const char* cal_msg =
+                            progress >= 0
+                                ? TextFormat(
+                                      "Calibration: averaging %d of %d",
+                                      progress,
+                                      cb->frames)
+                                : TextFormat(
+                                      "Calibration set %u: %s%s, %.2f ms "
+                                      "per frame",
+                                      atomic_load(&cb->version),
+                                      refs & RECORDING_DARK ? "dark"
+                                                            : "no dark",
+                                      refs & RECORDING_FLAT ? ", flat"
+                                                            : ", no flat",
+                                      corrected > 0
+                                          ? atomic_load(&cb->correct_ns) /
+                                                1e6 / corrected
+                                          : 0.0);
+                        DrawText(
+                            cal_msg,
+                            x + 20,
+                            line_y + 9 * font_size,
+                            font_size,
+                            LIGHTGRAY);
+                    }
+                    if (st->stats_running && st->stats_worker.histogram) {
+                        DrawImageStats(
+                            &st->image_stats,
+                            x + 20,
+                            line_y + 10 * font_size + 4,
+                            font_size);
+                    }
+                }
+                if (roll) {
+                    cap_fps_time = now;
+                }
+                int fps = GetFPS();
+                const char* fps_msg = TextFormat("FPS: %d", fps);
+                DrawText("Graphics: Raylib", 20, 20, font_size, LIGHTGRAY);
+                DrawText(
+                    fps_msg, 20, 20 + font_size, font_size, LIGHTGRAY);
+            }
+            // EndMode2D flushed the tiles, so this includes their GL
+            // submission; the overlay text goes out with EndDrawing
+            uint64_t present_t0 = NowNs();
+            TraceEnd("draw");
+            // Swap plus SetTargetFPS pacing
+            TraceBegin("present");
+            EndDrawing();
+            TraceEnd("present");
+            if (fresh) {
+                HistogramRecord(&draw_hist, present_t0 - draw_t0);
+                HistogramRecord(&present_hist, NowNs() - present_t0);
+            }
+        }
+        if (BENCH_FRAMES > 0 && fresh && ++bench_shown >= BENCH_FRAMES) {
+            break;
+        }
+    }
+    uint64_t loop_end_ns = NowNs();
+    uint64_t produced[MAX_STREAMS];
+    uint64_t dropped[MAX_STREAMS];
+    uint64_t lent[MAX_STREAMS];
+    for (int i = 0; i < stream_count; ++i) {
+        Capture* cap = &STREAMS[i].capture;
+        produced[i] = atomic_load(&cap->frames) - bench_start_frames[i];
+        dropped[i] =
+            atomic_load(&cap->handoff.skipped) - bench_start_skipped[i];
+        lent[i] = atomic_load(&cap->lent_bytes) - bench_start_lent[i];
+        // Joining the capture thread publishes the final health totals
+        StreamStop(&STREAMS[i]);
+        health[i] = cap->health;
+        LogHealth(STREAMS[i].cam_id, &health[i]);
+        const Histogram* upload = &STREAMS[i].upload_hist;
+        if (upload->count > 0) {
+            Log(INFO,
+                "Camera %d texture upload (%s): avg %.3f ms, max %.3f ms over "
+                "%lu frames\n",
+                STREAMS[i].cam_id,
+                STREAMS[i].pbo_ready ? "pbo" : "sync",
+                HistogramMean(upload) / 1e6,
+                upload->max / 1e6,
+                upload->count);
+        }
+    }
+    if (BENCH_FRAMES > 0 && bench_shown > 1) {
+        double elapsed = (loop_end_ns - bench_start_ns) / 1e9;
+        const Stream* first = &STREAMS[0];
+        printf(
+            "Benchmark: %lu frames from %d %s source(s) %dx%d, %s, %s "
+            "upload\n",
+            bench_shown,
+            stream_count,
+            first->source.name,
+            first->source.width,
+            first->source.height,
+            first->shader_debayer ? "gpu debayer"
+            : first->cpu_debayer  ? "cpu demosaic"
+                                  : "no debayer",
+            !has_gl ? "no" : first->pbo_ready ? "pbo" : "sync");
+        printf(
+            "  %-16s %9s %9s %9s %9s\n",
+            "stage (ms)",
+            "min",
+            "p50",
+            "p99",
+            "max");
+        HistogramPrintRow("acquire wait", &wait_hist);
+        for (int i = 0; i < stream_count; ++i) {
+            char label[32];
+            snprintf(label, sizeof(label), "convert cam %d", STREAMS[i].cam_id);
+            HistogramPrintRow(label, &STREAMS[i].convert_hist);
+            snprintf(label, sizeof(label), "upload cam %d", STREAMS[i].cam_id);
+            HistogramPrintRow(label, &STREAMS[i].upload_hist);
+            if (STREAMS[i].stats_running) {
+                snprintf(
+                    label, sizeof(label), "sample cam %d", STREAMS[i].cam_id);
+                HistogramPrintRow(label, &STREAMS[i].stats_hist);
+            }
+            if (STREAMS[i].focus_ready) {
+                snprintf(
+                    label, sizeof(label), "focus cam %d", STREAMS[i].cam_id);
+                HistogramPrintRow(label, &STREAMS[i].focus_hist);
+            }
+        }
+        HistogramPrintRow("draw", &draw_hist);
+        HistogramPrintRow("present", &present_hist);
+        printf("  achieved %.1f fps\n", (bench_shown - 1) / elapsed);
+        for (int i = 0; i < stream_count; ++i) {
+            printf(
+                "  camera %d: source %.1f fps, %lu of %lu frames never "
+                "displayed, sensor dropped %lu in %lu gaps, jitter %.3f ms\n",
+                STREAMS[i].cam_id,
+                produced[i] / elapsed,
+                dropped[i],
+                produced[i],
+                health[i].dropped,
+                health[i].gaps,
+                health[i].jitter_us / 1e3);
+            const Recorder* rec = &STREAMS[i].recorder;
+            if (STREAMS[i].recording) {
+                uint64_t stalls = atomic_load(&rec->stalls);
+                printf(
+                    "  camera %d record: %lu written, %lu dropped, %lu "
+                    "stalls (avg %.3f ms), peak queue %d of %d\n",
+                    STREAMS[i].cam_id,
+                    atomic_load(&rec->written),
+                    atomic_load(&rec->dropped),
+                    stalls,
+                    stalls > 0 ? atomic_load(&rec->stall_ns) / 1e6 / stalls
+                               : 0.0,
+                    rec->inflight_max,
+                    rec->depth);
+            }
+            if (ZERO_COPY) {
+                const Capture* cap = &STREAMS[i].capture;
+                printf(
+                    "  camera %d zero-copy: %.2f GB/s not copied, %lu "
+                    "revoked, %.3f ms waited for uploads\n",
+                    STREAMS[i].cam_id,
+                    lent[i] / 1e9 / elapsed,
+                    atomic_load(&cap->revoked),
+                    atomic_load(&cap->lease_wait_ns) / 1e6);
+            }
+            if (STREAMS[i].auto_exposing) {
+                const AutoExposure* ae = &STREAMS[i].auto_exposure;
+                uint64_t metered = atomic_load(&ae->metered);
+                printf(
+                    "  camera %d auto exposure: %lu steps, metering avg "
+                    "%.3f ms, settled at %.2f ms %.1f dB, luma %d\n",
+                    STREAMS[i].cam_id,
+                    atomic_load(&ae->steps),
+                    metered > 0 ? atomic_load(&ae->meter_ns) / 1e6 / metered
+                                : 0.0,
+                    atomic_load(&ae->shown_exposure_us) / 1e3,
+                    atomic_load(&ae->shown_gain_cdb) / 100.0,
+                    atomic_load(&ae->shown_luma));
+            }
+            if (STREAMS[i].calibrating) {
+                const Calibrator* cb = &STREAMS[i].calibrator;
+                uint64_t corrected = atomic_load(&cb->corrected);
+                unsigned refs = atomic_load(&cb->references);
+                printf(
+                    "  camera %d calibration: %lu frames corrected (avg "
+                    "%.3f ms), set %u%s%s\n",
+                    STREAMS[i].cam_id,
+                    corrected,
+                    corrected > 0 ? atomic_load(&cb->correct_ns) / 1e6 /
+                                        corrected
+                                  : 0.0,
+                    atomic_load(&cb->version),
+                    refs & RECORDING_DARK ? ", dark" : "",
+                    refs & RECORDING_FLAT ? ", flat" : "");
+            }
+            if (STREAMS[i].focus_ready) {
+                printf(
+                    "  camera %d focus: %lu sharpness readbacks, latest "
+                    "%.1f\n",
+                    STREAMS[i].cam_id,
+                    STREAMS[i].sharpness.scores,
+                    STREAMS[i].sharpness.score);
+            }
+            if (STREAMS[i].auto_white_balance) {
+                const ImageStatsWorker* sw = &STREAMS[i].stats_worker;
+                uint64_t estimates = atomic_load(&sw->awb_estimates);
+                printf(
+                    "  camera %d white balance: %lu estimates (avg %.3f ms), "
+                    "%lu steps, settled at R %.3f G %.3f B %.3f\n",
+                    STREAMS[i].cam_id,
+                    estimates,
+                    estimates > 0 ? atomic_load(&sw->awb_ns) / 1e6 / estimates
+                                  : 0.0,
+                    STREAMS[i].awb_steps,
+                    STREAMS[i].wb_kr,
+                    STREAMS[i].wb_kg,
+                    STREAMS[i].wb_kb);
+            }
+            if (STREAMS[i].stats_running && STREAMS[i].stats_worker.histogram) {
+                const ImageStatsWorker* sw = &STREAMS[i].stats_worker;
+                uint64_t binned = atomic_load(&sw->binned);
+                printf(
+                    "  camera %d histogram: %lu sample sets binned (avg %.3f "
+                    "ms), mean luma %.1f\n",
+                    STREAMS[i].cam_id,
+                    binned,
+                    binned > 0 ? atomic_load(&sw->bin_ns) / 1e6 / binned
+                               : 0.0,
+                    STREAMS[i].image_stats.mean_luma);
+            }
+        }
+    }
+    for (int i = 0; i < stream_count; ++i) {
+        StreamClose(&STREAMS[i]);
+    }
+    if (has_gl) {
+        CloseWindow();
+    }
+    if (TRACE_PATH != NULL) {
+        Log(INFO, "Writing trace to %s\n", TRACE_PATH);
+        if (!TraceDump(TRACE_PATH)) {
+            Log(ERROR, "Failed to write trace to %s\n", TRACE_PATH);
         }
-        EndMode2D();
-        EndDrawing();
+        TraceShutdown();
     }
-    xiStopAcquisition(handle);
-    xiCloseDevice(handle);
-    return 0;
+    return exit_code;
 }
@@ -0,0 +1,1526 @@
+// asprintf() for the legacy logging baseline
+#define _GNU_SOURCE
+#include "microbench.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "auto_exposure.h"
+#include "calibration.h"
+#include "clock.h"
+#include "demosaic.h"
+#include "downsample.h"
+#include "frame_pool.h"
+#include "frame_source.h"
+#include "image_stats.h"
+#include "log.h"
+#include "pretrigger.h"
+#include "recorder.h"
+#include "recording.h"
+#include "trace.h"
+#include "triple_buffer.h"
+#include "white_balance.h"
+
+static double ArgF(int argc, char** argv, int i, double fallback) {
+    return i < argc ? atof(argv[i]) : fallback;
+}
+
+// --- triple_buffer ----------------------------------------------------------
+//
+// A synthetic producer publishes frames at a fixed rate while the consumer
+// polls at display rate. Every frame is filled with its sequence number so the
+// consumer can detect torn reads and out-of-order delivery.
+
+typedef struct TripleBufferBench {
+    TripleBuffer tb;
+    double rate_hz;
+    uint64_t end_ns;
+    uint64_t produced;
+    uint64_t max_publish_ns;
+} TripleBufferBench;
+
+static void* TripleBufferProducer(void* arg) {
+    TripleBufferBench* b = arg;
+    uint64_t period_ns = (uint64_t)(1e9 / b->rate_hz);
+    uint64_t next = NowNs();
+    while (next < b->end_ns) {
+        Frame* f = TripleBufferWriteSlot(&b->tb);
+        f->nframe = (uint32_t)b->produced;
+        memset(f->data, (int)(f->nframe & 0xff), f->capacity);
+        f->size = f->capacity;
+        uint64_t t0 = NowNs();
+        TripleBufferPublish(&b->tb);
+        uint64_t dt = NowNs() - t0;
+        if (dt > b->max_publish_ns) {
+            b->max_publish_ns = dt;
+        }
+        b->produced += 1;
+        next += period_ns;
+        SleepUntilNs(next);
+    }
+    return NULL;
+}
+
+static int BenchTripleBuffer(int argc, char** argv) {
+    double producer_hz = ArgF(argc, argv, 0, 150.0);
+    double consumer_hz = ArgF(argc, argv, 1, 60.0);
+    double seconds = ArgF(argc, argv, 2, 5.0);
+    size_t frame_bytes = 1920 * 1080 * 4;
+    printf(
+        "triple_buffer: producer %.1f Hz, consumer %.1f Hz, %.1f s\n",
+        producer_hz,
+        consumer_hz,
+        seconds);
+
+    TripleBufferBench b = {.rate_hz = producer_hz};
+    if (!TripleBufferInit(&b.tb, frame_bytes)) {
+        printf("Failed to allocate triple buffer\n");
+        return 1;
+    }
+    b.end_ns = NowNs() + (uint64_t)(seconds * 1e9);
+    pthread_t producer;
+    pthread_create(&producer, NULL, TripleBufferProducer, &b);
+
+    uint64_t consumed = 0;
+    uint64_t torn = 0;
+    uint64_t reordered = 0;
+    uint64_t max_take_ns = 0;
+    int64_t last = -1;
+    uint64_t period_ns = (uint64_t)(1e9 / consumer_hz);
+    uint64_t next = NowNs();
+    while (next < b.end_ns) {
+        uint64_t t0 = NowNs();
+        const Frame* f = TripleBufferLatest(&b.tb);
+        uint64_t dt = NowNs() - t0;
+        if (dt > max_take_ns) {
+            max_take_ns = dt;
+        }
+        if (f != NULL) {
+            consumed += 1;
+            if ((int64_t)f->nframe <= last) {
+                reordered += 1;
+            }
+            last = f->nframe;
+            unsigned char stamp = f->nframe & 0xff;
+            for (size_t i = 0; i < f->size; i += 4096) {
+                if (f->data[i] != stamp) {
+                    torn += 1;
+                    break;
+                }
+            }
+        }
+        next += period_ns;
+        SleepUntilNs(next);
+    }
+    pthread_join(producer, NULL);
+
+    uint64_t skipped = atomic_load(&b.tb.skipped);
+    printf("  produced     %lu\n", b.produced);
+    printf("  consumed     %lu\n", consumed);
+    printf("  skipped      %lu\n", skipped);
+    printf("  torn         %lu\n", torn);
+    printf("  reordered    %lu\n", reordered);
+    printf("  max publish  %lu ns\n", b.max_publish_ns);
+    printf("  max take     %lu ns\n", max_take_ns);
+    TripleBufferFree(&b.tb);
+    return (torn == 0 && reordered == 0) ? 0 : 1;
+}
+
+// --- demosaic ---------------------------------------------------------------
+//
+// Correctness first: flat fields must come back exactly, every SIMD kernel
+// must be bit-exact with the scalar one, RAW16 must match RAW8 after scaling,
+// and a synthetic scene must reconstruct above a PSNR floor. Then throughput
+// of every kernel the CPU supports on a 4K frame.
+
+static const DemosaicMethod DEMOSAIC_METHODS[] = {
+    DEMOSAIC_BILINEAR,
+    DEMOSAIC_EDGE_AWARE,
+};
+static const char* DEMOSAIC_METHOD_NAMES[] = {"bilinear", "edge-aware"};
+static const BayerPattern BAYER_PATTERNS[] = {
+    BAYER_RGGB,
+    BAYER_BGGR,
+    BAYER_GRBG,
+    BAYER_GBRG,
+};
+
+// Smooth colour gradients with a few hard-edged discs on top
+static void SceneRgb(int x, int y, int w, int h, uint8_t rgb[3]) {
+    rgb[0] = (uint8_t)(255 * x / w);
+    rgb[1] = (uint8_t)(255 * y / h);
+    rgb[2] = (uint8_t)(128 + 100 * sin(x * 0.01) * cos(y * 0.013));
+    for (int i = 0; i < 3; ++i) {
+        int cx = w * (i + 1) / 4;
+        int cy = h / 2;
+        int r = h / 6;
+        if ((x - cx) * (x - cx) + (y - cy) * (y - cy) < r * r) {
+            rgb[0] = i == 0 ? 230 : 20;
+            rgb[1] = i == 1 ? 230 : 20;
+            rgb[2] = i == 2 ? 230 : 20;
+        }
+    }
+}
+
+// Channel sampled at (x, y) for a given pattern
+static int BayerChannel(BayerPattern pattern, int x, int y) {
+    int ox = (pattern == BAYER_BGGR || pattern == BAYER_GRBG) ? 1 : 0;
+    int oy = (pattern == BAYER_BGGR || pattern == BAYER_GBRG) ? 1 : 0;
+    int qx = (x + ox) & 1;
+    int qy = (y + oy) & 1;
+    if (qx == 0 && qy == 0) {
+        return 0;
+    }
+    if (qx == 1 && qy == 1) {
+        return 2;
+    }
+    return 1;
+}
+
+static void MosaicScene(Frame* f, uint8_t* truth, const uint8_t* flat) {
+    for (int y = 0; y < f->height; ++y) {
+        for (int x = 0; x < f->width; ++x) {
+            uint8_t rgb[3];
+            if (flat != NULL) {
+                memcpy(rgb, flat, 3);
+            } else {
+                SceneRgb(x, y, f->width, f->height, rgb);
+            }
+            if (truth != NULL) {
+                memcpy(truth + 3 * ((size_t)y * f->width + x), rgb, 3);
+            }
+            uint8_t v = rgb[BayerChannel(f->pattern, x, y)];
+            size_t i = (size_t)y * f->width + x;
+            if (f->format == FRAME_RAW16) {
+                // 12-bit samples with noise in the bits that get shifted out
+                ((uint16_t*)f->data)[i] = (uint16_t)((v << 4) | (i & 0xf));
+            } else {
+                f->data[i] = v;
+            }
+        }
+    }
+}
+
+static Frame AllocBayer(int w, int h, FrameFormat format, BayerPattern p) {
+    Frame f = {
+        .width = w,
+        .height = h,
+        .format = format,
+        .pattern = p,
+        .bit_depth = format == FRAME_RAW16 ? 12 : 8,
+    };
+    f.capacity = (size_t)w * h * FrameBytesPerPixel(format);
+    f.size = f.capacity;
+    f.data = malloc(f.capacity);
+    return f;
+}
+
+static double Psnr(const uint8_t* rgba, const uint8_t* truth, int w, int h) {
+    double se = 0.0;
+    size_t n = 0;
+    // Skip a 2-pixel border where mirroring dominates
+    for (int y = 2; y < h - 2; ++y) {
+        for (int x = 2; x < w - 2; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                double d = (double)rgba[4 * ((size_t)y * w + x) + c] -
+                           truth[3 * ((size_t)y * w + x) + c];
+                se += d * d;
+                n += 1;
+            }
+        }
+    }
+    return se == 0.0 ? 99.0 : 10.0 * log10(255.0 * 255.0 / (se / n));
+}
+
+static int CheckDemosaic(void) {
+    int failures = 0;
+    DemosaicIsa best = DemosaicBestIsa();
+    static const int sizes[][2] = {{2, 2}, {17, 5}, {101, 67}, {1024, 64}};
+    for (size_t si = 0; si < sizeof(sizes) / sizeof(sizes[0]); ++si) {
+        int w = sizes[si][0];
+        int h = sizes[si][1];
+        uint8_t* expect = malloc((size_t)w * h * 4);
+        uint8_t* got = malloc((size_t)w * h * 4);
+        for (int pi = 0; pi < 4; ++pi) {
+            for (int mi = 0; mi < 2; ++mi) {
+                DemosaicMethod method = DEMOSAIC_METHODS[mi];
+                Frame f = AllocBayer(w, h, FRAME_RAW8, BAYER_PATTERNS[pi]);
+
+                // Flat field
+                const uint8_t flat[3] = {200, 100, 50};
+                MosaicScene(&f, NULL, flat);
+                Demosaic(&f, method, got);
+                for (size_t i = 0; i < (size_t)w * h; ++i) {
+                    if (memcmp(got + 4 * i, flat, 3) != 0) {
+                        printf("  FAIL flat %dx%d pattern %d %s\n",
+                               w, h, pi, DEMOSAIC_METHOD_NAMES[mi]);
+                        failures += 1;
+                        break;
+                    }
+                }
+
+                // SIMD vs scalar on noise
+                for (size_t i = 0; i < f.size; ++i) {
+                    f.data[i] = (uint8_t)(rand() & 0xff);
+                }
+                DemosaicWithIsa(&f, method, DEMOSAIC_SCALAR, expect);
+                for (int isa = DEMOSAIC_SSE41; isa <= (int)best; ++isa) {
+                    DemosaicWithIsa(&f, method, isa, got);
+                    if (memcmp(expect, got, (size_t)w * h * 4) != 0) {
+                        printf("  FAIL %s != scalar %dx%d pattern %d %s\n",
+                               DemosaicIsaName(isa), w, h, pi,
+                               DEMOSAIC_METHOD_NAMES[mi]);
+                        failures += 1;
+                    }
+                }
+
+                // RAW16 narrows to the same result as RAW8
+                Frame f16 = AllocBayer(w, h, FRAME_RAW16, BAYER_PATTERNS[pi]);
+                MosaicScene(&f, NULL, NULL);
+                MosaicScene(&f16, NULL, NULL);
+                Demosaic(&f, method, expect);
+                Demosaic(&f16, method, got);
+                if (memcmp(expect, got, (size_t)w * h * 4) != 0) {
+                    printf("  FAIL raw16 != raw8 %dx%d pattern %d %s\n",
+                           w, h, pi, DEMOSAIC_METHOD_NAMES[mi]);
+                    failures += 1;
+                }
+                free(f.data);
+                free(f16.data);
+            }
+        }
+        free(expect);
+        free(got);
+    }
+
+    // Reconstruction quality on the synthetic scene
+    int w = 640;
+    int h = 480;
+    Frame f = AllocBayer(w, h, FRAME_RAW8, BAYER_RGGB);
+    uint8_t* truth = malloc((size_t)w * h * 3);
+    uint8_t* got = malloc((size_t)w * h * 4);
+    MosaicScene(&f, truth, NULL);
+    for (int mi = 0; mi < 2; ++mi) {
+        Demosaic(&f, DEMOSAIC_METHODS[mi], got);
+        double psnr = Psnr(got, truth, w, h);
+        printf("  %-10s PSNR %.2f dB\n", DEMOSAIC_METHOD_NAMES[mi], psnr);
+        if (psnr < 25.0) {
+            printf("  FAIL %s PSNR below 25 dB\n", DEMOSAIC_METHOD_NAMES[mi]);
+            failures += 1;
+        }
+    }
+    free(f.data);
+    free(truth);
+    free(got);
+    return failures;
+}
+
+static int BenchDemosaic(int argc, char** argv) {
+    int iterations = (int)ArgF(argc, argv, 0, 20);
+    printf("demosaic: best kernel %s\n", DemosaicIsaName(DemosaicBestIsa()));
+    int failures = CheckDemosaic();
+    printf("  correctness: %s\n", failures == 0 ? "ok" : "FAILED");
+
+    int w = 3840;
+    int h = 2160;
+    double mpix = (double)w * h / 1e6;
+    uint8_t* rgba = malloc((size_t)w * h * 4);
+    for (int fi = 0; fi < 2; ++fi) {
+        FrameFormat format = fi == 0 ? FRAME_RAW8 : FRAME_RAW16;
+        Frame f = AllocBayer(w, h, format, BAYER_RGGB);
+        MosaicScene(&f, NULL, NULL);
+        for (int mi = 0; mi < 2; ++mi) {
+            double scalar_mps = 0.0;
+            for (int isa = 0; isa <= (int)DemosaicBestIsa(); ++isa) {
+                DemosaicWithIsa(&f, DEMOSAIC_METHODS[mi], isa, rgba);
+                uint64_t t0 = NowNs();
+                for (int i = 0; i < iterations; ++i) {
+                    DemosaicWithIsa(&f, DEMOSAIC_METHODS[mi], isa, rgba);
+                }
+                double s = (NowNs() - t0) / 1e9;
+                double mps = mpix * iterations / s;
+                if (isa == DEMOSAIC_SCALAR) {
+                    scalar_mps = mps;
+                }
+                printf("  %-5s %-10s %-6s %8.1f MP/s  %5.2fx\n",
+                       fi == 0 ? "raw8" : "raw16",
+                       DEMOSAIC_METHOD_NAMES[mi],
+                       DemosaicIsaName(isa),
+                       mps,
+                       mps / scalar_mps);
+            }
+        }
+        free(f.data);
+    }
+    free(rgba);
+    return failures == 0 ? 0 : 1;
+}
+
+// --- downsample -------------------------------------------------------------
+//
+// The preview downsample runs in place on the capture thread. The SIMD path
+// working in place has to match the scalar one reading from a separate
+// buffer, for every format and for widths that leave a scalar tail.
+
+static const FrameFormat DOWNSAMPLE_FORMATS[] = {
+    FRAME_RGB32,
+    FRAME_RAW8,
+    FRAME_RAW16,
+};
+static const char* DOWNSAMPLE_FORMAT_NAMES[] = {"rgb32", "raw8", "raw16"};
+
+static Frame DownsampleSource(int w, int h, FrameFormat format) {
+    Frame f = AllocBayer(
+        w, h, format, format == FRAME_RGB32 ? BAYER_NONE : BAYER_RGGB);
+    f.storage = f.data;
+    uint32_t x = 2463534242u;
+    for (size_t i = 0; i < f.capacity; ++i) {
+        // xorshift32, so neighbouring samples differ
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        f.data[i] = (unsigned char)x;
+    }
+    if (format == FRAME_RAW16) {
+        uint16_t* px = (uint16_t*)f.data;
+        for (size_t i = 0; i < f.capacity / 2; ++i) {
+            px[i] &= 0x0fff;
+        }
+    }
+    return f;
+}
+
+static int CheckDownsample(void) {
+    static const int sizes[][2] = {{8, 8}, {18, 10}, {101, 67}, {1024, 64}};
+    int failures = 0;
+    for (size_t si = 0; si < sizeof(sizes) / sizeof(sizes[0]); ++si) {
+        for (int fi = 0; fi < 3; ++fi) {
+            for (int factor = 2; factor <= 4; factor *= 2) {
+                int w = sizes[si][0];
+                int h = sizes[si][1];
+                FrameFormat format = DOWNSAMPLE_FORMATS[fi];
+                Frame simd = DownsampleSource(w, h, format);
+                Frame scalar = simd;
+                scalar.storage = malloc(simd.capacity);
+                // Scalar first, it reads the pixels the SIMD pass overwrites
+                DownsampleFrameScalar(&scalar, factor);
+                DownsampleFrame(&simd, factor);
+                if (simd.width != scalar.width ||
+                    simd.height != scalar.height ||
+                    simd.size != scalar.size ||
+                    memcmp(simd.data, scalar.data, simd.size) != 0) {
+                    printf(
+                        "  FAIL %s %dx%d /%d: SIMD in place differs\n",
+                        DOWNSAMPLE_FORMAT_NAMES[fi],
+                        w,
+                        h,
+                        factor);
+                    failures += 1;
+                }
+                free(simd.storage);
+                free(scalar.storage);
+            }
+        }
+    }
+    return failures;
+}
+
+static int BenchDownsample(int argc, char** argv) {
+    int iterations = (int)ArgF(argc, argv, 0, 20);
+    int failures = CheckDownsample();
+    printf("downsample:\n");
+    printf("  correctness: %s\n", failures == 0 ? "ok" : "FAILED");
+
+    int w = 3840;
+    int h = 2160;
+    double mpix = (double)w * h / 1e6;
+    for (int fi = 0; fi < 3; ++fi) {
+        Frame src = DownsampleSource(w, h, DOWNSAMPLE_FORMATS[fi]);
+        unsigned char* out = malloc(src.capacity);
+        for (int factor = 2; factor <= 4; factor *= 2) {
+            double scalar_mps = 0.0;
+            // RAW16 has no SIMD kernel
+            int kernels = DOWNSAMPLE_FORMATS[fi] == FRAME_RAW16 ? 1 : 2;
+            for (int simd = 0; simd < kernels; ++simd) {
+                uint64_t elapsed = 0;
+                Frame f;
+                for (int i = 0; i < iterations; ++i) {
+                    // Out of place, like a transient frame from the driver
+                    f = src;
+                    f.storage = out;
+                    uint64_t t0 = NowNs();
+                    if (simd) {
+                        DownsampleFrame(&f, factor);
+                    } else {
+                        DownsampleFrameScalar(&f, factor);
+                    }
+                    elapsed += NowNs() - t0;
+                }
+                double mps = mpix * iterations / (elapsed / 1e9);
+                if (!simd) {
+                    scalar_mps = mps;
+                }
+                printf(
+                    "  %-5s /%d %-6s %8.1f MP/s  %5.2fx  %dx%d\n",
+                    DOWNSAMPLE_FORMAT_NAMES[fi],
+                    factor,
+                    simd ? "simd" : "scalar",
+                    mps,
+                    mps / scalar_mps,
+                    f.width,
+                    f.height);
+            }
+        }
+        free(out);
+        free(src.data);
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+// --- calibration ------------------------------------------------------------
+//
+// Dark and flat correction runs on the capture thread ahead of the recorder.
+// The SIMD path working in place has to match the scalar one, for both
+// formats, tails and ROIs. References averaged from frames of a vignetted,
+// tinted target with a fixed-pattern dark have to flatten a fresh frame of
+// it, and survive a trip through a recording. A reference taken while running
+// has to arrive as a new set without changing the old one, and a pre-trigger
+// recording across the switch has to keep each frame with its own.
+
+static uint32_t Xorshift(uint32_t* x) {
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+static void RandomReferences(Calibration* cal, uint32_t seed) {
+    for (size_t i = 0; i < (size_t)cal->width * cal->height; ++i) {
+        cal->dark[i] = (uint16_t)(Xorshift(&seed) % 64);
+        cal->gain[i] = (uint16_t)(CALIBRATION_GAIN_ONE / 2 +
+                                  Xorshift(&seed) % (2 * CALIBRATION_GAIN_ONE));
+    }
+    cal->has_dark = true;
+    cal->has_flat = true;
+}
+
+static void RandomSamples(Frame* f, int max, uint32_t seed) {
+    size_t n = (size_t)f->width * f->height;
+    for (size_t i = 0; i < n; ++i) {
+        int v = (int)(Xorshift(&seed) % ((uint32_t)max + 1));
+        if (f->format == FRAME_RAW8) {
+            f->data[i] = (uint8_t)v;
+        } else {
+            ((uint16_t*)f->data)[i] = (uint16_t)v;
+        }
+    }
+}
+
+static int CheckCalibrationKernels(void) {
+    // width, height, roi x, roi y, within a reference of width + 7 x height
+    static const int cases[][4] = {
+        {8, 4, 0, 0},
+        {37, 19, 5, 3},
+        {101, 67, 0, 0},
+        {1024, 16, 7, 0},
+    };
+    static const int depths[] = {8, 12, 16};
+    int failures = 0;
+    for (size_t ci = 0; ci < sizeof(cases) / sizeof(cases[0]); ++ci) {
+        for (int di = 0; di < 3; ++di) {
+            int w = cases[ci][0];
+            int h = cases[ci][1];
+            FrameFormat format = depths[di] == 8 ? FRAME_RAW8 : FRAME_RAW16;
+            Calibration cal;
+            CalibrationAlloc(
+                &cal, w + 7, h + cases[ci][3], format, depths[di]);
+            RandomReferences(&cal, 2463534242u + (uint32_t)ci);
+            Frame simd = AllocBayer(w, h, format, BAYER_RGGB);
+            simd.storage = simd.data;
+            simd.roi_x = cases[ci][2];
+            simd.roi_y = cases[ci][3];
+            simd.bit_depth = depths[di];
+            RandomSamples(&simd, (1 << depths[di]) - 1, 88675123u);
+            Frame scalar = simd;
+            scalar.storage = malloc(simd.capacity);
+            // Scalar first, it reads the pixels the SIMD pass overwrites
+            bool ok = CalibrationCorrectScalar(&cal, &scalar) &&
+                      CalibrationCorrect(&cal, &simd);
+            if (!ok || memcmp(simd.data, scalar.data, simd.size) != 0) {
+                printf(
+                    "  FAIL %d-bit %dx%d at %d,%d: SIMD in place differs\n",
+                    depths[di],
+                    w,
+                    h,
+                    simd.roi_x,
+                    simd.roi_y);
+                failures += 1;
+            }
+            free(simd.storage);
+            free(scalar.storage);
+            CalibrationFree(&cal);
+        }
+    }
+    return failures;
+}
+
+// Level of the lit target at (x, y): tinted per Bayer site and darkening
+// toward the corners, plus the sensor's fixed-pattern dark
+static double TargetLevel(int x, int y, int w, int h, double level) {
+    static const double tint[4] = {0.8, 1.0, 1.0, 0.6};
+    double dx = (x - w / 2.0) / (w / 2.0);
+    double dy = (y - h / 2.0) / (h / 2.0);
+    double vignette = 1.0 - 0.3 * (dx * dx + dy * dy);
+    return level * tint[(y & 1) * 2 + (x & 1)] * vignette;
+}
+
+static int DarkLevel(int x, int y) {
+    uint32_t seed = (uint32_t)(y * 7919 + x) | 1u;
+    return 8 + (int)(Xorshift(&seed) % 24);
+}
+
+static void TargetFrame(Frame* f, double level, uint32_t* seed) {
+    uint16_t* px = (uint16_t*)f->data;
+    for (int y = 0; y < f->height; ++y) {
+        for (int x = 0; x < f->width; ++x) {
+            double v = DarkLevel(x, y) +
+                       TargetLevel(x, y, f->width, f->height, level);
+            int noise = (int)(Xorshift(seed) % 9) - 4;
+            px[(size_t)y * f->width + x] = (uint16_t)(v + noise + 0.5);
+        }
+    }
+}
+
+// Worst deviation of any sample from the mean of its Bayer site, relative
+static double SiteSpread(const Frame* f) {
+    const uint16_t* px = (const uint16_t*)f->data;
+    double mean[4] = {0.0, 0.0, 0.0, 0.0};
+    for (int y = 0; y < f->height; ++y) {
+        for (int x = 0; x < f->width; ++x) {
+            mean[(y & 1) * 2 + (x & 1)] += px[(size_t)y * f->width + x];
+        }
+    }
+    for (int s = 0; s < 4; ++s) {
+        mean[s] /= (double)f->width * f->height / 4;
+    }
+    double worst = 0.0;
+    for (int y = 0; y < f->height; ++y) {
+        for (int x = 0; x < f->width; ++x) {
+            double m = mean[(y & 1) * 2 + (x & 1)];
+            double d = fabs(px[(size_t)y * f->width + x] - m) / m;
+            worst = d > worst ? d : worst;
+        }
+    }
+    return worst;
+}
+
+static int CheckCalibrationReferences(const char* path, int frames) {
+    int w = 256;
+    int h = 128;
+    Calibration cal;
+    CalibrationAlloc(&cal, w, h, FRAME_RAW16, 12);
+    uint32_t* sums = malloc((size_t)w * h * sizeof(*sums));
+    Frame f = AllocBayer(w, h, FRAME_RAW16, BAYER_RGGB);
+    f.storage = f.data;
+    uint32_t seed = 2463534242u;
+    for (int kind = CALIBRATION_DARK; kind <= CALIBRATION_FLAT; ++kind) {
+        memset(sums, 0, (size_t)w * h * sizeof(*sums));
+        for (int i = 0; i < frames; ++i) {
+            TargetFrame(&f, kind == CALIBRATION_FLAT ? 3000.0 : 0.0, &seed);
+            const uint16_t* px = (const uint16_t*)f.data;
+            for (size_t p = 0; p < (size_t)w * h; ++p) {
+                sums[p] += px[p];
+            }
+        }
+        CalibrationSetReference(&cal, (CalibrationKind)kind, sums, frames);
+    }
+    free(sums);
+
+    TargetFrame(&f, 1500.0, &seed);
+    double before = SiteSpread(&f);
+    CalibrationCorrect(&cal, &f);
+    double after = SiteSpread(&f);
+    // What is left is the noise of the frame and the references
+    int failures = after < 0.02 ? 0 : 1;
+    printf(
+        "  flat target, %d frames: %.1f%% spread raw, %.2f%% corrected%s\n",
+        frames,
+        before * 100.0,
+        after * 100.0,
+        failures == 0 ? "" : "  FAIL");
+
+    RecordingInfo info = {
+        .width = w,
+        .height = h,
+        .format = FRAME_RAW16,
+        .pattern = BAYER_RGGB,
+        .bit_depth = 12,
+        .frame_bytes = f.size,
+        .calibration = &cal,
+    };
+    Recorder rec;
+    if (!RecorderOpen(&rec, path, &info, 2, true)) {
+        free(f.data);
+        CalibrationFree(&cal);
+        return failures + 1;
+    }
+    RecorderWrite(&rec, &f);
+    RecorderClose(&rec);
+    Recording played;
+    Calibration stored;
+    CalibrationAlloc(&stored, w, h, FRAME_RAW16, 12);
+    size_t plane = (size_t)w * h * sizeof(uint16_t);
+    bool same = RecordingOpen(&played, path);
+    if (same) {
+        Frame first = {0};
+        same = CalibrationLoadRecording(&stored, &played) &&
+               (played.header.calibration & RECORDING_CORRECTED) == 0 &&
+               memcmp(stored.dark, cal.dark, plane) == 0 &&
+               memcmp(stored.gain, cal.gain, plane) == 0 &&
+               RecordingFrame(&played, 0, &first) &&
+               memcmp(first.data, f.data, f.size) == 0;
+        RecordingClose(&played);
+    }
+    if (!same) {
+        printf("  FAIL references or frames differ after a recording\n");
+        failures += 1;
+    }
+    unlink(path);
+    CalibrationFree(&stored);
+    free(f.data);
+    CalibrationFree(&cal);
+    return failures;
+}
+
+// Frames `first` and `second` of a pre-trigger recording split where the
+// references changed, and whether the second file carries `cal`
+static bool CheckSetParts(
+    const char* path, uint64_t first, uint64_t second, const Calibration* cal) {
+    char part[4200];
+    Recording played;
+    snprintf(part, sizeof(part), "%s.1", path);
+    bool ok = RecordingOpen(&played, part);
+    if (ok) {
+        ok = played.frame_count == first && played.header.calibration == 0;
+        RecordingClose(&played);
+    }
+    unlink(part);
+    snprintf(part, sizeof(part), "%s.1.1", path);
+    bool second_ok = RecordingOpen(&played, part);
+    if (second_ok) {
+        Calibration stored;
+        CalibrationAlloc(
+            &stored, cal->width, cal->height, cal->format, cal->bit_depth);
+        size_t plane = (size_t)cal->width * cal->height * sizeof(uint16_t);
+        second_ok = played.frame_count == second &&
+                    CalibrationLoadRecording(&stored, &played) &&
+                    stored.has_dark &&
+                    memcmp(stored.dark, cal->dark, plane) == 0;
+        CalibrationFree(&stored);
+        RecordingClose(&played);
+    }
+    unlink(part);
+    return ok && second_ok;
+}
+
+static int CheckCalibrationSets(const char* path, int frames) {
+    int w = 256;
+    int h = 128;
+    FrameSource src = {
+        .width = w,
+        .height = h,
+        .format = FRAME_RAW16,
+        .bit_depth = 12,
+    };
+    Calibrator c;
+    if (!CalibratorInit(&c, &src, NULL, NULL, frames)) {
+        printf("  FAIL calibrator didn't start\n");
+        return 1;
+    }
+    Frame f = AllocBayer(w, h, FRAME_RAW16, BAYER_RGGB);
+    f.storage = f.data;
+    RecordingInfo info = {
+        .width = w,
+        .height = h,
+        .format = FRAME_RAW16,
+        .pattern = BAYER_RGGB,
+        .bit_depth = 12,
+        .frame_bytes = f.size,
+    };
+    PreTrigger pt;
+    if (!PreTriggerInit(&pt, path, &info, 100.0, 1.0, 0.0, 0, 2)) {
+        free(f.data);
+        CalibratorFree(&c);
+        return 1;
+    }
+    // Capped-lens frames, with a few more once the new set is in effect
+    Calibration* first = c.current;
+    CalibrationRetain(first);
+    CalibratorRequest(&c, CALIBRATION_DARK);
+    uint64_t pushed[2] = {0, 0};
+    uint32_t seed = 88675123u;
+    uint64_t deadline = NowNs() + 5000000000ull;
+    for (uint32_t i = 0; pushed[1] < 4 && NowNs() < deadline; ++i) {
+        TargetFrame(&f, 0.0, &seed);
+        f.nframe = i;
+        f.timestamp_us = (uint64_t)i * 10000;
+        CalibratorAverage(&c, &f);
+        if (pushed[1] == 3) {
+            PreTriggerRequest(&pt);
+        }
+        PreTriggerPush(&pt, &f, c.current);
+        pushed[c.current != first] += 1;
+        SleepUntilNs(NowNs() + 1000000);
+    }
+    // Past the end of the trigger, so the flush stops before it
+    f.timestamp_us += 10000;
+    PreTriggerPush(&pt, &f, c.current);
+    PreTriggerFree(&pt);
+
+    const Calibration* now = c.current;
+    bool switched = now != first && now->version == 2 && now->has_dark &&
+                    first->version == 1 && !first->has_dark;
+    int failures = switched ? 0 : 1;
+    if (!CheckSetParts(path, pushed[0], pushed[1], now)) {
+        failures += 1;
+    }
+    printf(
+        "  new set %u, pre-trigger recording split %lu + %lu: %s\n",
+        now->version,
+        pushed[0],
+        pushed[1],
+        failures == 0 ? "ok" : "FAILED");
+    CalibrationRelease(first);
+    CalibratorFree(&c);
+    free(f.data);
+    return failures;
+}
+
+static int BenchCalibration(int argc, char** argv) {
+    int iterations = (int)ArgF(argc, argv, 0, 20);
+    const char* path =
+        argc > 1 ? argv[1] : "/tmp/xiclops_calibration_bench.raw";
+    printf("calibration:\n");
+    int failures = CheckCalibrationKernels();
+    printf("  kernels: %s\n", failures == 0 ? "ok" : "FAILED");
+    failures += CheckCalibrationReferences(path, 16);
+    failures += CheckCalibrationSets(path, 16);
+
+    int w = 3840;
+    int h = 2160;
+    double mpix = (double)w * h / 1e6;
+    static const int depths[] = {8, 12};
+    for (int di = 0; di < 2; ++di) {
+        FrameFormat format = depths[di] == 8 ? FRAME_RAW8 : FRAME_RAW16;
+        Calibration cal;
+        CalibrationAlloc(&cal, w, h, format, depths[di]);
+        RandomReferences(&cal, 2463534242u);
+        Frame src = AllocBayer(w, h, format, BAYER_RGGB);
+        src.bit_depth = depths[di];
+        RandomSamples(&src, (1 << depths[di]) - 1, 88675123u);
+        unsigned char* out = malloc(src.capacity);
+        double scalar_mps = 0.0;
+        for (int simd = 0; simd < 2; ++simd) {
+            uint64_t elapsed = 0;
+            for (int i = 0; i < iterations; ++i) {
+                // Out of place, like a transient frame from the driver
+                Frame f = src;
+                f.storage = out;
+                uint64_t t0 = NowNs();
+                if (simd) {
+                    CalibrationCorrect(&cal, &f);
+                } else {
+                    CalibrationCorrectScalar(&cal, &f);
+                }
+                elapsed += NowNs() - t0;
+            }
+            double mps = mpix * iterations / (elapsed / 1e9);
+            if (!simd) {
+                scalar_mps = mps;
+            }
+            printf(
+                "  %-5s %-6s %8.1f MP/s  %5.2fx  %.3f ms per %dx%d frame\n",
+                format == FRAME_RAW8 ? "raw8" : "raw16",
+                simd ? "simd" : "scalar",
+                mps,
+                mps / scalar_mps,
+                mpix / mps * 1e3,
+                w,
+                h);
+        }
+        free(out);
+        free(src.data);
+        CalibrationFree(&cal);
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+// --- auto_exposure ----------------------------------------------------------
+//
+// Closes the loop around the synthetic source, whose brightness follows
+// exposure times gain two frames after a change, like a real sensor. Each run
+// starts the scene some stops off and counts frames until the metered mean
+// stays within a tenth of a stop of the target.
+
+#define AE_BENCH_MAX_FRAMES 240
+#define AE_BENCH_HOLD_FRAMES 10
+
+static int ConvergeFrames(
+    FrameSource* src, Frame* frame, AutoExposure* ae, double target) {
+    int settled_at = -1;
+    for (int i = 0; i < AE_BENCH_MAX_FRAMES; ++i) {
+        if (src->next(src, frame, 100) != SOURCE_OK) {
+            return -1;
+        }
+        AutoExposureUpdate(ae, src, frame);
+        if (fabs(log2(ae->luma / target)) < 0.1) {
+            if (settled_at < 0) {
+                settled_at = i;
+            }
+            if (i - settled_at + 1 >= AE_BENCH_HOLD_FRAMES) {
+                return settled_at;
+            }
+        } else {
+            settled_at = -1;
+        }
+    }
+    return -1;
+}
+
+static int BenchAutoExposure(int argc, char** argv) {
+    double target = ArgF(argc, argv, 0, 110.0);
+    int max_frames = (int)ArgF(argc, argv, 1, 60);
+    static const double STOPS[] = {-4.0, -2.0, 2.0, 4.0};
+    static const double DAMPING[] = {0.5, 1.0};
+    printf(
+        "auto_exposure: target %.0f, within %d frames\n", target, max_frames);
+    // Sources are opened per run; keep their log lines out of the table
+    enum LEVEL saved = VERBOSITY;
+    VERBOSITY = WARN;
+    int failures = 0;
+    for (int fi = 0; fi < 3; ++fi) {
+        SourceConfig cfg = {
+            .width = 640,
+            .height = 480,
+            .format = DOWNSAMPLE_FORMATS[fi],
+            .exposure_us = 10000,
+        };
+        for (size_t di = 0; di < sizeof(DAMPING) / sizeof(DAMPING[0]); ++di) {
+            printf(
+                "  %-5s damping %.1f:",
+                DOWNSAMPLE_FORMAT_NAMES[fi],
+                DAMPING[di]);
+            for (size_t si = 0; si < sizeof(STOPS) / sizeof(STOPS[0]); ++si) {
+                FrameSource src;
+                if (!FrameSourceOpenSynthetic(&src, 0, &cfg)) {
+                    return 1;
+                }
+                Frame frame = {.capacity = src.frame_bytes};
+                frame.storage = malloc(src.frame_bytes);
+                // Start the loop `STOPS` off the reference exposure, once
+                // the sensor shows it
+                int exposure = (int)(cfg.exposure_us * exp2(STOPS[si]));
+                float gain = 0.0f;
+                src.set_exposure(&src, &exposure, &gain);
+                do {
+                    src.next(&src, &frame, 100);
+                } while (frame.exposure_us != exposure);
+                AutoExposureConfig ae_cfg = {
+                    .target = target,
+                    .damping = DAMPING[di],
+                    .region_w = 1.0f,
+                    .region_h = 1.0f,
+                    .max_gain_db = 12.0f,
+                };
+                AutoExposure* ae = malloc(sizeof(AutoExposure));
+                AutoExposureInit(ae, &ae_cfg, &src);
+                int frames = ConvergeFrames(&src, &frame, ae, target);
+                bool ok = frames >= 0 && frames <= max_frames;
+                if (frames >= 0) {
+                    printf("  %+.0f stops %3d", STOPS[si], frames);
+                } else {
+                    printf("  %+.0f stops never", STOPS[si]);
+                }
+                printf("%s", ok ? "" : " FAIL");
+                failures += ok ? 0 : 1;
+                free(ae);
+                free(frame.storage);
+                FrameSourceClose(&src);
+            }
+            printf("\n");
+        }
+    }
+    VERBOSITY = saved;
+    printf("  convergence: %s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
+
+// --- awb --------------------------------------------------------------------
+//
+// Closes the white balance loop around a gray scene seen through per-channel
+// gains, like the xiAPI conversion applies them, starting from a strong
+// cast. The scene is neutral, so the loop has to bring the gains back to
+// within AWB_BENCH_TOLERANCE stops of equal, not just stop moving. Counts
+// estimates until the residual correction stays that small, and times the
+// estimator on a full sample set.
+
+#define AWB_BENCH_MAX_STEPS 60
+#define AWB_BENCH_HOLD_STEPS 3
+#define AWB_BENCH_TOLERANCE 0.03
+#define AWB_BENCH_WIDTH 1920
+#define AWB_BENCH_HEIGHT 1080
+
+typedef struct AwbBenchRun {
+    int steps;  // until settled, -1 if never
+    float gains[3];
+    double estimate_ns;
+} AwbBenchRun;
+
+// Gray blocks of many levels with some texture, R = G = B before the gains
+// (kr, kg, kb), which clip like the camera's conversion
+static void RenderGrayScene(Frame* frame, const float gains[3]) {
+    uint8_t lut[3][256];
+    for (int c = 0; c < 3; ++c) {
+        for (int v = 0; v < 256; ++v) {
+            double scaled = v * gains[c] + 0.5;
+            lut[c][v] = scaled > 255.0 ? 255 : (uint8_t)scaled;
+        }
+    }
+    for (int y = 0; y < frame->height; ++y) {
+        uint8_t* row = frame->data + (size_t)y * frame->width * 4;
+        for (int x = 0; x < frame->width; ++x) {
+            int level = 24 + ((x / 64 + 3 * (y / 64)) % 9) * 24 + (x ^ y) % 9;
+            row[4 * x + 0] = lut[2][level];
+            row[4 * x + 1] = lut[1][level];
+            row[4 * x + 2] = lut[0][level];
+            row[4 * x + 3] = 255;
+        }
+    }
+}
+
+static AwbBenchRun ConvergeWhiteBalance(
+    Frame* frame, const AwbConfig* cfg, uint8_t* planes) {
+    AwbBenchRun run = {.steps = -1, .gains = {2.0f, 1.0f, 0.5f}};
+    uint64_t estimate_ns = 0;
+    int estimates = 0;
+    int settled_at = -1;
+    for (int i = 0; i < AWB_BENCH_MAX_STEPS; ++i) {
+        RenderGrayScene(frame, run.gains);
+        uint8_t* r = planes;
+        uint8_t* g = r + IMAGE_STATS_SAMPLES;
+        uint8_t* b = g + IMAGE_STATS_SAMPLES;
+        uint32_t n =
+            ImageStatsGather(frame, NULL, IMAGE_STATS_SAMPLES, r, g, b);
+        float correction[3];
+        uint64_t t0 = NowNs();
+        bool ok = WhiteBalanceEstimate(cfg->method, r, g, b, n, correction);
+        estimate_ns += NowNs() - t0;
+        estimates += 1;
+        if (!ok) {
+            break;
+        }
+        double residual = fmax(
+            fabs(log2(correction[0])), fabs(log2(correction[2])));
+        if (residual < AWB_BENCH_TOLERANCE) {
+            if (settled_at < 0) {
+                settled_at = i;
+            }
+            if (i - settled_at + 1 >= AWB_BENCH_HOLD_STEPS) {
+                run.steps = settled_at;
+                break;
+            }
+        } else {
+            settled_at = -1;
+        }
+        WhiteBalanceStep(cfg, true, correction, run.gains);
+    }
+    run.estimate_ns = estimates > 0 ? (double)estimate_ns / estimates : 0.0;
+    return run;
+}
+
+static int BenchAwb(int argc, char** argv) {
+    int max_steps = (int)ArgF(argc, argv, 0, 20);
+    static const AwbMethod METHODS[] = {AWB_GRAY_WORLD, AWB_WHITE_PATCH};
+    static const char* METHOD_NAMES[] = {"gray world", "white patch"};
+    static const double DAMPING[] = {0.5, 1.0};
+    printf(
+        "awb: %d samples of a gray scene, cast R x2.0 B x0.5, within %d "
+        "estimates\n",
+        IMAGE_STATS_SAMPLES,
+        max_steps);
+    uint8_t* planes = malloc(3 * (size_t)IMAGE_STATS_SAMPLES);
+    Frame frame = {
+        .width = AWB_BENCH_WIDTH,
+        .height = AWB_BENCH_HEIGHT,
+        .format = FRAME_RGB32,
+        .bit_depth = 8,
+    };
+    frame.capacity = (size_t)frame.width * frame.height * 4;
+    frame.size = frame.capacity;
+    frame.storage = malloc(frame.capacity);
+    frame.data = frame.storage;
+    if (planes == NULL || frame.storage == NULL) {
+        free(planes);
+        free(frame.storage);
+        return 1;
+    }
+    int failures = 0;
+    for (size_t mi = 0; mi < sizeof(METHODS) / sizeof(METHODS[0]); ++mi) {
+        for (size_t di = 0; di < sizeof(DAMPING) / sizeof(DAMPING[0]); ++di) {
+            AwbConfig awb = {.method = METHODS[mi], .damping = DAMPING[di]};
+            AwbBenchRun run = ConvergeWhiteBalance(&frame, &awb, planes);
+            // Equal gains are what neutralise a gray scene
+            double off = fmax(
+                fabs(log2(run.gains[0] / run.gains[1])),
+                fabs(log2(run.gains[2] / run.gains[1])));
+            bool neutral = off < AWB_BENCH_TOLERANCE;
+            bool ok = run.steps >= 0 && run.steps <= max_steps && neutral;
+            printf("  %-11s damping %.1f: ", METHOD_NAMES[mi], DAMPING[di]);
+            if (run.steps >= 0) {
+                printf("%3d estimates", run.steps);
+            } else {
+                printf("never settled");
+            }
+            printf(
+                ", gains R %.3f G %.3f B %.3f (%.3f stops off neutral), "
+                "estimate %.3f ms%s\n",
+                run.gains[0],
+                run.gains[1],
+                run.gains[2],
+                off,
+                run.estimate_ns / 1e6,
+                ok ? "" : " FAIL");
+            failures += ok ? 0 : 1;
+        }
+    }
+    free(planes);
+    free(frame.storage);
+    printf("  convergence: %s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
+
+// --- log --------------------------------------------------------------------
+//
+// Per-call cost of a log statement at a level that is filtered at runtime,
+// one that is compiled out, and one that is written (to /dev/null), next to
+// the old asprintf-then-filter pattern.
+
+static double NsPerCall(uint64_t t0, int n) {
+    return (double)(NowNs() - t0) / n;
+}
+
+static int BenchLog(int argc, char** argv) {
+    int n = (int)ArgF(argc, argv, 0, 1000000);
+    FILE* devnull = fopen("/dev/null", "w");
+    if (devnull == NULL) {
+        printf("Failed to open /dev/null\n");
+        return 1;
+    }
+    enum LEVEL saved = VERBOSITY;
+    VERBOSITY = INFO;
+    LogSetOutput(devnull);
+    volatile int frame = 0;
+
+    uint64_t t0 = NowNs();
+    for (int i = 0; i < n; ++i) {
+        char* msg;
+        asprintf(&msg, "Frame %d picked up\n", frame);
+        if (DEBUG <= VERBOSITY) {
+            fputs(msg, devnull);
+        }
+        free(msg);
+    }
+    double legacy = NsPerCall(t0, n);
+
+    t0 = NowNs();
+    for (int i = 0; i < n; ++i) {
+        Log(DEBUG, "Frame %d picked up\n", frame);
+    }
+    double disabled = NsPerCall(t0, n);
+
+    t0 = NowNs();
+    for (int i = 0; i < n; ++i) {
+        Log(TRACE, "Frame %d picked up\n", frame);
+    }
+    double trace = NsPerCall(t0, n);
+
+    t0 = NowNs();
+    for (int i = 0; i < n; ++i) {
+        Log(INFO, "Frame %d picked up\n", frame);
+    }
+    double enabled = NsPerCall(t0, n);
+
+    LogSetOutput(NULL);
+    VERBOSITY = saved;
+    fclose(devnull);
+
+    printf("log: %d calls each, verbosity INFO\n", n);
+    printf("  %-24s %8.1f ns/call\n", "asprintf + filter (old)", legacy);
+    printf("  %-24s %8.1f ns/call\n", "disabled level", disabled);
+    printf(
+        "  %-24s %8.1f ns/call\n",
+        LOG_MAX_LEVEL < TRACE ? "TRACE (compiled out)" : "TRACE (runtime off)",
+        trace);
+    printf("  %-24s %8.1f ns/call\n", "enabled level", enabled);
+    return 0;
+}
+
+// --- trace ------------------------------------------------------------------
+//
+// Cost of recording one trace event, and a dump of the result so the JSON can
+// be checked in Perfetto.
+
+static int BenchTrace(int argc, char** argv) {
+    int n = (int)ArgF(argc, argv, 0, 1000000);
+    const char* path = argc > 1 ? argv[1] : "/tmp/xiclops_trace_bench.json";
+    TraceInit(1 << 16);
+    TraceSetThreadName("bench");
+
+    uint64_t t0 = NowNs();
+    for (int i = 0; i < n; ++i) {
+        TraceBegin("stage");
+        TraceEnd("stage");
+    }
+    double per_event = (double)(NowNs() - t0) / (2.0 * n);
+
+    t0 = NowNs();
+    for (int i = 0; i < n; ++i) {
+        (void)NowNs();
+    }
+    double clock = (double)(NowNs() - t0) / n;
+
+    uint64_t dump_t0 = NowNs();
+    bool ok = TraceDump(path);
+    double dump_ms = (NowNs() - dump_t0) / 1e6;
+    TraceShutdown();
+
+    printf("trace: %d begin/end pairs\n", n);
+    printf("  %-24s %8.1f ns\n", "per event", per_event);
+    printf("  %-24s %8.1f ns\n", "of which clock read", clock);
+    printf("  %-24s %8.1f ms (%s)\n", "dump 64k events", dump_ms, path);
+    return ok ? 0 : 1;
+}
+
+// --- record -----------------------------------------------------------------
+//
+// Sustained recorder throughput: unpaced 4K RGB32 synthetic frames are pushed
+// through the recorder in blocking mode, so the rate is whatever the disk and
+// the queue depth allow. The source alone is timed first to show how much of
+// the budget frame generation takes. The file is then mapped back to check
+// the container and time random access.
+
+static uint64_t Fnv1a(const unsigned char* data, size_t bytes) {
+    uint64_t h = 1469598103934665603ull;
+    for (size_t i = 0; i < bytes; ++i) {
+        h = (h ^ data[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+static int CheckRecording(
+    const char* path, uint64_t written, uint64_t first_hash) {
+    Recording rec;
+    if (!RecordingOpen(&rec, path)) {
+        return 1;
+    }
+    int failures = 0;
+    if (rec.frame_count != written) {
+        printf(
+            "  FAIL index has %lu frames, expected %lu\n",
+            rec.frame_count,
+            written);
+        failures += 1;
+    }
+    Frame frame;
+    uint64_t last_ts = 0;
+    for (uint64_t i = 0; i < rec.frame_count; ++i) {
+        RecordingFrame(&rec, i, &frame);
+        if (frame.timestamp_us < last_ts) {
+            printf("  FAIL timestamps go backwards at frame %lu\n", i);
+            failures += 1;
+            break;
+        }
+        last_ts = frame.timestamp_us;
+    }
+    if (rec.frame_count > 0) {
+        RecordingFrame(&rec, 0, &frame);
+        if (Fnv1a(frame.data, frame.size) != first_hash) {
+            printf("  FAIL first frame differs from what was written\n");
+            failures += 1;
+        }
+        uint64_t mid = rec.frame_count / 2;
+        RecordingFrame(&rec, mid, &frame);
+        uint64_t found = RecordingSeek(&rec, frame.timestamp_us);
+        if (rec.index[found].timestamp_us != frame.timestamp_us) {
+            printf("  FAIL seek to frame %lu landed on %lu\n", mid, found);
+            failures += 1;
+        }
+    }
+
+    // Touch one page of random frames: the cost of a seek is a page fault
+    uint64_t t0 = NowNs();
+    volatile unsigned char sink = 0;
+    int seeks = 1000;
+    for (int i = 0; i < seeks && rec.frame_count > 0; ++i) {
+        uint64_t pick = ((uint64_t)i * 2654435761u) % rec.frame_count;
+        RecordingFrame(&rec, pick, &frame);
+        sink = frame.data[frame.size / 2];
+    }
+    (void)sink;
+    double seek_us = (NowNs() - t0) / 1e3 / seeks;
+    printf("  %-24s %8.3f us\n", "random frame access", seek_us);
+    RecordingClose(&rec);
+    return failures;
+}
+
+static int BenchRecord(int argc, char** argv) {
+    const char* path = argc > 0 ? argv[0] : "/tmp/xiclops_record_bench.raw";
+    int n = (int)ArgF(argc, argv, 1, 300);
+    int depth = (int)ArgF(argc, argv, 2, 8);
+    SourceConfig cfg = {.width = 3840, .height = 2160, .format = FRAME_RGB32};
+    FrameSource src;
+    if (!FrameSourceOpenSynthetic(&src, 0, &cfg)) {
+        return 1;
+    }
+    Frame frame = {
+        .storage = aligned_alloc(RECORDER_ALIGN, src.frame_bytes),
+        .capacity = src.frame_bytes,
+    };
+
+    uint64_t t0 = NowNs();
+    for (int i = 0; i < 30; ++i) {
+        src.next(&src, &frame, 100);
+    }
+    double source_ms = (NowNs() - t0) / 1e6 / 30;
+
+    RecordingInfo info = {
+        .width = src.width,
+        .height = src.height,
+        .format = src.format,
+        .pattern = src.pattern,
+        .bit_depth = src.bit_depth,
+        .frame_bytes = src.frame_bytes,
+    };
+    Recorder rec;
+    if (!RecorderOpen(&rec, path, &info, depth, true)) {
+        free(frame.storage);
+        FrameSourceClose(&src);
+        return 1;
+    }
+    t0 = NowNs();
+    uint64_t max_write_ns = 0;
+    uint64_t first_hash = 0;
+    for (int i = 0; i < n; ++i) {
+        src.next(&src, &frame, 100);
+        if (i == 0) {
+            first_hash = Fnv1a(frame.data, frame.size);
+        }
+        uint64_t w0 = NowNs();
+        RecorderWrite(&rec, &frame);
+        uint64_t dt = NowNs() - w0;
+        if (dt > max_write_ns) {
+            max_write_ns = dt;
+        }
+    }
+    RecorderClose(&rec);
+    double seconds = (NowNs() - t0) / 1e9;
+    free(frame.storage);
+    FrameSourceClose(&src);
+
+    uint64_t written = atomic_load(&rec.written);
+    uint64_t stalls = atomic_load(&rec.stalls);
+    double mb = written * (double)rec.slot_bytes / 1e6;
+    printf(
+        "record: %d frames of %zu bytes, depth %d, %s\n",
+        n,
+        rec.frame_bytes,
+        rec.depth,
+        rec.direct ? "O_DIRECT" : "cached");
+    printf("  %-24s %8.1f MB/s\n", "sustained", mb / seconds);
+    printf("  %-24s %8.1f fps\n", "frames", written / seconds);
+    printf("  %-24s %8.3f ms\n", "source per frame", source_ms);
+    printf("  %-24s %8.3f ms\n", "worst RecorderWrite", max_write_ns / 1e6);
+    printf(
+        "  %-24s %8lu (avg %.3f ms)\n",
+        "stalls",
+        stalls,
+        stalls > 0 ? atomic_load(&rec.stall_ns) / 1e6 / stalls : 0.0);
+    printf("  %-24s %8lu\n", "errors", atomic_load(&rec.errors));
+    int failures = CheckRecording(path, written, first_hash);
+    unlink(path);
+    return written == (uint64_t)n && failures == 0 ? 0 : 1;
+}
+
+// --- pool -------------------------------------------------------------------
+//
+// Frame memory from the heap against the hugepage frame pool. Two access
+// patterns: copying a ring of 4K RGB32 frames the way the capture path does,
+// and a dependent walk touching one cache line per 4 KiB page in random order,
+// where nearly every step is a TLB miss on small pages. Each variant is
+// allocated and faulted in before timing.
+
+typedef struct PoolBuffer {
+    const char* name;
+    unsigned char* data;
+    FramePool pool;  // unused for the malloc baseline
+} PoolBuffer;
+
+static double PoolCopyGbs(
+    unsigned char* ring,
+    int frames,
+    size_t frame_bytes,
+    unsigned char* dst,
+    int passes) {
+    uint64_t t0 = NowNs();
+    for (int p = 0; p < passes; ++p) {
+        for (int i = 0; i < frames; ++i) {
+            memcpy(dst, ring + (size_t)i * frame_bytes, frame_bytes);
+        }
+    }
+    double seconds = (NowNs() - t0) / 1e9;
+    return (double)passes * frames * frame_bytes / 1e9 / seconds;
+}
+
+// Links every page into one random cycle through its first word, then walks
+// it; returns ns per step
+static double PoolPageWalkNs(unsigned char* data, size_t bytes, size_t steps) {
+    size_t pages = bytes / 4096;
+    size_t* order = malloc(pages * sizeof(size_t));
+    if (order == NULL) {
+        return 0.0;
+    }
+    for (size_t i = 0; i < pages; ++i) {
+        order[i] = i;
+    }
+    uint64_t x = 88172645463325252ull;
+    for (size_t i = pages - 1; i > 0; --i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        size_t j = x % (i + 1);
+        size_t t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+    // Vary the line within the page so the walk doesn't alias in the cache
+    for (size_t i = 0; i < pages; ++i) {
+        size_t from = order[i] * 4096 + (order[i] % 64) * 64;
+        size_t next = order[(i + 1) % pages];
+        *(size_t*)(data + from) = next * 4096 + (next % 64) * 64;
+    }
+    free(order);
+
+    size_t at = 0;
+    uint64_t t0 = NowNs();
+    for (size_t i = 0; i < steps; ++i) {
+        at = *(volatile size_t*)(data + at);
+    }
+    return (double)(NowNs() - t0) / steps;
+}
+
+static int BenchPool(int argc, char** argv) {
+    int frames = (int)ArgF(argc, argv, 0, 16);
+    int node = (int)ArgF(argc, argv, 1, -1);
+    size_t frame_bytes = 3840 * 2160 * 4;
+    size_t bytes = (size_t)frames * frame_bytes;
+    int passes = 8;
+    size_t steps = 4u << 20;
+    printf(
+        "pool: %d frames of %zu bytes (%.2f GB), current node %d\n",
+        frames,
+        frame_bytes,
+        bytes / 1e9,
+        NumaCurrentNode());
+
+    unsigned char* dst = malloc(frame_bytes);
+    if (dst == NULL) {
+        return 1;
+    }
+    memset(dst, 0, frame_bytes);
+    PoolBuffer buffers[3] = {{.name = "malloc"}, {.name = "frame pool"}};
+    int count = 2;
+    buffers[0].data = malloc(bytes);
+    if (buffers[0].data != NULL) {
+        memset(buffers[0].data, 1, bytes);
+    }
+    if (FramePoolInit(&buffers[1].pool, frames, frame_bytes)) {
+        buffers[1].data = buffers[1].pool.base;
+    }
+    if (node >= 0) {
+        buffers[2].name = "frame pool, bound";
+        FramePoolSetNode(node);
+        if (FramePoolInit(&buffers[2].pool, frames, frame_bytes)) {
+            buffers[2].data = buffers[2].pool.base;
+        }
+        FramePoolSetNode(-1);
+        count = 3;
+    }
+
+    int failures = 0;
+    printf("  %-24s %10s %10s  %s\n", "", "copy GB/s", "walk ns", "pages");
+    for (int i = 0; i < count; ++i) {
+        PoolBuffer* b = &buffers[i];
+        if (b->data == NULL) {
+            printf("  %-24s allocation failed\n", b->name);
+            failures += 1;
+            continue;
+        }
+        // The pool's slots are padded, so copy out of it the same way
+        size_t stride = i == 0 ? frame_bytes : b->pool.slot_bytes;
+        PoolCopyGbs(b->data, frames, stride, dst, 1);
+        double gbs = PoolCopyGbs(b->data, frames, stride, dst, passes);
+        double walk = PoolPageWalkNs(b->data, bytes, steps);
+        printf(
+            "  %-24s %10.2f %10.1f  %s\n",
+            b->name,
+            gbs,
+            walk,
+            i == 0 ? "heap" : HugeKindName(b->pool.kind));
+    }
+    free(buffers[0].data);
+    FramePoolFree(&buffers[1].pool);
+    FramePoolFree(&buffers[2].pool);
+    free(dst);
+    return failures == 0 ? 0 : 1;
+}
+
+typedef struct Microbench {
+    const char* name;
+    int (*run)(int argc, char** argv);
+    const char* usage;
+} Microbench;
+
+static const Microbench MICROBENCHES[] = {
+    {"triple_buffer",
+     BenchTripleBuffer,
+     "[producer_hz=150] [consumer_hz=60] [seconds=5]"},
+    {"demosaic", BenchDemosaic, "[iterations=20]"},
+    {"downsample", BenchDownsample, "[iterations=20]"},
+    {"calibration", BenchCalibration, "[iterations=20] [path]"},
+    {"auto_exposure", BenchAutoExposure, "[target=110] [max_frames=60]"},
+    {"awb", BenchAwb, "[max_estimates=20]"},
+    {"log", BenchLog, "[calls=1000000]"},
+    {"trace", BenchTrace, "[pairs=1000000] [out.json]"},
+    {"record", BenchRecord, "[path] [frames=300] [depth=8]"},
+    {"pool", BenchPool, "[frames=16] [numa_node=-1]"},
+};
+
+int RunMicrobench(const char* name, int argc, char** argv) {
+    size_t count = sizeof(MICROBENCHES) / sizeof(MICROBENCHES[0]);
+    for (size_t i = 0; i < count; ++i) {
+        if (strcmp(MICROBENCHES[i].name, name) == 0) {
+            return MICROBENCHES[i].run(argc, argv);
+        }
+    }
+    printf("Unknown microbenchmark: %s\n", name);
+    printf("Available:\n");
+    for (size_t i = 0; i < count; ++i) {
+        printf("  %s %s\n", MICROBENCHES[i].name, MICROBENCHES[i].usage);
+    }
+    return 1;
+}
@@ -0,0 +1,9 @@
+#ifndef XICLOPS_MICROBENCH_H
+#define XICLOPS_MICROBENCH_H
+
+// Runs the named microbenchmark with the remaining command line arguments
+// and returns a process exit code. Used for checking pipeline building blocks
+// on machines without a camera attached.
+int RunMicrobench(const char* name, int argc, char** argv);
+
+#endif  // XICLOPS_MICROBENCH_H
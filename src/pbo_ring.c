@@ -0,0 +1,86 @@
+#include "pbo_ring.h"
+
+#include <rlgl.h>
+#include <string.h>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+bool PboRingInit(
+    PboRing* ring, Texture2D texture, size_t frame_bytes, int depth) {
+    memset(ring, 0, sizeof(*ring));
+    if (depth < 2) {
+        depth = 2;
+    } else if (depth > PBO_RING_MAX_DEPTH) {
+        depth = PBO_RING_MAX_DEPTH;
+    }
+    // Buffer objects are untyped, so rlgl's loader works for unpack buffers
+    for (int i = 0; i < depth; ++i) {
+        ring->ids[i] = rlLoadVertexBuffer(NULL, (int)frame_bytes, true);
+        if (ring->ids[i] == 0) {
+            ring->depth = i;
+            PboRingFree(ring);
+            return false;
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    ring->depth = depth;
+    ring->size = frame_bytes;
+    ring->texture = texture;
+    ring->pending = -1;
+    return true;
+}
+
+void PboRingFree(PboRing* ring) {
+    for (int i = 0; i < ring->depth; ++i) {
+        if (ring->fences[i] != NULL) {
+            glDeleteSync(ring->fences[i]);
+        }
+        rlUnloadVertexBuffer(ring->ids[i]);
+    }
+    memset(ring, 0, sizeof(*ring));
+}
+
+void PboRingUpload(PboRing* ring, const void* pixels) {
+    // Copy last call's frame into the texture; with an unpack buffer bound
+    // the data pointer is an offset, so this returns without touching memory
+    if (ring->pending >= 0) {
+        int slot = ring->pending;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->ids[slot]);
+        rlUpdateTexture(
+            ring->texture.id,
+            0,
+            0,
+            ring->texture.width,
+            ring->texture.height,
+            ring->texture.format,
+            (const void*)0);
+        if (ring->fences[slot] != NULL) {
+            glDeleteSync(ring->fences[slot]);
+        }
+        ring->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // Stage the new frame. If the GPU is done with the slot we can skip the
+    // driver's synchronisation entirely, otherwise let it orphan the storage.
+    int slot = ring->next;
+    GLbitfield access = GL_MAP_WRITE_BIT;
+    GLsync fence = ring->fences[slot];
+    if (fence == NULL ||
+        glClientWaitSync(fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+        access |= GL_MAP_UNSYNCHRONIZED_BIT;
+    } else {
+        access |= GL_MAP_INVALIDATE_BUFFER_BIT;
+        ring->busy += 1;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->ids[slot]);
+    void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ring->size, access);
+    if (dst != NULL) {
+        memcpy(dst, pixels, ring->size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        ring->pending = slot;
+        ring->next = (slot + 1) % ring->depth;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
@@ -0,0 +1,34 @@
+#ifndef XICLOPS_PBO_RING_H
+#define XICLOPS_PBO_RING_H
+
+#include <raylib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PBO_RING_MAX_DEPTH 3
+
+// Streams frames into a texture through a ring of pixel unpack buffers. Each
+// upload first kicks off the GPU copy of the frame staged on the previous
+// call, then stages the new frame into the next buffer, so the render thread
+// never waits for glTexSubImage2D to pull from client memory. The texture
+// therefore shows the previous frame.
+typedef struct PboRing {
+    unsigned int ids[PBO_RING_MAX_DEPTH];
+    void* fences[PBO_RING_MAX_DEPTH];  // GLsync of the last copy out of a slot
+    int depth;
+    int next;     // slot the next frame is staged into
+    int pending;  // staged slot not yet copied into the texture, -1 if none
+    size_t size;
+    Texture2D texture;
+    uint64_t busy;  // slots still being read by the GPU when reused
+} PboRing;
+
+// Requires a current GL context (after InitWindow). Depth is clamped to
+// [2, PBO_RING_MAX_DEPTH].
+bool PboRingInit(
+    PboRing* ring, Texture2D texture, size_t frame_bytes, int depth);
+void PboRingFree(PboRing* ring);
+void PboRingUpload(PboRing* ring, const void* pixels);
+
+#endif  // XICLOPS_PBO_RING_H
@@ -0,0 +1,280 @@
+#include "pretrigger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "calibration.h"
+#include "clock.h"
+#include "log.h"
+#include "recorder.h"
+#include "trace.h"
+
+// Used to size the ring when the source can't tell its frame rate
+static const double PRETRIGGER_FALLBACK_HZ = 60.0;
+
+// Writes frames from the cursor to a new file until the flush ends or reaches
+// a frame taken with other references than the first. True in the latter case.
+static bool FlushPart(PreTrigger* pt, const char* path) {
+    Recorder rec;
+    bool opened = false;
+    bool ok = false;
+    bool changed = false;
+    Calibration* cal = NULL;
+    for (;;) {
+        uint64_t cursor = atomic_load(&pt->cursor);
+        uint64_t head = atomic_load_explicit(&pt->head, memory_order_acquire);
+        uint64_t end = atomic_load(&pt->end);
+        if (cursor >= end) {
+            break;
+        }
+        if (cursor >= head) {
+            // Caught up with the camera; the post-trigger frames trickle in
+            SleepUntilNs(NowNs() + 1000000);
+            continue;
+        }
+        // Unflushed slots aren't overwritten, so their sets stay put
+        uint64_t index = cursor % pt->capacity;
+        if (!opened) {
+            cal = pt->sets[index];
+            CalibrationRetain(cal);
+            RecordingInfo info = pt->info;
+            info.calibration = cal;
+            ok = RecorderOpen(&rec, path, &info, pt->record_depth, true);
+            if (!ok) {
+                Log(ERROR, "Pre-trigger recording %s failed to open\n", path);
+            }
+            opened = true;
+        } else if (pt->sets[index] != cal) {
+            changed = true;
+            break;
+        }
+        if (ok) {
+            RecorderWrite(&rec, &pt->meta[index]);
+        }
+        atomic_store_explicit(&pt->cursor, cursor + 1, memory_order_release);
+        atomic_fetch_add(&pt->flushed, 1);
+    }
+    if (ok) {
+        RecorderClose(&rec);
+    }
+    CalibrationRelease(cal);
+    return changed;
+}
+
+static void FlushOne(PreTrigger* pt) {
+    // Room for the base path and any trigger and part numbers, so clip names
+    // can't be cut short into one another
+    char path[sizeof(pt->path) + 2 * sizeof(".4294967295")];
+    unsigned n = atomic_load(&pt->triggers);
+    snprintf(path, sizeof(path), "%s.%u", pt->path, n);
+    uint64_t t0 = NowNs();
+    for (unsigned part = 1; FlushPart(pt, path); ++part) {
+        snprintf(path, sizeof(path), "%s.%u.%u", pt->path, n, part);
+        Log(INFO,
+            "Calibration references changed during pre-trigger recording "
+            "%u, going on in %s\n",
+            n,
+            path);
+    }
+    Log(INFO,
+        "Pre-trigger recording %s done in %.1f s, %lu frames lost so far\n",
+        path,
+        (NowNs() - t0) / 1e9,
+        atomic_load(&pt->lost));
+}
+
+static void* FlushThread(void* arg) {
+    PreTrigger* pt = arg;
+    TraceSetThreadName("pretrigger");
+    FramePoolPinThread();
+    for (;;) {
+        pthread_mutex_lock(&pt->lock);
+        while (atomic_load(&pt->state) == PRETRIGGER_IDLE && !pt->stopping) {
+            pthread_cond_wait(&pt->wake, &pt->lock);
+        }
+        bool stopping = pt->stopping;
+        pthread_mutex_unlock(&pt->lock);
+        if (atomic_load(&pt->state) == PRETRIGGER_IDLE && stopping) {
+            break;
+        }
+        TraceBegin("pretrigger flush");
+        FlushOne(pt);
+        TraceEnd("pretrigger flush");
+        atomic_store(&pt->state, PRETRIGGER_IDLE);
+    }
+    return NULL;
+}
+
+bool PreTriggerInit(
+    PreTrigger* pt,
+    const char* path,
+    const RecordingInfo* info,
+    double rate_hz,
+    double pre_s,
+    double post_s,
+    int gpi,
+    int record_depth) {
+    memset(pt, 0, sizeof(*pt));
+    if (strlen(path) >= sizeof(pt->path)) {
+        Log(ERROR, "Pre-trigger path is too long: %s\n", path);
+        return false;
+    }
+    snprintf(pt->path, sizeof(pt->path), "%s", path);
+    pt->info = *info;
+    pt->info.calibration = NULL;
+    pt->pre_us = (uint64_t)(pre_s * 1e6);
+    pt->post_us = (uint64_t)(post_s * 1e6);
+    pt->gpi_mask = gpi > 0 ? 1u << (gpi - 1) : 0;
+    pt->record_depth = record_depth;
+
+    if (rate_hz <= 0.0) {
+        Log(WARN,
+            "Frame rate unknown, sizing pre-trigger ring for %.0f fps\n",
+            PRETRIGGER_FALLBACK_HZ);
+        rate_hz = PRETRIGGER_FALLBACK_HZ;
+    }
+    // A quarter extra so the flush can lag behind the camera for a while
+    pt->capacity = (uint64_t)(pre_s * rate_hz * 1.25) + 2 * record_depth + 2;
+    bool pooled = FramePoolInit(&pt->ring, pt->capacity, info->frame_bytes);
+    pt->meta = calloc(pt->capacity, sizeof(Frame));
+    pt->sets = calloc(pt->capacity, sizeof(*pt->sets));
+    if (!pooled || pt->meta == NULL || pt->sets == NULL) {
+        Log(ERROR,
+            "Failed to allocate %.2f GB for the pre-trigger ring\n",
+            pt->ring.bytes / 1e9);
+        FramePoolFree(&pt->ring);
+        free(pt->meta);
+        free(pt->sets);
+        return false;
+    }
+    atomic_init(&pt->state, PRETRIGGER_IDLE);
+    atomic_init(&pt->end, UINT64_MAX);
+    pthread_mutex_init(&pt->lock, NULL);
+    pthread_cond_init(&pt->wake, NULL);
+    if (pthread_create(&pt->thread, NULL, FlushThread, pt) != 0) {
+        pthread_cond_destroy(&pt->wake);
+        pthread_mutex_destroy(&pt->lock);
+        FramePoolFree(&pt->ring);
+        free(pt->meta);
+        free(pt->sets);
+        return false;
+    }
+    Log(INFO,
+        "Pre-trigger ring: %lu frames (%.2f GB, %s), %.1f s before and "
+        "%.1f s after each trigger\n",
+        pt->capacity,
+        pt->ring.bytes / 1e9,
+        HugeKindName(pt->ring.kind),
+        pre_s,
+        post_s);
+    return true;
+}
+
+void PreTriggerFree(PreTrigger* pt) {
+    // Cut a flush in progress short at the last frame stored
+    if (atomic_load(&pt->state) == PRETRIGGER_FLUSHING) {
+        atomic_store(&pt->end, atomic_load(&pt->head));
+        atomic_store(&pt->state, PRETRIGGER_DRAINING);
+    }
+    pthread_mutex_lock(&pt->lock);
+    pt->stopping = true;
+    pthread_cond_signal(&pt->wake);
+    pthread_mutex_unlock(&pt->lock);
+    pthread_join(pt->thread, NULL);
+    pthread_cond_destroy(&pt->wake);
+    pthread_mutex_destroy(&pt->lock);
+    FramePoolFree(&pt->ring);
+    free(pt->meta);
+    pt->meta = NULL;
+    for (uint64_t i = 0; i < pt->capacity; ++i) {
+        CalibrationRelease(pt->sets[i]);
+    }
+    free(pt->sets);
+    pt->sets = NULL;
+}
+
+void PreTriggerRequest(PreTrigger* pt) {
+    atomic_store(&pt->requested, true);
+}
+
+static void Trigger(PreTrigger* pt, const Frame* frame, uint64_t head) {
+    // Walk back from the newest stored frame while it is inside the window
+    uint64_t oldest = head > pt->capacity ? head - pt->capacity : 0;
+    uint64_t start = head;
+    while (start > oldest) {
+        const Frame* prev = &pt->meta[(start - 1) % pt->capacity];
+        if (frame->timestamp_us - prev->timestamp_us > pt->pre_us) {
+            break;
+        }
+        start -= 1;
+    }
+    pt->end_ts_us = frame->timestamp_us + pt->post_us;
+    atomic_store(&pt->cursor, start);
+    atomic_store(&pt->end, UINT64_MAX);
+    atomic_fetch_add(&pt->triggers, 1);
+    Log(INFO,
+        "Triggered at frame %u, saving %lu frames from before it\n",
+        frame->nframe,
+        head - start);
+
+    pthread_mutex_lock(&pt->lock);
+    atomic_store(&pt->state, PRETRIGGER_FLUSHING);
+    pthread_cond_signal(&pt->wake);
+    pthread_mutex_unlock(&pt->lock);
+}
+
+void PreTriggerPush(
+    PreTrigger* pt, const Frame* frame, Calibration* calibration) {
+    uint64_t head = atomic_load_explicit(&pt->head, memory_order_relaxed);
+    bool edge = (frame->gpi_level & pt->gpi_mask) != 0 &&
+                (pt->last_gpi & pt->gpi_mask) == 0;
+    pt->last_gpi = frame->gpi_level;
+    bool requested = atomic_exchange(&pt->requested, false);
+    int state = atomic_load(&pt->state);
+    if (edge || requested) {
+        if (state == PRETRIGGER_IDLE) {
+            Trigger(pt, frame, head);
+            state = PRETRIGGER_FLUSHING;
+        } else {
+            Log(INFO, "Trigger ignored, still saving the previous one\n");
+        }
+    }
+    if (state == PRETRIGGER_FLUSHING && frame->timestamp_us > pt->end_ts_us) {
+        atomic_store(&pt->end, head);
+        atomic_store(&pt->state, PRETRIGGER_DRAINING);
+        state = PRETRIGGER_DRAINING;
+    }
+
+    // The slot's previous frame may still be waiting for the flush thread
+    if (state != PRETRIGGER_IDLE && head >= pt->capacity) {
+        uint64_t victim = head - pt->capacity;
+        uint64_t cursor =
+            atomic_load_explicit(&pt->cursor, memory_order_acquire);
+        if (victim >= cursor && victim < atomic_load(&pt->end)) {
+            atomic_fetch_add(&pt->lost, 1);
+            return;
+        }
+    }
+
+    TraceBegin("pretrigger copy");
+    uint64_t index = head % pt->capacity;
+    unsigned char* slot = FramePoolSlot(&pt->ring, index);
+    size_t bytes =
+        frame->size < pt->info.frame_bytes ? frame->size : pt->info.frame_bytes;
+    memcpy(slot, frame->data, bytes);
+    Frame* meta = &pt->meta[index];
+    *meta = *frame;
+    meta->data = slot;
+    meta->storage = slot;
+    meta->capacity = pt->ring.slot_bytes;
+    meta->size = bytes;
+    meta->transient = false;
+    if (pt->sets[index] != calibration) {
+        CalibrationRelease(pt->sets[index]);
+        CalibrationRetain(calibration);
+        pt->sets[index] = calibration;
+    }
+    TraceEnd("pretrigger copy");
+    atomic_store_explicit(&pt->head, head + 1, memory_order_release);
+}
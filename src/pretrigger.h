@@ -0,0 +1,81 @@
+#ifndef XICLOPS_PRETRIGGER_H
+#define XICLOPS_PRETRIGGER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "frame.h"
+#include "frame_pool.h"
+#include "recording.h"
+
+typedef enum PreTriggerState {
+    PRETRIGGER_IDLE,      // ring keeps the last `pre_us` of frames
+    PRETRIGGER_FLUSHING,  // writing the ring, then frames until the end
+    PRETRIGGER_DRAINING,  // end reached, writing what is left
+} PreTriggerState;
+
+// Keeps the most recent frames in a preallocated hugepage ring so a trigger
+// can save what happened before it. On a trigger the frames from the last
+// `pre_us` plus everything up to `post_us` after it go to a new recording,
+// written by a dedicated thread chasing the capture thread around the ring.
+// The capture thread never waits: while flushing it skips frames that would
+// overwrite ones not yet on disk, counting them as lost. Each slot holds the
+// calibration references its frame was taken with; should they change during
+// a recording, it goes on in a new file so every file carries its frames' own.
+typedef struct PreTrigger {
+    char path[4096];  // recordings go to <path>.<trigger number>[.<part>]
+    RecordingInfo info;  // without the references, which come per slot
+    uint64_t pre_us;
+    uint64_t post_us;
+    uint32_t gpi_mask;  // rising edge on this input triggers, 0 for none
+    int record_depth;
+
+    // Ring of `capacity` page-aligned slots, sequence numbered by `head`
+    FramePool ring;
+    uint64_t capacity;
+    Frame* meta;  // per slot: metadata of the frame stored there
+    struct Calibration** sets;  // per slot: its frame's references, held
+    atomic_uint_least64_t head;    // frames stored so far
+    atomic_uint_least64_t cursor;  // next frame the flush thread writes
+    atomic_uint_least64_t end;     // flush stops before this frame
+
+    // Capture thread only
+    uint32_t last_gpi;
+    uint64_t end_ts_us;
+
+    atomic_bool requested;  // trigger from another thread
+    atomic_int state;       // PreTriggerState
+    atomic_uint triggers;   // recordings started
+    atomic_uint_least64_t lost;  // frames skipped to protect unflushed ones
+    atomic_uint_least64_t flushed;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool stopping;  // guarded by lock
+} PreTrigger;
+
+// Sizes the ring for `pre_s` seconds at `rate_hz` with headroom for the flush
+// to fall behind, allocates it and starts the flush thread
+bool PreTriggerInit(
+    PreTrigger* pt,
+    const char* path,
+    const RecordingInfo* info,
+    double rate_hz,
+    double pre_s,
+    double post_s,
+    int gpi,
+    int record_depth);
+// Finishes a flush in progress, then stops the thread and frees the ring
+void PreTriggerFree(PreTrigger* pt);
+
+// Capture thread: stores the frame, holding on to the references it was
+// taken with (NULL for none), and handles GPI and requested triggers
+void PreTriggerPush(
+    PreTrigger* pt, const Frame* frame, struct Calibration* calibration);
+// Any thread: triggers on the next frame; ignored while already flushing
+void PreTriggerRequest(PreTrigger* pt);
+
+#endif  // XICLOPS_PRETRIGGER_H
@@ -0,0 +1,351 @@
+// O_DIRECT
+#define _GNU_SOURCE
+#include "recorder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "calibration.h"
+#include "clock.h"
+#include "log.h"
+#include "trace.h"
+
+_Static_assert(
+    RECORDING_HEADER_BYTES % RECORDER_ALIGN == 0,
+    "frames after the header must stay aligned for O_DIRECT");
+_Static_assert(
+    FRAME_POOL_ALIGN == RECORDER_ALIGN,
+    "queue slots are written whole, so they must match the file slots");
+
+// liburing isn't a dependency; the three syscalls and the ring layout are all
+// the recorder needs
+static int IoUringSetup(unsigned entries, struct io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int IoUringEnter(int fd, unsigned submit, unsigned wait) {
+    unsigned flags = wait > 0 ? IORING_ENTER_GETEVENTS : 0;
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+static void* RingMap(int fd, size_t bytes, off_t offset) {
+    void* p = mmap(
+        NULL,
+        bytes,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE,
+        fd,
+        offset);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static void RingUnmap(Recorder* rec) {
+    if (rec->sqes != NULL) {
+        munmap(rec->sqes, rec->sqes_bytes);
+    }
+    if (rec->cq_ring != NULL && rec->cq_ring != rec->sq_ring) {
+        munmap(rec->cq_ring, rec->cq_ring_bytes);
+    }
+    if (rec->sq_ring != NULL) {
+        munmap(rec->sq_ring, rec->sq_ring_bytes);
+    }
+    close(rec->ring_fd);
+    rec->ring_fd = -1;
+}
+
+static bool RingInit(Recorder* rec) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    rec->ring_fd = IoUringSetup(rec->depth, &p);
+    if (rec->ring_fd < 0) {
+        return false;
+    }
+    rec->sq_ring_bytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    rec->cq_ring_bytes =
+        p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && rec->cq_ring_bytes > rec->sq_ring_bytes) {
+        rec->sq_ring_bytes = rec->cq_ring_bytes;
+    }
+    rec->sq_ring =
+        RingMap(rec->ring_fd, rec->sq_ring_bytes, IORING_OFF_SQ_RING);
+    if (rec->sq_ring == NULL) {
+        RingUnmap(rec);
+        return false;
+    }
+    rec->cq_ring = single ? rec->sq_ring
+                          : RingMap(
+                                rec->ring_fd,
+                                rec->cq_ring_bytes,
+                                IORING_OFF_CQ_RING);
+    rec->sqes_bytes = p.sq_entries * sizeof(struct io_uring_sqe);
+    rec->sqes = RingMap(rec->ring_fd, rec->sqes_bytes, IORING_OFF_SQES);
+    if (rec->cq_ring == NULL || rec->sqes == NULL) {
+        RingUnmap(rec);
+        return false;
+    }
+    unsigned char* sq = rec->sq_ring;
+    rec->sq_head = (unsigned*)(sq + p.sq_off.head);
+    rec->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    rec->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    rec->sq_array = (unsigned*)(sq + p.sq_off.array);
+    unsigned char* cq = rec->cq_ring;
+    rec->cq_head = (unsigned*)(cq + p.cq_off.head);
+    rec->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    rec->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    rec->cqes = cq + p.cq_off.cqes;
+    return true;
+}
+
+static void Complete(Recorder* rec, int slot, int res) {
+    if (res != (int)rec->slot_bytes) {
+        if (atomic_fetch_add(&rec->errors, 1) == 0) {
+            Log(ERROR,
+                "Recording write failed: %s\n",
+                res < 0 ? strerror(-res) : "short write");
+        }
+        // Offset 0 is the header, so it marks the entry for RecorderClose()
+        // to leave out
+        rec->index[rec->slot_entry[slot]].offset = 0;
+    } else {
+        atomic_fetch_add(&rec->written, 1);
+    }
+    rec->free_slots[rec->free_count++] = slot;
+    atomic_fetch_sub(&rec->inflight, 1);
+}
+
+// Reaps finished writes, waiting for at least `wait` of them
+static void Reap(Recorder* rec, unsigned wait) {
+    if (wait > 0) {
+        IoUringEnter(rec->ring_fd, 0, wait);
+    }
+    unsigned head = *rec->cq_head;
+    unsigned tail = atomic_load_explicit(
+        (_Atomic unsigned*)rec->cq_tail, memory_order_acquire);
+    struct io_uring_cqe* cqes = rec->cqes;
+    while (head != tail) {
+        struct io_uring_cqe* cqe = &cqes[head & *rec->cq_mask];
+        Complete(rec, (int)cqe->user_data, cqe->res);
+        head += 1;
+    }
+    atomic_store_explicit(
+        (_Atomic unsigned*)rec->cq_head, head, memory_order_release);
+}
+
+static void Submit(Recorder* rec, int slot) {
+    unsigned tail = *rec->sq_tail;
+    unsigned index = tail & *rec->sq_mask;
+    struct io_uring_sqe* sqe = &((struct io_uring_sqe*)rec->sqes)[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = rec->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(rec->buffers + slot * rec->slot_bytes);
+    sqe->len = (unsigned)rec->slot_bytes;
+    sqe->off = rec->offset;
+    sqe->user_data = (uint64_t)slot;
+    rec->sq_array[index] = index;
+    atomic_store_explicit(
+        (_Atomic unsigned*)rec->sq_tail, tail + 1, memory_order_release);
+    // Entries a failed enter left behind go out with this one
+    unsigned head = atomic_load_explicit(
+        (_Atomic unsigned*)rec->sq_head, memory_order_acquire);
+    if (IoUringEnter(rec->ring_fd, tail + 1 - head, 0) < 0) {
+        Log(WARN, "io_uring submit deferred: %s\n", strerror(errno));
+    }
+}
+
+// Synchronous write of a small block (header, index) through the O_DIRECT
+// descriptor, padded with zeros to the alignment
+static bool WriteAligned(
+    Recorder* rec, const void* data, size_t bytes, uint64_t offset) {
+    size_t padded = (bytes + RECORDER_ALIGN - 1) / RECORDER_ALIGN *
+                    RECORDER_ALIGN;
+    unsigned char* buf = aligned_alloc(RECORDER_ALIGN, padded);
+    if (buf == NULL) {
+        return false;
+    }
+    memset(buf + bytes, 0, padded - bytes);
+    memcpy(buf, data, bytes);
+    ssize_t n = pwrite(rec->fd, buf, padded, (off_t)offset);
+    free(buf);
+    return n == (ssize_t)padded;
+}
+
+bool RecorderOpen(
+    Recorder* rec,
+    const char* path,
+    const RecordingInfo* info,
+    int depth,
+    bool block_when_full) {
+    size_t frame_bytes = info->frame_bytes;
+    memset(rec, 0, sizeof(*rec));
+    rec->ring_fd = -1;
+    rec->block_when_full = block_when_full;
+    rec->depth = depth < 1                    ? 1
+                 : depth > RECORDER_MAX_DEPTH ? RECORDER_MAX_DEPTH
+                                              : depth;
+    rec->frame_bytes = frame_bytes;
+    rec->slot_bytes =
+        (frame_bytes + RECORDER_ALIGN - 1) / RECORDER_ALIGN * RECORDER_ALIGN;
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    rec->fd = open(path, flags | O_DIRECT, 0644);
+    rec->direct = rec->fd >= 0;
+    if (rec->fd < 0 && errno == EINVAL) {
+        Log(WARN, "%s does not support O_DIRECT, writing cached\n", path);
+        rec->fd = open(path, flags, 0644);
+    }
+    if (rec->fd < 0) {
+        Log(ERROR, "Failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    bool pooled = FramePoolInit(&rec->pool, rec->depth, frame_bytes);
+    rec->buffers = rec->pool.base;
+    rec->index_capacity = 4096;
+    rec->index = malloc(rec->index_capacity * sizeof(*rec->index));
+    if (!pooled || rec->index == NULL) {
+        FramePoolFree(&rec->pool);
+        free(rec->index);
+        close(rec->fd);
+        return false;
+    }
+    // Final once the frame count and index are known, see RecorderClose()
+    RecordingHeaderInit(&rec->header, info, rec->slot_bytes);
+    bool written = WriteAligned(rec, &rec->header, sizeof(rec->header), 0);
+    if (written && rec->header.dark_offset > 0) {
+        const Calibration* cal = info->calibration;
+        size_t plane = (size_t)cal->width * cal->height * sizeof(uint16_t);
+        written =
+            WriteAligned(rec, cal->dark, plane, rec->header.dark_offset) &&
+            WriteAligned(rec, cal->gain, plane, rec->header.gain_offset);
+    }
+    if (!written) {
+        Log(ERROR, "Failed to write header to %s\n", path);
+        FramePoolFree(&rec->pool);
+        free(rec->index);
+        close(rec->fd);
+        return false;
+    }
+    rec->offset = rec->header.header_bytes;
+    // Padding past the frame is written as-is, so keep it deterministic
+    memset(rec->buffers, 0, rec->depth * rec->slot_bytes);
+    for (int i = 0; i < rec->depth; ++i) {
+        rec->free_slots[rec->free_count++] = rec->depth - 1 - i;
+    }
+
+    if (!RingInit(rec)) {
+        Log(WARN,
+            "io_uring unavailable (%s), recording with blocking writes\n",
+            strerror(errno));
+    }
+    Log(INFO,
+        "Recording to %s (%s, %d buffers of %zu bytes)\n",
+        path,
+        rec->direct ? "O_DIRECT" : "cached",
+        rec->depth,
+        rec->slot_bytes);
+    return true;
+}
+
+void RecorderClose(Recorder* rec) {
+    if (rec->ring_fd >= 0) {
+        while (atomic_load(&rec->inflight) > 0) {
+            Reap(rec, 1);
+        }
+        RingUnmap(rec);
+    }
+    // Playback must not take a slot that never reached the disk for a frame
+    uint64_t kept = 0;
+    for (uint64_t i = 0; i < rec->index_count; ++i) {
+        if (rec->index[i].offset != 0) {
+            rec->index[kept++] = rec->index[i];
+        }
+    }
+    rec->index_count = kept;
+    rec->header.frame_count = rec->index_count;
+    rec->header.index_offset = rec->offset;
+    size_t index_bytes = rec->index_count * sizeof(*rec->index);
+    bool ok = index_bytes == 0 ||
+              WriteAligned(rec, rec->index, index_bytes, rec->offset);
+    // Trim the index padding, then publish the index through the header
+    ok = ok && ftruncate(rec->fd, (off_t)(rec->offset + index_bytes)) == 0;
+    ok = ok && WriteAligned(rec, &rec->header, sizeof(rec->header), 0);
+    if (!ok) {
+        Log(ERROR, "Failed to finalize recording: %s\n", strerror(errno));
+    }
+    close(rec->fd);
+    FramePoolFree(&rec->pool);
+    rec->buffers = NULL;
+    free(rec->index);
+    rec->index = NULL;
+    Log(INFO,
+        "Recorded %lu frames, %lu dropped, %lu stalls, %lu errors\n",
+        atomic_load(&rec->written),
+        atomic_load(&rec->dropped),
+        atomic_load(&rec->stalls),
+        atomic_load(&rec->errors));
+}
+
+bool RecorderWrite(Recorder* rec, const Frame* frame) {
+    if (rec->ring_fd >= 0) {
+        Reap(rec, 0);
+        if (rec->free_count == 0 && rec->block_when_full) {
+            TraceBegin("record stall");
+            uint64_t t0 = NowNs();
+            Reap(rec, 1);
+            atomic_fetch_add(&rec->stall_ns, NowNs() - t0);
+            atomic_fetch_add(&rec->stalls, 1);
+            TraceEnd("record stall");
+        }
+    }
+    if (rec->free_count == 0) {
+        atomic_fetch_add(&rec->dropped, 1);
+        return false;
+    }
+
+    if (rec->index_count == rec->index_capacity) {
+        size_t capacity = rec->index_capacity * 2;
+        void* grown = realloc(rec->index, capacity * sizeof(*rec->index));
+        if (grown == NULL) {
+            atomic_fetch_add(&rec->dropped, 1);
+            return false;
+        }
+        rec->index = grown;
+        rec->index_capacity = capacity;
+    }
+    rec->index[rec->index_count++] = (RecordingIndexEntry){
+        .offset = rec->offset,
+        .timestamp_us = frame->timestamp_us,
+        .nframe = frame->nframe,
+        .exposure_us = (uint32_t)frame->exposure_us,
+    };
+
+    int slot = rec->free_slots[--rec->free_count];
+    rec->slot_entry[slot] = rec->index_count - 1;
+    unsigned char* buf = rec->buffers + slot * rec->slot_bytes;
+    size_t bytes = frame->size < rec->frame_bytes ? frame->size
+                                                  : rec->frame_bytes;
+    TraceBegin("record copy");
+    memcpy(buf, frame->data, bytes);
+    TraceEnd("record copy");
+    int inflight = atomic_fetch_add(&rec->inflight, 1) + 1;
+    if (inflight > rec->inflight_max) {
+        rec->inflight_max = inflight;
+    }
+
+    if (rec->ring_fd >= 0) {
+        Submit(rec, slot);
+    } else {
+        ssize_t n = pwrite(rec->fd, buf, rec->slot_bytes, (off_t)rec->offset);
+        Complete(rec, slot, n < 0 ? -errno : (int)n);
+    }
+    rec->offset += rec->slot_bytes;
+    return true;
+}
@@ -0,0 +1,80 @@
+#ifndef XICLOPS_RECORDER_H
+#define XICLOPS_RECORDER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame.h"
+#include "frame_pool.h"
+#include "recording.h"
+
+#define RECORDER_ALIGN 4096
+#define RECORDER_MAX_DEPTH 64
+
+// Writes every frame handed to it to disk without blocking the caller on I/O.
+// Frames are copied into a pool of page-aligned buffers and submitted as
+// O_DIRECT writes through an io_uring, so the page cache is bypassed and the
+// only cost on the capture thread is the copy. When every buffer is still in
+// flight the recorder either drops the frame or waits for a completion,
+// depending on `block_when_full`. The file is a recording as laid out in
+// recording.h.
+typedef struct Recorder {
+    int fd;
+    bool direct;  // O_DIRECT accepted by the filesystem
+    bool block_when_full;
+    int depth;
+    size_t frame_bytes;
+    size_t slot_bytes;  // frame_bytes rounded up to RECORDER_ALIGN
+    FramePool pool;
+    unsigned char* buffers;  // pool.base
+    int free_slots[RECORDER_MAX_DEPTH];
+    int free_count;
+    uint64_t offset;  // file offset of the next frame
+    RecordingHeader header;
+    RecordingIndexEntry* index;  // one entry per frame queued
+    uint64_t index_count;
+    uint64_t index_capacity;
+    uint64_t slot_entry[RECORDER_MAX_DEPTH];  // index entry of each slot
+    // io_uring state; ring_fd < 0 means synchronous pwrite() fallback
+    int ring_fd;
+    void* sq_ring;
+    size_t sq_ring_bytes;
+    void* cq_ring;
+    size_t cq_ring_bytes;
+    void* sqes;
+    size_t sqes_bytes;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    void* cqes;
+    // Written by the capture thread, read by anyone
+    atomic_uint_least64_t written;  // frames completed on disk
+    atomic_uint_least64_t dropped;  // frames refused because the queue was full
+    atomic_uint_least64_t stalls;   // waits for a free buffer (blocking mode)
+    atomic_uint_least64_t stall_ns;
+    atomic_uint_least64_t errors;  // failed or short writes
+    atomic_int inflight;
+    int inflight_max;
+} Recorder;
+
+// Creates or truncates `path`. Depth is clamped to [1, RECORDER_MAX_DEPTH].
+bool RecorderOpen(
+    Recorder* rec,
+    const char* path,
+    const RecordingInfo* info,
+    int depth,
+    bool block_when_full);
+// Waits for outstanding writes, appends the index of the frames that reached
+// the disk, finalizes the header and closes the file
+void RecorderClose(Recorder* rec);
+
+// Queues one frame. Returns false if it was dropped or could not be written.
+bool RecorderWrite(Recorder* rec, const Frame* frame);
+
+#endif  // XICLOPS_RECORDER_H
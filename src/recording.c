@@ -0,0 +1,221 @@
+#include "recording.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "calibration.h"
+#include "log.h"
+
+static size_t PlaneBytes(const RecordingInfo* info) {
+    size_t bytes = (size_t)info->width * info->height * sizeof(uint16_t);
+    return (bytes + RECORDING_HEADER_BYTES - 1) / RECORDING_HEADER_BYTES *
+           RECORDING_HEADER_BYTES;
+}
+
+size_t RecordingCalibrationBytes(const RecordingInfo* info) {
+    const Calibration* cal = info->calibration;
+    if (cal == NULL || !(cal->has_dark || cal->has_flat)) {
+        return 0;
+    }
+    return 2 * PlaneBytes(info);
+}
+
+void RecordingHeaderInit(
+    RecordingHeader* header, const RecordingInfo* info, size_t slot_bytes) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+    header->version = RECORDING_VERSION;
+    header->header_bytes = RECORDING_HEADER_BYTES;
+    header->width = (uint32_t)info->width;
+    header->height = (uint32_t)info->height;
+    header->format = (uint32_t)info->format;
+    header->pattern = (uint32_t)info->pattern;
+    header->bit_depth = (uint32_t)info->bit_depth;
+    header->exposure_us = (uint32_t)info->exposure_us;
+    header->wb_kr = info->wb_kr;
+    header->wb_kg = info->wb_kg;
+    header->wb_kb = info->wb_kb;
+    header->frame_bytes = info->frame_bytes;
+    header->slot_bytes = slot_bytes;
+    size_t calibration_bytes = RecordingCalibrationBytes(info);
+    if (calibration_bytes > 0) {
+        const Calibration* cal = info->calibration;
+        header->calibration = (cal->has_dark ? RECORDING_DARK : 0) |
+                              (cal->has_flat ? RECORDING_FLAT : 0) |
+                              (info->corrected ? RECORDING_CORRECTED : 0);
+        header->dark_offset = RECORDING_HEADER_BYTES;
+        header->gain_offset = RECORDING_HEADER_BYTES + PlaneBytes(info);
+        header->header_bytes += (uint32_t)calibration_bytes;
+    }
+}
+
+static bool RecoverIndex(Recording* rec) {
+    const RecordingHeader* h = &rec->header;
+    uint64_t count = (rec->map_bytes - h->header_bytes) / h->slot_bytes;
+    rec->recovered = calloc(count > 0 ? count : 1, sizeof(*rec->recovered));
+    if (rec->recovered == NULL) {
+        return false;
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+        rec->recovered[i].offset = h->header_bytes + i * h->slot_bytes;
+        rec->recovered[i].nframe = (uint32_t)(i + 1);
+    }
+    rec->index = rec->recovered;
+    rec->frame_count = count;
+    Log(WARN, "Recording has no index, recovered %lu frames\n", count);
+    return true;
+}
+
+bool RecordingOpen(Recording* rec, const char* path) {
+    memset(rec, 0, sizeof(*rec));
+    rec->fd = open(path, O_RDONLY);
+    if (rec->fd < 0) {
+        Log(ERROR, "Failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(rec->fd, &st) != 0 || st.st_size < RECORDING_HEADER_BYTES) {
+        Log(ERROR, "%s is not a recording\n", path);
+        close(rec->fd);
+        return false;
+    }
+    rec->map_bytes = (size_t)st.st_size;
+    void* map = mmap(NULL, rec->map_bytes, PROT_READ, MAP_SHARED, rec->fd, 0);
+    if (map == MAP_FAILED) {
+        Log(ERROR, "Failed to map %s: %s\n", path, strerror(errno));
+        close(rec->fd);
+        return false;
+    }
+    rec->map = map;
+    memcpy(&rec->header, rec->map, sizeof(rec->header));
+
+    const RecordingHeader* h = &rec->header;
+    bool valid =
+        memcmp(h->magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) == 0 &&
+        h->version == RECORDING_VERSION;
+    valid = valid && h->slot_bytes > 0 && h->frame_bytes <= h->slot_bytes &&
+            h->header_bytes >= RECORDING_HEADER_BYTES &&
+            h->header_bytes <= rec->map_bytes;
+    if (!valid) {
+        Log(ERROR,
+            "%s is not a version %d recording\n",
+            path,
+            RECORDING_VERSION);
+        RecordingClose(rec);
+        return false;
+    }
+    // Everything downstream reads width * height pixels of the format from
+    // each frame, so the frames must hold that much. Playback hands the
+    // pattern and bit depth on as they are, so they must be ones it knows.
+    int bpp = h->format <= FRAME_RAW16 ? FrameBytesPerPixel(h->format) : 0;
+    uint64_t pixel_bytes = (uint64_t)h->width * h->height * bpp;
+    uint32_t max_depth = h->format == FRAME_RAW16 ? 16 : 8;
+    if (bpp == 0 || h->width == 0 || h->height == 0 ||
+        h->frame_bytes < pixel_bytes || h->pattern > BAYER_GBRG ||
+        h->bit_depth == 0 || h->bit_depth > max_depth) {
+        Log(ERROR,
+            "%s has an inconsistent header: %ux%u, format %u, pattern %u, "
+            "%u bits, %lu bytes per frame\n",
+            path,
+            h->width,
+            h->height,
+            h->format,
+            h->pattern,
+            h->bit_depth,
+            h->frame_bytes);
+        RecordingClose(rec);
+        return false;
+    }
+
+    // A header written at the end names an index; only a file cut short
+    // (no frame count yet) gets its index recovered
+    if (h->frame_count > 0 &&
+        (h->index_offset < h->header_bytes ||
+         h->index_offset > rec->map_bytes ||
+         h->frame_count > (rec->map_bytes - h->index_offset) /
+                              sizeof(RecordingIndexEntry))) {
+        Log(ERROR,
+            "%s: index of %lu frames at %lu lies outside the file\n",
+            path,
+            h->frame_count,
+            h->index_offset);
+        RecordingClose(rec);
+        return false;
+    }
+    if (h->frame_count > 0) {
+        rec->index = (const RecordingIndexEntry*)(rec->map + h->index_offset);
+        rec->frame_count = h->frame_count;
+    } else if (!RecoverIndex(rec)) {
+        RecordingClose(rec);
+        return false;
+    }
+    Log(INFO,
+        "%s: %ux%u, %lu frames\n",
+        path,
+        h->width,
+        h->height,
+        rec->frame_count);
+    return true;
+}
+
+void RecordingClose(Recording* rec) {
+    if (rec->map != NULL) {
+        munmap(rec->map, rec->map_bytes);
+        rec->map = NULL;
+    }
+    free(rec->recovered);
+    rec->recovered = NULL;
+    if (rec->fd >= 0) {
+        close(rec->fd);
+        rec->fd = -1;
+    }
+}
+
+bool RecordingFrame(const Recording* rec, uint64_t i, Frame* frame) {
+    if (i >= rec->frame_count) {
+        return false;
+    }
+    const RecordingHeader* h = &rec->header;
+    const RecordingIndexEntry* e = &rec->index[i];
+    if (e->offset > rec->map_bytes ||
+        h->frame_bytes > rec->map_bytes - e->offset) {
+        return false;
+    }
+    // The mapping is read-only; consumers only ever read frame data
+    frame->data = rec->map + e->offset;
+    frame->size = h->frame_bytes;
+    frame->width = (int)h->width;
+    frame->height = (int)h->height;
+    frame->roi_x = 0;
+    frame->roi_y = 0;
+    frame->format = (FrameFormat)h->format;
+    frame->pattern = (BayerPattern)h->pattern;
+    frame->bit_depth = (int)h->bit_depth;
+    frame->nframe = e->nframe;
+    frame->timestamp_us = e->timestamp_us;
+    frame->gpi_level = 0;
+    frame->exposure_us =
+        (int)(e->exposure_us != 0 ? e->exposure_us : h->exposure_us);
+    frame->gain_db = 0.0f;
+    frame->transient = false;
+    return true;
+}
+
+uint64_t RecordingSeek(const Recording* rec, uint64_t timestamp_us) {
+    uint64_t lo = 0;
+    uint64_t hi = rec->frame_count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (rec->index[mid].timestamp_us < timestamp_us) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
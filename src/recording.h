@@ -0,0 +1,111 @@
+#ifndef XICLOPS_RECORDING_H
+#define XICLOPS_RECORDING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame.h"
+
+// On-disk layout of a recorded session, all little-endian:
+//
+//   [0, RECORDING_HEADER_BYTES)   RecordingHeader, zero padded
+//   dark, gain                    optional calibration references (see
+//                                 calibration.h), width * height uint16_t
+//                                 each at dark_offset and gain_offset, zero
+//                                 padded to RECORDING_HEADER_BYTES
+//   frame i                       at header_bytes + i * slot_bytes, the frame
+//                                 followed by zero padding to slot_bytes;
+//                                 slots whose write failed aren't indexed
+//   index                         frame_count RecordingIndexEntry at
+//                                 index_offset
+//
+// Slots are page multiples so frames can be written with O_DIRECT and mapped
+// straight into textures. The header and index are written when recording
+// stops; a file with frame_count == 0 but frames after the header was cut
+// short, and the reader recovers the frames without their timestamps.
+// Frames are stored corrected with the references if RECORDING_CORRECTED,
+// else raw, and the references are there for playback to apply.
+
+#define RECORDING_MAGIC "XICLOPS"
+#define RECORDING_VERSION 1
+#define RECORDING_HEADER_BYTES 4096
+
+// RecordingHeader.calibration
+#define RECORDING_DARK 1u       // dark reference stored
+#define RECORDING_FLAT 2u       // flat reference stored
+#define RECORDING_CORRECTED 4u  // and already applied to the frames
+
+typedef struct RecordingHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_bytes;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;  // FrameFormat, from XI_PRM_IMAGE_DATA_FORMAT
+    uint32_t pattern;  // BayerPattern
+    uint32_t bit_depth;
+    uint32_t exposure_us;
+    float wb_kr;
+    float wb_kg;
+    float wb_kb;
+    uint32_t calibration;  // RECORDING_DARK | RECORDING_FLAT | ...
+    uint64_t frame_bytes;
+    uint64_t slot_bytes;
+    uint64_t frame_count;
+    uint64_t index_offset;
+    uint64_t dark_offset;  // 0 without calibration references
+    uint64_t gain_offset;
+} RecordingHeader;
+
+typedef struct RecordingIndexEntry {
+    uint64_t offset;
+    uint64_t timestamp_us;  // sensor timestamp
+    uint32_t nframe;        // sensor frame counter
+    uint32_t exposure_us;   // 0 in older files: see the header's
+} RecordingIndexEntry;
+
+// What the writer knows about the stream when it starts
+typedef struct RecordingInfo {
+    int width;
+    int height;
+    FrameFormat format;
+    BayerPattern pattern;
+    int bit_depth;
+    int exposure_us;
+    float wb_kr;
+    float wb_kg;
+    float wb_kb;
+    size_t frame_bytes;
+    // References in effect, stored with the recording; NULL for none
+    const struct Calibration* calibration;
+    bool corrected;  // frames are written corrected with them
+} RecordingInfo;
+
+// Room the calibration references take after the header, if any
+size_t RecordingCalibrationBytes(const RecordingInfo* info);
+void RecordingHeaderInit(
+    RecordingHeader* header, const RecordingInfo* info, size_t slot_bytes);
+
+// A recording mapped read-only. Frames returned by RecordingFrame() point into
+// the mapping and stay valid until RecordingClose().
+typedef struct Recording {
+    int fd;
+    unsigned char* map;
+    size_t map_bytes;
+    RecordingHeader header;
+    const RecordingIndexEntry* index;
+    RecordingIndexEntry* recovered;  // synthesized index of a truncated file
+    uint64_t frame_count;
+} Recording;
+
+bool RecordingOpen(Recording* rec, const char* path);
+void RecordingClose(Recording* rec);
+
+// Points `frame->data` at frame i and fills in its metadata without copying;
+// `storage` and `capacity` are left alone. False if out of range.
+bool RecordingFrame(const Recording* rec, uint64_t i, Frame* frame);
+// First frame at or after the sensor timestamp, frame_count if none
+uint64_t RecordingSeek(const Recording* rec, uint64_t timestamp_us);
+
+#endif  // XICLOPS_RECORDING_H
@@ -0,0 +1,246 @@
+#include "shaders.h"
+
+#include <rlgl.h>
+
+#define STRINGIFY(x) #x
+#define GLSL_INT(x) STRINGIFY(x)
+
+// Samples are fetched with texelFetch so filtering and zoom never mix
+// neighbouring Bayer sites. `bayerOrigin` shifts the pixel parity so that
+// red always lands on (0, 0) of the 2x2 tile.
+static const char* DEBAYER_FS =
+    "#version 330\n"
+    "in vec2 fragTexCoord;\n"
+    "in vec4 fragColor;\n"
+    "uniform sampler2D texture0;\n"
+    "uniform vec4 colDiffuse;\n"
+    "uniform ivec2 bayerOrigin;\n"
+    "uniform vec3 wbGains;\n"
+    "out vec4 finalColor;\n"
+    "ivec2 size;\n"
+    "float px(ivec2 p) {\n"
+    "    return texelFetch(texture0, clamp(p, ivec2(0), size - 1), 0).r;\n"
+    "}\n"
+    "void main() {\n"
+    "    size = textureSize(texture0, 0);\n"
+    "    ivec2 p = ivec2(fragTexCoord * vec2(size));\n"
+    "    ivec2 q = (p + bayerOrigin) & 1;\n"
+    "    float c = px(p);\n"
+    "    float l = px(p + ivec2(-1, 0));\n"
+    "    float r = px(p + ivec2(1, 0));\n"
+    "    float u = px(p + ivec2(0, -1));\n"
+    "    float d = px(p + ivec2(0, 1));\n"
+    "    float cross = (l + r + u + d) * 0.25;\n"
+    "    float diag = (px(p + ivec2(-1, -1)) + px(p + ivec2(1, -1)) +\n"
+    "                  px(p + ivec2(-1, 1)) + px(p + ivec2(1, 1))) * 0.25;\n"
+    "    float horiz = (l + r) * 0.5;\n"
+    "    float vert = (u + d) * 0.5;\n"
+    "    vec3 rgb;\n"
+    "    if (q == ivec2(0, 0)) {\n"
+    "        rgb = vec3(c, cross, diag);\n"
+    "    } else if (q == ivec2(1, 1)) {\n"
+    "        rgb = vec3(diag, cross, c);\n"
+    "    } else if (q == ivec2(1, 0)) {\n"
+    "        rgb = vec3(horiz, c, vert);\n"
+    "    } else {\n"
+    "        rgb = vec3(vert, c, horiz);\n"
+    "    }\n"
+    "    finalColor = vec4(clamp(rgb * wbGains, 0.0, 1.0), 1.0) *\n"
+    "                 colDiffuse * fragColor;\n"
+    "}\n";
+
+// Luma of a colour texture, or of a Bayer mosaic one per 2x2 tile (R + 2G +
+// B, before white balance), so the focus shaders work on either. Positions
+// are in luma samples and clamp at the edges.
+#define LUMA_GLSL                                                       \
+    "uniform int mosaic;\n"                                             \
+    "ivec2 lumaSize;\n"                                                 \
+    "void initLuma() {\n"                                               \
+    "    lumaSize = textureSize(texture0, 0) / (mosaic != 0 ? 2 : 1);\n" \
+    "}\n"                                                               \
+    "float luma(ivec2 p) {\n"                                           \
+    "    p = clamp(p, ivec2(0), lumaSize - 1);\n"                       \
+    "    if (mosaic != 0) {\n"                                          \
+    "        ivec2 t = 2 * p;\n"                                        \
+    "        return (texelFetch(texture0, t, 0).r +\n"                  \
+    "                texelFetch(texture0, t + ivec2(1, 0), 0).r +\n"    \
+    "                texelFetch(texture0, t + ivec2(0, 1), 0).r +\n"    \
+    "                texelFetch(texture0, t + ivec2(1, 1), 0).r) *\n"   \
+    "               0.25;\n"                                            \
+    "    }\n"                                                           \
+    "    vec3 rgb = texelFetch(texture0, p, 0).rgb;\n"                  \
+    "    return dot(rgb, vec3(0.299, 0.587, 0.114));\n"                 \
+    "}\n"
+
+// Sobel magnitude, scaled to a per-pixel luma step
+static const char* PEAKING_FS =
+    "#version 330\n"
+    "in vec2 fragTexCoord;\n"
+    "in vec4 fragColor;\n"
+    "uniform sampler2D texture0;\n"
+    "uniform float threshold;\n"
+    "uniform vec4 peakColor;\n"
+    "out vec4 finalColor;\n" LUMA_GLSL
+    "void main() {\n"
+    "    initLuma();\n"
+    "    ivec2 p = ivec2(fragTexCoord * vec2(lumaSize));\n"
+    "    float tl = luma(p + ivec2(-1, -1));\n"
+    "    float t = luma(p + ivec2(0, -1));\n"
+    "    float tr = luma(p + ivec2(1, -1));\n"
+    "    float l = luma(p + ivec2(-1, 0));\n"
+    "    float r = luma(p + ivec2(1, 0));\n"
+    "    float bl = luma(p + ivec2(-1, 1));\n"
+    "    float b = luma(p + ivec2(0, 1));\n"
+    "    float br = luma(p + ivec2(1, 1));\n"
+    "    float gx = (tr + 2.0 * r + br) - (tl + 2.0 * l + bl);\n"
+    "    float gy = (bl + 2.0 * b + br) - (tl + 2.0 * t + tr);\n"
+    "    if (length(vec2(gx, gy)) * 0.25 < threshold) {\n"
+    "        discard;\n"
+    "    }\n"
+    "    finalColor = peakColor;\n"
+    "}\n";
+
+// One fragment per block of the region; the block is read from the
+// fragment's position, so the quad's texture coordinates don't matter
+static const char* LAPLACIAN_FS =
+    "#version 330\n"
+    "uniform sampler2D texture0;\n"
+    "uniform ivec2 origin;\n"
+    "uniform ivec2 extent;\n"
+    "out vec4 finalColor;\n"
+    "const int BLOCK = " GLSL_INT(SHARPNESS_BLOCK) ";\n" LUMA_GLSL
+    "void main() {\n"
+    "    initLuma();\n"
+    "    ivec2 first = ivec2(gl_FragCoord.xy) * BLOCK;\n"
+    "    vec3 sums = vec3(0.0);\n"
+    "    for (int y = 0; y < BLOCK; ++y) {\n"
+    "        for (int x = 0; x < BLOCK; ++x) {\n"
+    "            ivec2 q = first + ivec2(x, y);\n"
+    "            if (q.x >= extent.x || q.y >= extent.y) {\n"
+    "                continue;\n"
+    "            }\n"
+    "            ivec2 p = origin + q;\n"
+    "            float lap = luma(p + ivec2(1, 0)) + luma(p - ivec2(1, 0)) +\n"
+    "                        luma(p + ivec2(0, 1)) + luma(p - ivec2(0, 1)) -\n"
+    "                        4.0 * luma(p);\n"
+    "            sums += vec3(lap, lap * lap, 1.0);\n"
+    "        }\n"
+    "    }\n"
+    "    finalColor = vec4(sums, 1.0);\n"
+    "}\n";
+
+static const char* REDUCE_FS =
+    "#version 330\n"
+    "uniform sampler2D texture0;\n"
+    "uniform ivec2 inputSize;\n"
+    "out vec4 finalColor;\n"
+    "const int BLOCK = " GLSL_INT(SHARPNESS_BLOCK) ";\n"
+    "void main() {\n"
+    "    ivec2 first = ivec2(gl_FragCoord.xy) * BLOCK;\n"
+    "    vec3 sums = vec3(0.0);\n"
+    "    for (int y = 0; y < BLOCK; ++y) {\n"
+    "        for (int x = 0; x < BLOCK; ++x) {\n"
+    "            ivec2 q = first + ivec2(x, y);\n"
+    "            if (q.x < inputSize.x && q.y < inputSize.y) {\n"
+    "                sums += texelFetch(texture0, q, 0).rgb;\n"
+    "            }\n"
+    "        }\n"
+    "    }\n"
+    "    finalColor = vec4(sums, 1.0);\n"
+    "}\n";
+
+bool DebayerShaderLoad(DebayerShader* ds) {
+    ds->shader = LoadShaderFromMemory(NULL, DEBAYER_FS);
+    // raylib falls back to its default shader when compilation fails
+    if (ds->shader.id == rlGetShaderIdDefault()) {
+        return false;
+    }
+    ds->bayer_origin_loc = GetShaderLocation(ds->shader, "bayerOrigin");
+    ds->wb_gains_loc = GetShaderLocation(ds->shader, "wbGains");
+    DebayerShaderSetPattern(ds, BAYER_RGGB);
+    DebayerShaderSetGains(ds, 1.0f, 1.0f, 1.0f);
+    return true;
+}
+
+void DebayerShaderUnload(DebayerShader* ds) {
+    UnloadShader(ds->shader);
+}
+
+void DebayerShaderSetPattern(DebayerShader* ds, BayerPattern pattern) {
+    int origin[2] = {0, 0};
+    switch (pattern) {
+        case BAYER_NONE:
+        case BAYER_RGGB: {
+            break;
+        }
+        case BAYER_BGGR: {
+            origin[0] = 1;
+            origin[1] = 1;
+            break;
+        }
+        case BAYER_GRBG: {
+            origin[0] = 1;
+            break;
+        }
+        case BAYER_GBRG: {
+            origin[1] = 1;
+            break;
+        }
+    }
+    SetShaderValue(
+        ds->shader, ds->bayer_origin_loc, origin, SHADER_UNIFORM_IVEC2);
+}
+
+void DebayerShaderSetGains(DebayerShader* ds, float kr, float kg, float kb) {
+    float gains[3] = {kr, kg, kb};
+    SetShaderValue(ds->shader, ds->wb_gains_loc, gains, SHADER_UNIFORM_VEC3);
+}
+
+bool PeakingShaderLoad(PeakingShader* ps) {
+    ps->shader = LoadShaderFromMemory(NULL, PEAKING_FS);
+    if (ps->shader.id == rlGetShaderIdDefault()) {
+        return false;
+    }
+    ps->mosaic_loc = GetShaderLocation(ps->shader, "mosaic");
+    ps->threshold_loc = GetShaderLocation(ps->shader, "threshold");
+    ps->color_loc = GetShaderLocation(ps->shader, "peakColor");
+    PeakingShaderSet(ps, false, 24.0f, RED);
+    return true;
+}
+
+void PeakingShaderUnload(PeakingShader* ps) {
+    UnloadShader(ps->shader);
+}
+
+void PeakingShaderSet(
+    PeakingShader* ps, bool mosaic, float threshold, Color color) {
+    int mosaic_i = mosaic ? 1 : 0;
+    float level = threshold / 255.0f;
+    Vector4 rgba = ColorNormalize(color);
+    SetShaderValue(ps->shader, ps->mosaic_loc, &mosaic_i, SHADER_UNIFORM_INT);
+    SetShaderValue(
+        ps->shader, ps->threshold_loc, &level, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(ps->shader, ps->color_loc, &rgba, SHADER_UNIFORM_VEC4);
+}
+
+bool SharpnessShadersLoad(SharpnessShaders* ss) {
+    ss->laplacian = LoadShaderFromMemory(NULL, LAPLACIAN_FS);
+    if (ss->laplacian.id == rlGetShaderIdDefault()) {
+        return false;
+    }
+    ss->reduce = LoadShaderFromMemory(NULL, REDUCE_FS);
+    if (ss->reduce.id == rlGetShaderIdDefault()) {
+        UnloadShader(ss->laplacian);
+        return false;
+    }
+    ss->mosaic_loc = GetShaderLocation(ss->laplacian, "mosaic");
+    ss->origin_loc = GetShaderLocation(ss->laplacian, "origin");
+    ss->extent_loc = GetShaderLocation(ss->laplacian, "extent");
+    ss->input_size_loc = GetShaderLocation(ss->reduce, "inputSize");
+    return true;
+}
+
+void SharpnessShadersUnload(SharpnessShaders* ss) {
+    UnloadShader(ss->laplacian);
+    UnloadShader(ss->reduce);
+}
@@ -0,0 +1,59 @@
+#ifndef XICLOPS_SHADERS_H
+#define XICLOPS_SHADERS_H
+
+#include <raylib.h>
+#include <stdbool.h>
+
+#include "frame.h"
+
+// Bilinear demosaic of a single-channel Bayer texture. Draw the raw texture
+// inside BeginShaderMode(debayer.shader) to get RGB on screen.
+typedef struct DebayerShader {
+    Shader shader;
+    int bayer_origin_loc;
+    int wb_gains_loc;
+} DebayerShader;
+
+bool DebayerShaderLoad(DebayerShader* ds);
+void DebayerShaderUnload(DebayerShader* ds);
+void DebayerShaderSetPattern(DebayerShader* ds, BayerPattern pattern);
+// Raw data carries no white balance, so the gains are applied in the shader
+void DebayerShaderSetGains(DebayerShader* ds, float kr, float kg, float kb);
+
+// Focus peaking. Drawing the stream texture a second time inside
+// BeginShaderMode(peaking.shader) paints the pixels whose luma gradient
+// (Sobel) exceeds the threshold and leaves the rest of the picture alone.
+typedef struct PeakingShader {
+    Shader shader;
+    int mosaic_loc;
+    int threshold_loc;
+    int color_loc;
+} PeakingShader;
+
+bool PeakingShaderLoad(PeakingShader* ps);
+void PeakingShaderUnload(PeakingShader* ps);
+// `mosaic` for single-channel Bayer textures, whose luma is taken per 2x2
+// tile; `threshold` in luma levels (0-255)
+void PeakingShaderSet(
+    PeakingShader* ps, bool mosaic, float threshold, Color color);
+
+// Passes of the sharpness reduction (see sharpness.h), drawn over a whole
+// float render target. `laplacian` turns each SHARPNESS_BLOCK square of luma
+// samples of a region into the sums of their Laplacian, its square and their
+// count; `reduce` sums each SHARPNESS_BLOCK square of texels of the previous
+// pass.
+#define SHARPNESS_BLOCK 8
+
+typedef struct SharpnessShaders {
+    Shader laplacian;
+    int mosaic_loc;
+    int origin_loc;  // region corner, luma samples
+    int extent_loc;  // region size, luma samples
+    Shader reduce;
+    int input_size_loc;
+} SharpnessShaders;
+
+bool SharpnessShadersLoad(SharpnessShaders* ss);
+void SharpnessShadersUnload(SharpnessShaders* ss);
+
+#endif  // XICLOPS_SHADERS_H
@@ -0,0 +1,220 @@
+#include "sharpness.h"
+
+#include <rlgl.h>
+#include <string.h>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#define PACK_BYTES \
+    (SHARPNESS_READBACK * SHARPNESS_READBACK * 4 * sizeof(float))
+
+static int Blocks(int n) {
+    return (n + SHARPNESS_BLOCK - 1) / SHARPNESS_BLOCK;
+}
+
+// raylib's render textures are 8-bit; the sums need float
+static bool LoadLevel(RenderTexture2D* rt, int width, int height) {
+    memset(rt, 0, sizeof(*rt));
+    rt->id = rlLoadFramebuffer();
+    if (rt->id == 0) {
+        return false;
+    }
+    rt->texture = (Texture2D){
+        .id = rlLoadTexture(
+            NULL, width, height, PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, 1),
+        .width = width,
+        .height = height,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R32G32B32A32,
+    };
+    rlFramebufferAttach(
+        rt->id,
+        rt->texture.id,
+        RL_ATTACHMENT_COLOR_CHANNEL0,
+        RL_ATTACHMENT_TEXTURE2D,
+        0);
+    if (rt->texture.id == 0 || !rlFramebufferComplete(rt->id)) {
+        UnloadRenderTexture(*rt);
+        return false;
+    }
+    return true;
+}
+
+static void FreeLevels(SharpnessMeter* m) {
+    for (int i = 0; i < m->levels; ++i) {
+        UnloadRenderTexture(m->level[i]);
+    }
+    m->levels = 0;
+    m->extent_w = 0;
+    m->extent_h = 0;
+}
+
+// Sized for a region of `width` x `height` luma samples; only redone when it
+// changes (ROI or preview changes)
+static bool SizeLevels(SharpnessMeter* m, int width, int height) {
+    if (m->levels > 0 && m->extent_w == width && m->extent_h == height) {
+        return true;
+    }
+    FreeLevels(m);
+    int w = Blocks(width);
+    int h = Blocks(height);
+    for (;;) {
+        if (m->levels == SHARPNESS_MAX_LEVELS ||
+            !LoadLevel(&m->level[m->levels], w, h)) {
+            FreeLevels(m);
+            return false;
+        }
+        m->levels += 1;
+        if (w <= SHARPNESS_READBACK && h <= SHARPNESS_READBACK) {
+            break;
+        }
+        w = Blocks(w);
+        h = Blocks(h);
+    }
+    m->extent_w = width;
+    m->extent_h = height;
+    return true;
+}
+
+// Covers the whole target, so every fragment runs once. Blending reads the
+// target, which starts out as whatever was in the memory (NaNs included),
+// hence the clear.
+static void DrawPass(const RenderTexture2D* target, Texture2D input) {
+    ClearBackground(BLANK);
+    DrawTexturePro(
+        input,
+        (Rectangle){0.0f, 0.0f, (float)input.width, (float)input.height},
+        (Rectangle){
+            0.0f,
+            0.0f,
+            (float)target->texture.width,
+            (float)target->texture.height,
+        },
+        (Vector2){0.0f, 0.0f},
+        0.0f,
+        WHITE);
+}
+
+bool SharpnessMeterInit(SharpnessMeter* m) {
+    memset(m, 0, sizeof(*m));
+    if (!SharpnessShadersLoad(&m->shaders)) {
+        return false;
+    }
+    // Buffer objects are untyped, so rlgl's loader works for pack buffers
+    m->pack = rlLoadVertexBuffer(NULL, (int)PACK_BYTES, true);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (m->pack == 0) {
+        SharpnessShadersUnload(&m->shaders);
+        return false;
+    }
+    return true;
+}
+
+void SharpnessMeterFree(SharpnessMeter* m) {
+    if (m->fence != NULL) {
+        glDeleteSync(m->fence);
+        m->fence = NULL;
+    }
+    FreeLevels(m);
+    rlUnloadVertexBuffer(m->pack);
+    SharpnessShadersUnload(&m->shaders);
+}
+
+void SharpnessMeterSubmit(
+    SharpnessMeter* m, Texture2D texture, bool mosaic, Rectangle region) {
+    if (m->fence != NULL) {
+        return;
+    }
+    // In luma samples, clipped to the texture
+    int div = mosaic ? 2 : 1;
+    int x0 = (int)region.x / div;
+    int y0 = (int)region.y / div;
+    int x1 = (int)(region.x + region.width) / div;
+    int y1 = (int)(region.y + region.height) / div;
+    x0 = x0 < 0 ? 0 : x0;
+    y0 = y0 < 0 ? 0 : y0;
+    x1 = x1 > texture.width / div ? texture.width / div : x1;
+    y1 = y1 > texture.height / div ? texture.height / div : y1;
+    if (x1 - x0 < 3 || y1 - y0 < 3 || !SizeLevels(m, x1 - x0, y1 - y0)) {
+        return;
+    }
+
+    int mosaic_i = mosaic ? 1 : 0;
+    int origin[2] = {x0, y0};
+    int extent[2] = {x1 - x0, y1 - y0};
+    Shader laplacian = m->shaders.laplacian;
+    BeginTextureMode(m->level[0]);
+    BeginShaderMode(laplacian);
+    SetShaderValue(
+        laplacian, m->shaders.mosaic_loc, &mosaic_i, SHADER_UNIFORM_INT);
+    SetShaderValue(
+        laplacian, m->shaders.origin_loc, origin, SHADER_UNIFORM_IVEC2);
+    SetShaderValue(
+        laplacian, m->shaders.extent_loc, extent, SHADER_UNIFORM_IVEC2);
+    DrawPass(&m->level[0], texture);
+    EndShaderMode();
+    EndTextureMode();
+    for (int i = 1; i < m->levels; ++i) {
+        Texture2D input = m->level[i - 1].texture;
+        int size[2] = {input.width, input.height};
+        BeginTextureMode(m->level[i]);
+        BeginShaderMode(m->shaders.reduce);
+        SetShaderValue(
+            m->shaders.reduce,
+            m->shaders.input_size_loc,
+            size,
+            SHADER_UNIFORM_IVEC2);
+        DrawPass(&m->level[i], input);
+        EndShaderMode();
+        EndTextureMode();
+    }
+
+    const RenderTexture2D* last = &m->level[m->levels - 1];
+    m->pack_w = last->texture.width;
+    m->pack_h = last->texture.height;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, last->id);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m->pack);
+    glReadPixels(0, 0, m->pack_w, m->pack_h, GL_RGBA, GL_FLOAT, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    m->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool SharpnessMeterPoll(SharpnessMeter* m) {
+    if (m->fence == NULL) {
+        return false;
+    }
+    GLenum status = glClientWaitSync(m->fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        return false;
+    }
+    glDeleteSync(m->fence);
+    m->fence = NULL;
+    if (status == GL_WAIT_FAILED) {
+        return false;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m->pack);
+    const float* sums =
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, PACK_BYTES, GL_MAP_READ_BIT);
+    double sum = 0.0;
+    double squares = 0.0;
+    double count = 0.0;
+    if (sums != NULL) {
+        for (int i = 0; i < m->pack_w * m->pack_h; ++i) {
+            sum += sums[4 * i + 0];
+            squares += sums[4 * i + 1];
+            count += sums[4 * i + 2];
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (count < 1.0) {
+        return false;
+    }
+    double mean = sum / count;
+    m->score = (squares / count - mean * mean) * 255.0 * 255.0;
+    m->scores += 1;
+    return true;
+}
@@ -0,0 +1,54 @@
+#ifndef XICLOPS_SHARPNESS_H
+#define XICLOPS_SHARPNESS_H
+
+#include <raylib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "shaders.h"
+
+// Focus score: variance of the Laplacian of luma over a region of a stream
+// texture, in luma levels squared; higher is sharper. It is reduced on the
+// GPU, SHARPNESS_BLOCK x SHARPNESS_BLOCK per pass into float render targets,
+// until at most SHARPNESS_READBACK x SHARPNESS_READBACK sums are left, which
+// come back through a pixel pack buffer read a frame or more later, so the
+// render thread never waits for the GPU. Only compare scores taken at the
+// same preview factor: downsampling smooths the picture.
+#define SHARPNESS_READBACK 8
+#define SHARPNESS_MAX_LEVELS 6
+
+typedef struct FocusConfig {
+    float threshold;  // peaking: luma step per pixel, 0-255
+    // Scored region as fractions of the frame
+    float region_x;
+    float region_y;
+    float region_w;
+    float region_h;
+} FocusConfig;
+
+typedef struct SharpnessMeter {
+    SharpnessShaders shaders;
+    int levels;
+    RenderTexture2D level[SHARPNESS_MAX_LEVELS];
+    int extent_w;  // region the levels were sized for, in luma samples
+    int extent_h;
+    unsigned int pack;  // PBO the last level is read back through
+    void* fence;        // GLsync of the readback in flight, NULL if none
+    int pack_w;
+    int pack_h;
+    double score;
+    uint64_t scores;  // readbacks completed
+} SharpnessMeter;
+
+// Requires a current GL context (after InitWindow)
+bool SharpnessMeterInit(SharpnessMeter* m);
+void SharpnessMeterFree(SharpnessMeter* m);
+// Queues the passes over `region` (texels) of `texture`, unless the previous
+// readback is still in flight. `mosaic` for single-channel Bayer textures.
+// Must be called outside BeginMode2D(), which render targets reset.
+void SharpnessMeterSubmit(
+    SharpnessMeter* m, Texture2D texture, bool mosaic, Rectangle region);
+// Takes a finished readback without waiting; true if `score` changed
+bool SharpnessMeterPoll(SharpnessMeter* m);
+
+#endif  // XICLOPS_SHARPNESS_H
@@ -0,0 +1,161 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "clock.h"
+#include "frame_source.h"
+#include "log.h"
+#include "recording.h"
+
+// Frames are lent straight out of the recording's mapping, so replay costs
+// page faults rather than copies. Realtime pacing follows the recorded sensor
+// timestamps, restarting the clock whenever playback loops; a recovered index
+// has no timestamps and plays unpaced.
+typedef struct PlaybackSource {
+    Recording rec;
+    PlaybackMode mode;
+    uint64_t next;       // realtime/fast: next frame to deliver
+    int64_t shown;       // step: last frame delivered, -1 before the first
+    atomic_int pending;  // step: frames requested but not yet delivered
+    uint64_t clock_start_ns;
+    uint64_t clock_start_us;  // sensor timestamp shown at clock_start_ns
+} PlaybackSource;
+
+// Prefetch this far ahead so realtime replay doesn't stall on disk reads
+#define PLAYBACK_READAHEAD 4
+
+static void Readahead(PlaybackSource* p, uint64_t i) {
+    const RecordingHeader* h = &p->rec.header;
+    for (uint64_t k = i; k < i + PLAYBACK_READAHEAD; ++k) {
+        if (k >= p->rec.frame_count) {
+            break;
+        }
+        uint64_t offset = p->rec.index[k].offset;
+        madvise(p->rec.map + offset, h->frame_bytes, MADV_WILLNEED);
+    }
+}
+
+// Which frame to deliver next, or -1 to report a timeout
+static int64_t NextIndex(PlaybackSource* p, int timeout_ms) {
+    uint64_t count = p->rec.frame_count;
+    switch (p->mode) {
+        case PLAYBACK_STEP: {
+            uint64_t end_ns = NowNs() + (uint64_t)timeout_ms * 1000000ull;
+            int steps = p->shown < 0 ? 1 : atomic_exchange(&p->pending, 0);
+            while (steps == 0 && NowNs() < end_ns) {
+                SleepUntilNs(NowNs() + 1000000);
+                steps = atomic_exchange(&p->pending, 0);
+            }
+            int64_t target = p->shown + steps;
+            target = target < 0 ? 0 : target;
+            target = target >= (int64_t)count ? (int64_t)count - 1 : target;
+            if (steps == 0 || target == p->shown) {
+                return -1;
+            }
+            return target;
+        }
+        case PLAYBACK_REALTIME: {
+            if (p->next == count) {
+                p->next = 0;
+            }
+            uint64_t ts = p->rec.index[p->next].timestamp_us;
+            if (p->next == 0 || ts < p->clock_start_us) {
+                p->clock_start_ns = NowNs();
+                p->clock_start_us = ts;
+            }
+            uint64_t due =
+                p->clock_start_ns + (ts - p->clock_start_us) * 1000ull;
+            uint64_t now = NowNs();
+            if (due > now + (uint64_t)timeout_ms * 1000000ull) {
+                SleepUntilNs(now + (uint64_t)timeout_ms * 1000000ull);
+                return -1;
+            }
+            SleepUntilNs(due);
+            return (int64_t)p->next++;
+        }
+        case PLAYBACK_FAST: {
+            if (p->next == count) {
+                p->next = 0;
+            }
+            return (int64_t)p->next++;
+        }
+    }
+    return -1;
+}
+
+static SourceStatus PlaybackNext(
+    FrameSource* src, Frame* frame, int timeout_ms) {
+    PlaybackSource* p = src->impl;
+    int64_t i = NextIndex(p, timeout_ms);
+    if (i < 0) {
+        return SOURCE_TIMEOUT;
+    }
+    if (!RecordingFrame(&p->rec, (uint64_t)i, frame)) {
+        Log(ERROR, "Recording frame %ld is out of bounds\n", i);
+        return SOURCE_ERROR;
+    }
+    p->shown = i;
+    Readahead(p, (uint64_t)i + 1);
+    return SOURCE_OK;
+}
+
+static void PlaybackStep(FrameSource* src, int frames) {
+    PlaybackSource* p = src->impl;
+    atomic_fetch_add(&p->pending, frames);
+}
+
+static void PlaybackClose(FrameSource* src) {
+    PlaybackSource* p = src->impl;
+    RecordingClose(&p->rec);
+    free(p);
+    src->impl = NULL;
+}
+
+bool FrameSourceOpenPlayback(
+    FrameSource* src, const char* path, PlaybackMode mode) {
+    memset(src, 0, sizeof(*src));
+    PlaybackSource* p = calloc(1, sizeof(PlaybackSource));
+    if (p == NULL) {
+        return false;
+    }
+    if (!RecordingOpen(&p->rec, path)) {
+        free(p);
+        return false;
+    }
+    if (p->rec.frame_count == 0) {
+        Log(ERROR, "%s contains no frames\n", path);
+        RecordingClose(&p->rec);
+        free(p);
+        return false;
+    }
+    p->mode = mode;
+    p->shown = -1;
+    atomic_init(&p->pending, 0);
+
+    const RecordingHeader* h = &p->rec.header;
+    src->name = "playback";
+    src->downsampling = 1;
+    src->width = (int)h->width;
+    src->height = (int)h->height;
+    src->format = (FrameFormat)h->format;
+    src->pattern = (BayerPattern)h->pattern;
+    src->bit_depth = (int)h->bit_depth;
+    src->frame_bytes = h->frame_bytes;
+    const RecordingIndexEntry* first = &p->rec.index[0];
+    const RecordingIndexEntry* last = &p->rec.index[p->rec.frame_count - 1];
+    if (last->timestamp_us > first->timestamp_us) {
+        src->rate_hz = (p->rec.frame_count - 1) * 1e6 /
+                       (last->timestamp_us - first->timestamp_us);
+    }
+    src->exposure_us = (int)h->exposure_us;
+    src->wb_kr = h->wb_kr;
+    src->wb_kg = h->wb_kg;
+    src->wb_kb = h->wb_kb;
+    src->next = PlaybackNext;
+    src->close = PlaybackClose;
+    src->step = mode == PLAYBACK_STEP ? PlaybackStep : NULL;
+    src->impl = p;
+    Readahead(p, 0);
+    return true;
+}
@@ -0,0 +1,350 @@
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock.h"
+#include "frame_source.h"
+#include "log.h"
+
+// The pattern repeats every SYNTH_PERIOD pixels in both directions, so one
+// (width + period) x period tile is rendered up front and every frame is just
+// row copies out of it at a moving offset. Steps are even to keep the Bayer
+// parity of raw patterns intact while scrolling.
+#define SYNTH_PERIOD 256
+#define SYNTH_STEP_X 4
+#define SYNTH_STEP_Y 2
+// Frames between an exposure change and the first frame showing it, like a
+// sensor that exposes one frame while reading out the previous one
+#define SYNTH_EXPOSURE_DELAY 2
+
+typedef struct SyntheticSource {
+    unsigned char* tile;
+    size_t tile_stride;
+    // The pattern at the configured exposure and white balance, kept once
+    // either changes so `tile` can be rescaled from it
+    unsigned char* base;
+    int reference_us;
+    int exposure_us;
+    float gain_db;
+    bool exposure_pending;
+    int pending_us;
+    float pending_db;
+    uint32_t pending_at;  // nframe from which the pending values show
+    // White balance the RGB32 pattern was rendered with, and the gains in
+    // effect; new ones arrive from any thread in thousandths
+    float reference_wb[3];
+    float wb[3];
+    atomic_int wanted_wb[3];
+    atomic_bool wb_pending;
+    unsigned char* lent;  // stands in for the driver buffer with zero_copy
+    SourceRoi roi;
+    uint64_t period_ns;
+    uint64_t deadline_ns;
+    uint32_t nframe;
+} SyntheticSource;
+
+static void PatternRgb(int x, int y, int seed, uint8_t rgb[3]) {
+    int u = x % SYNTH_PERIOD;
+    int v = y % SYNTH_PERIOD;
+    rgb[0] = (uint8_t)(u + seed * 64);
+    rgb[1] = (uint8_t)v;
+    rgb[2] = (uint8_t)(u + v);
+    // Checkerboard gives the demosaic and focus tools hard edges to chew on
+    if (((u / 32) + (v / 32)) & 1) {
+        rgb[0] /= 2;
+        rgb[1] /= 2;
+        rgb[2] /= 2;
+    }
+}
+
+static void RenderTile(SyntheticSource* s, FrameSource* src, int seed) {
+    int tile_w = src->width + SYNTH_PERIOD;
+    for (int y = 0; y < SYNTH_PERIOD; ++y) {
+        unsigned char* row = s->tile + (size_t)y * s->tile_stride;
+        for (int x = 0; x < tile_w; ++x) {
+            uint8_t rgb[3];
+            PatternRgb(x, y, seed, rgb);
+            // RGGB: red on even/even, blue on odd/odd
+            uint8_t mono = (x & 1) == (y & 1) ? rgb[(x & 1) * 2] : rgb[1];
+            switch (src->format) {
+                case FRAME_RGB32: {
+                    // Same BGRA layout xiAPI produces
+                    row[4 * x + 0] = rgb[2];
+                    row[4 * x + 1] = rgb[1];
+                    row[4 * x + 2] = rgb[0];
+                    row[4 * x + 3] = 255;
+                    break;
+                }
+                case FRAME_RAW8: {
+                    row[x] = mono;
+                    break;
+                }
+                case FRAME_RAW16: {
+                    ((uint16_t*)row)[x] = (uint16_t)(mono << 4);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Keeps the pattern as rendered before the first rescale
+static bool KeepBase(SyntheticSource* s) {
+    if (s->base == NULL) {
+        size_t bytes = s->tile_stride * SYNTH_PERIOD;
+        s->base = malloc(bytes);
+        if (s->base == NULL) {
+            return false;
+        }
+        memcpy(s->base, s->tile, bytes);
+    }
+    return true;
+}
+
+// Brightness scales with exposure time times linear gain, clipping like a
+// sensor would; RGB32 channels also scale with the white balance, like the
+// xiAPI conversion. Alpha is left alone.
+static void ScaleTile(SyntheticSource* s, const FrameSource* src) {
+    double k = (double)s->exposure_us / s->reference_us *
+               pow(10.0, s->gain_db / 20.0);
+    size_t bytes = s->tile_stride * SYNTH_PERIOD;
+    if (src->format == FRAME_RAW16) {
+        const uint16_t* in = (const uint16_t*)s->base;
+        uint16_t* out = (uint16_t*)s->tile;
+        for (size_t i = 0; i < bytes / 2; ++i) {
+            // 12 significant bits, clipped where the sensor would
+            double v = in[i] * k + 0.5;
+            out[i] = (uint16_t)(v > 4095.0 ? 4095 : (int)v);
+        }
+        return;
+    }
+    bool rgb = src->format == FRAME_RGB32;
+    // Per BGRA byte
+    uint8_t lut[4][256];
+    for (int c = 0; c < 4; ++c) {
+        double kc = k;
+        if (rgb && c < 3) {
+            kc *= s->wb[2 - c] / s->reference_wb[2 - c];
+        }
+        for (int v = 0; v < 256; ++v) {
+            double scaled = v * kc + 0.5;
+            lut[c][v] = scaled > 255.0 ? 255 : (uint8_t)scaled;
+        }
+    }
+    for (size_t i = 0; i < bytes; ++i) {
+        int c = rgb ? (int)(i & 3) : 0;
+        s->tile[i] = c == 3 ? s->base[i] : lut[c][s->base[i]];
+    }
+}
+
+static SourceStatus SyntheticNext(
+    FrameSource* src, Frame* frame, int timeout_ms) {
+    SyntheticSource* s = src->impl;
+    if (s->period_ns > 0) {
+        uint64_t now = NowNs();
+        if (s->deadline_ns > now + (uint64_t)timeout_ms * 1000000ull) {
+            SleepUntilNs(now + (uint64_t)timeout_ms * 1000000ull);
+            return SOURCE_TIMEOUT;
+        }
+        SleepUntilNs(s->deadline_ns);
+        // Don't try to catch up after a stall, like a real sensor: exposures
+        // that fell in the stall are lost, but the frame counter still
+        // advances so the capture path sees them as drops
+        s->deadline_ns += s->period_ns;
+        if (s->deadline_ns < now) {
+            s->nframe += (uint32_t)((now - s->deadline_ns) / s->period_ns + 1);
+            s->deadline_ns = now + s->period_ns;
+        }
+    }
+
+    bool rescale = false;
+    if (s->exposure_pending && s->nframe + 1 >= s->pending_at) {
+        s->exposure_us = s->pending_us;
+        s->gain_db = s->pending_db;
+        s->exposure_pending = false;
+        rescale = true;
+    }
+    if (atomic_exchange(&s->wb_pending, false) && KeepBase(s)) {
+        for (int c = 0; c < 3; ++c) {
+            s->wb[c] = atomic_load(&s->wanted_wb[c]) / 1000.0f;
+        }
+        rescale = true;
+    }
+    if (rescale) {
+        ScaleTile(s, src);
+    }
+
+    frame->data = s->lent != NULL ? s->lent : frame->storage;
+    frame->transient = s->lent != NULL;
+    int bpp = FrameBytesPerPixel(src->format);
+    const SourceRoi* roi = &s->roi;
+    size_t row_bytes = (size_t)roi->width * bpp;
+    uint32_t t = s->nframe;
+    size_t x_off =
+        (size_t)((t * SYNTH_STEP_X + roi->x) % SYNTH_PERIOD) * bpp;
+    for (int y = 0; y < roi->height; ++y) {
+        int tile_y = (int)((y + roi->y + t * SYNTH_STEP_Y) % SYNTH_PERIOD);
+        memcpy(
+            frame->data + (size_t)y * row_bytes,
+            s->tile + (size_t)tile_y * s->tile_stride + x_off,
+            row_bytes);
+    }
+
+    s->nframe += 1;
+    frame->size = row_bytes * roi->height;
+    frame->width = roi->width;
+    frame->height = roi->height;
+    frame->roi_x = roi->x;
+    frame->roi_y = roi->y;
+    frame->format = src->format;
+    frame->pattern = src->pattern;
+    frame->bit_depth = src->bit_depth;
+    frame->nframe = s->nframe;
+    frame->timestamp_us = NowNs() / 1000;
+    frame->gpi_level = 0;
+    frame->exposure_us = s->exposure_us;
+    frame->gain_db = s->gain_db;
+    return SOURCE_OK;
+}
+
+static bool SyntheticSetRoi(FrameSource* src, SourceRoi* roi) {
+    SyntheticSource* s = src->impl;
+    // Even offsets and sizes keep the mosaic phase
+    int x = roi->x < 0 ? 0 : roi->x & ~1;
+    int y = roi->y < 0 ? 0 : roi->y & ~1;
+    x = x > src->width - 2 ? src->width - 2 : x;
+    y = y > src->height - 2 ? src->height - 2 : y;
+    int w = roi->width & ~1;
+    int h = roi->height & ~1;
+    w = w < 2 ? 2 : w > src->width - x ? src->width - x : w;
+    h = h < 2 ? 2 : h > src->height - y ? src->height - y : h;
+    s->roi = (SourceRoi){.x = x, .y = y, .width = w, .height = h};
+    *roi = s->roi;
+    return true;
+}
+
+static bool SyntheticSetExposure(
+    FrameSource* src, int* exposure_us, float* gain_db) {
+    SyntheticSource* s = src->impl;
+    if (!KeepBase(s)) {
+        return false;
+    }
+    int e = *exposure_us;
+    e = e < src->exposure_min_us   ? src->exposure_min_us
+        : e > src->exposure_max_us ? src->exposure_max_us
+                                   : e;
+    float g = *gain_db;
+    g = g < src->gain_min_db   ? src->gain_min_db
+        : g > src->gain_max_db ? src->gain_max_db
+                               : g;
+    s->pending_us = e;
+    s->pending_db = g;
+    s->pending_at = s->nframe + 1 + SYNTH_EXPOSURE_DELAY;
+    s->exposure_pending = true;
+    *exposure_us = e;
+    *gain_db = g;
+    return true;
+}
+
+// Raw patterns are left alone, as a camera would
+static bool SyntheticSetWhiteBalance(
+    FrameSource* src, float kr, float kg, float kb) {
+    SyntheticSource* s = src->impl;
+    float gains[3] = {kr, kg, kb};
+    for (int c = 0; c < 3; ++c) {
+        if (!(gains[c] > 0.0f)) {
+            return false;
+        }
+    }
+    for (int c = 0; c < 3; ++c) {
+        atomic_store(&s->wanted_wb[c], (int)(gains[c] * 1000.0f + 0.5f));
+    }
+    atomic_store(&s->wb_pending, src->format == FRAME_RGB32);
+    return true;
+}
+
+static void SyntheticClose(FrameSource* src) {
+    SyntheticSource* s = src->impl;
+    free(s->tile);
+    free(s->base);
+    free(s->lent);
+    free(s);
+    src->impl = NULL;
+}
+
+bool FrameSourceOpenSynthetic(
+    FrameSource* src, int seed, const SourceConfig* cfg) {
+    memset(src, 0, sizeof(*src));
+    // Keep the mosaic phase identical on every row/column pair
+    int width = cfg->width & ~1;
+    int height = cfg->height & ~1;
+    if (width <= 0 || height <= 0) {
+        Log(ERROR, "Invalid synthetic size %dx%d\n", cfg->width, cfg->height);
+        return false;
+    }
+    src->name = "synthetic";
+    src->downsampling = 1;
+    src->width = width;
+    src->height = height;
+    src->format = cfg->format;
+    src->pattern = cfg->format == FRAME_RGB32 ? BAYER_NONE : BAYER_RGGB;
+    src->bit_depth = cfg->format == FRAME_RAW16 ? 12 : 8;
+    src->frame_bytes = (size_t)width * height * FrameBytesPerPixel(cfg->format);
+
+    SyntheticSource* s = calloc(1, sizeof(SyntheticSource));
+    if (s == NULL) {
+        return false;
+    }
+    s->tile_stride =
+        (size_t)(width + SYNTH_PERIOD) * FrameBytesPerPixel(cfg->format);
+    s->tile = malloc(s->tile_stride * SYNTH_PERIOD);
+    if (s->tile == NULL) {
+        free(s);
+        return false;
+    }
+    if (cfg->zero_copy) {
+        s->lent = malloc(src->frame_bytes);
+        if (s->lent == NULL) {
+            free(s->tile);
+            free(s);
+            return false;
+        }
+    }
+    RenderTile(s, src, seed);
+    s->roi = (SourceRoi){.width = width, .height = height};
+    if (cfg->rate_hz > 0.0) {
+        s->period_ns = (uint64_t)(1e9 / cfg->rate_hz);
+        s->deadline_ns = NowNs() + s->period_ns;
+    }
+
+    src->rate_hz = cfg->rate_hz;
+    src->exposure_us = cfg->exposure_us;
+    src->exposure_min_us = 10;
+    src->exposure_max_us = 1000000;
+    src->gain_min_db = 0.0f;
+    src->gain_max_db = 24.0f;
+    s->reference_us = cfg->exposure_us > 0 ? cfg->exposure_us : 1;
+    s->exposure_us = s->reference_us;
+    src->wb_kr = cfg->wb_kr;
+    src->wb_kg = cfg->wb_kg;
+    src->wb_kb = cfg->wb_kb;
+    float wb[3] = {cfg->wb_kr, cfg->wb_kg, cfg->wb_kb};
+    for (int c = 0; c < 3; ++c) {
+        s->reference_wb[c] = wb[c] > 0.0f ? wb[c] : 1.0f;
+        s->wb[c] = s->reference_wb[c];
+    }
+    src->next = SyntheticNext;
+    src->close = SyntheticClose;
+    src->set_roi = SyntheticSetRoi;
+    src->set_exposure = SyntheticSetExposure;
+    src->set_white_balance = SyntheticSetWhiteBalance;
+    src->impl = s;
+    Log(INFO,
+        "Synthetic source %d: %dx%d at %.1f Hz\n",
+        seed,
+        width,
+        height,
+        cfg->rate_hz);
+    return true;
+}
@@ -0,0 +1,658 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xiApi.h>
+
+#include "frame_source.h"
+#include "log.h"
+
+// Part of the measured bandwidth left for protocol overhead
+static const double BANDWIDTH_HEADROOM = 0.9;
+// On drops the limit backs off; after enough clean health windows it creeps
+// back towards the calibrated share
+static const double BANDWIDTH_BACKOFF = 0.85;
+static const double BANDWIDTH_RECOVER = 1.02;
+static const int BANDWIDTH_CLEAN_WINDOWS = 10;
+
+typedef struct XimeaSource {
+    HANDLE handle;
+    XI_IMG image;
+    int cam_id;
+    bool zero_copy;
+    // Capture thread only, via XimeaFeedback()
+    bool adaptive;
+    int bw_min;
+    int bw_target;
+    int bw_limit;
+    int clean_windows;
+    // Sensor geometry for ROI changes; offsets are relative to the
+    // configured (centered) full frame at base_x/base_y
+    int base_x;
+    int base_y;
+    int w_inc;
+    int h_inc;
+    int x_inc;
+    int y_inc;
+    SourceRoi roi;  // capture thread only
+    // Applied through XimeaSetExposure(), capture thread only
+    int exposure_us;
+    float gain_db;
+} XimeaSource;
+
+// The available bandwidth is measured once per controller, by the first
+// camera opened on it, before any of its neighbours stream. Cameras are
+// opened one at a time from the main thread.
+#define XIMEA_MAX_CONTROLLERS 16
+
+typedef struct ControllerBandwidth {
+    char key[256];
+    int available_mbps;
+} ControllerBandwidth;
+
+static ControllerBandwidth CONTROLLERS[XIMEA_MAX_CONTROLLERS];
+static int CONTROLLER_COUNT = 0;
+
+// Cameras on one controller share the device location up to its last
+// component (the port)
+static bool ControllerKey(int cam_id, char* key, size_t size) {
+    char location[256] = {0};
+    if (xiGetDeviceInfoString(
+            cam_id, XI_PRM_DEVICE_LOCATION, location, sizeof(location)) !=
+            XI_OK ||
+        location[0] == '\0') {
+        return false;
+    }
+    char* cut = strrchr(location, '/');
+    char* dash = strrchr(location, '-');
+    if (dash != NULL && (cut == NULL || dash > cut)) {
+        cut = dash;
+    }
+    if (cut != NULL && cut != location) {
+        *cut = '\0';
+    }
+    snprintf(key, size, "%s", location);
+    return true;
+}
+
+int FrameSourceXimeaPeers(int cam_id, const int* cam_ids, int count) {
+    char key[256];
+    if (!ControllerKey(cam_id, key, sizeof(key))) {
+        return 1;
+    }
+    int peers = 0;
+    for (int i = 0; i < count; ++i) {
+        char other[256];
+        if (cam_ids[i] == cam_id ||
+            (ControllerKey(cam_ids[i], other, sizeof(other)) &&
+             strcmp(key, other) == 0)) {
+            peers += 1;
+        }
+    }
+    return peers > 0 ? peers : 1;
+}
+
+static int AvailableBandwidth(HANDLE handle, int cam_id) {
+    char key[256];
+    bool keyed = ControllerKey(cam_id, key, sizeof(key));
+    for (int i = 0; keyed && i < CONTROLLER_COUNT; ++i) {
+        if (strcmp(CONTROLLERS[i].key, key) == 0) {
+            return CONTROLLERS[i].available_mbps;
+        }
+    }
+    // Takes a moment: the driver measures it by streaming test data
+    int available = 0;
+    if (xiGetParamInt(handle, XI_PRM_AVAILABLE_BANDWIDTH, &available) !=
+        XI_OK) {
+        return 0;
+    }
+    Log(INFO,
+        "Controller %s: %d Mbit/s available\n",
+        keyed ? key : "(unknown)",
+        available);
+    if (keyed && CONTROLLER_COUNT < XIMEA_MAX_CONTROLLERS) {
+        ControllerBandwidth* c = &CONTROLLERS[CONTROLLER_COUNT++];
+        snprintf(c->key, sizeof(c->key), "%s", key);
+        c->available_mbps = available;
+    }
+    return available;
+}
+
+static void XimeaSetBandwidth(FrameSource* src, XimeaSource* xi, int mbps) {
+    if (xiSetParamInt(xi->handle, XI_PRM_LIMIT_BANDWIDTH, mbps) != XI_OK) {
+        Log(WARN,
+            "Failed to set bandwidth limit %d Mbit/s on camera %d\n",
+            mbps,
+            xi->cam_id);
+        return;
+    }
+    xi->bw_limit = mbps;
+    atomic_store(&src->bandwidth_mbps, mbps);
+}
+
+static void XimeaFeedback(FrameSource* src, uint64_t frames, uint64_t lost) {
+    XimeaSource* xi = src->impl;
+    if (!xi->adaptive || frames + lost == 0) {
+        return;
+    }
+    if (lost > 0) {
+        xi->clean_windows = 0;
+        int lower = (int)(xi->bw_limit * BANDWIDTH_BACKOFF);
+        lower = lower < xi->bw_min ? xi->bw_min : lower;
+        if (lower < xi->bw_limit) {
+            Log(WARN,
+                "Camera %d lost %lu frames, bandwidth limit %d -> %d Mbit/s\n",
+                xi->cam_id,
+                lost,
+                xi->bw_limit,
+                lower);
+            XimeaSetBandwidth(src, xi, lower);
+        }
+        return;
+    }
+    if (++xi->clean_windows < BANDWIDTH_CLEAN_WINDOWS ||
+        xi->bw_limit >= xi->bw_target) {
+        return;
+    }
+    xi->clean_windows = 0;
+    int higher = (int)(xi->bw_limit * BANDWIDTH_RECOVER) + 1;
+    higher = higher > xi->bw_target ? xi->bw_target : higher;
+    Log(DEBUG,
+        "Camera %d bandwidth limit %d -> %d Mbit/s\n",
+        xi->cam_id,
+        xi->bw_limit,
+        higher);
+    XimeaSetBandwidth(src, xi, higher);
+}
+
+static FrameFormat FormatFromXi(XI_IMG_FORMAT frm) {
+    switch (frm) {
+        case XI_RAW8: {
+            return FRAME_RAW8;
+        }
+        case XI_RAW16: {
+            return FRAME_RAW16;
+        }
+        default: {
+            return FRAME_RGB32;
+        }
+    }
+}
+
+static BayerPattern PatternFromXi(int cfa) {
+    switch (cfa) {
+        case XI_CFA_BAYER_RGGB: {
+            return BAYER_RGGB;
+        }
+        case XI_CFA_BAYER_BGGR: {
+            return BAYER_BGGR;
+        }
+        case XI_CFA_BAYER_GRBG: {
+            return BAYER_GRBG;
+        }
+        case XI_CFA_BAYER_GBRG: {
+            return BAYER_GBRG;
+        }
+        default: {
+            return BAYER_NONE;
+        }
+    }
+}
+
+static SourceStatus XimeaNext(FrameSource* src, Frame* frame, int timeout_ms) {
+    XimeaSource* xi = src->impl;
+    XI_IMG* image = &xi->image;
+    if (!xi->zero_copy) {
+        image->bp = frame->storage;
+        image->bp_size = frame->capacity;
+    }
+    XI_RETURN status = xiGetImage(xi->handle, timeout_ms, image);
+    if (status == XI_TIMEOUT) {
+        return SOURCE_TIMEOUT;
+    }
+    if (status != XI_OK) {
+        Log(ERROR, "xiGetImage failed on camera %d: %d\n", xi->cam_id, status);
+        return SOURCE_ERROR;
+    }
+    // In unsafe mode bp is the driver's buffer, reused by the next call
+    frame->data = xi->zero_copy ? image->bp : frame->storage;
+    frame->transient = xi->zero_copy;
+    frame->format = FormatFromXi(image->frm);
+    frame->pattern = src->pattern;
+    frame->bit_depth = src->bit_depth;
+    frame->size = ((size_t)image->width * FrameBytesPerPixel(frame->format) +
+                   image->padding_x) *
+                  image->height;
+    frame->width = image->width;
+    frame->height = image->height;
+    frame->roi_x = xi->roi.x;
+    frame->roi_y = xi->roi.y;
+    frame->nframe = image->acq_nframe;
+    frame->timestamp_us =
+        (uint64_t)image->tsSec * 1000000 + (uint64_t)image->tsUSec;
+    frame->gpi_level = image->GPI_level;
+    frame->exposure_us = (int)image->exposure_time_us;
+    frame->gain_db = image->gain_db;
+    return SOURCE_OK;
+}
+
+static int RoundDown(int v, int inc) {
+    return inc > 1 ? v / inc * inc : v;
+}
+
+// With acquisition stopped; offsets go to 0 first so the new size always
+// fits. Returns the parameter that failed, NULL if none.
+static const char* WriteRoi(XimeaSource* xi, const SourceRoi* roi) {
+    const struct {
+        const char* prm;
+        int value;
+    } writes[] = {
+        {XI_PRM_OFFSET_X, 0},
+        {XI_PRM_OFFSET_Y, 0},
+        {XI_PRM_WIDTH, roi->width},
+        {XI_PRM_HEIGHT, roi->height},
+        {XI_PRM_OFFSET_X, xi->base_x + roi->x},
+        {XI_PRM_OFFSET_Y, xi->base_y + roi->y},
+    };
+    for (size_t i = 0; i < sizeof(writes) / sizeof(writes[0]); ++i) {
+        if (xiSetParamInt(xi->handle, writes[i].prm, writes[i].value) !=
+            XI_OK) {
+            return writes[i].prm;
+        }
+    }
+    return NULL;
+}
+
+// The crop the sensor has, relative to the source's full frame
+static void ReadRoi(XimeaSource* xi) {
+    int x = xi->base_x + xi->roi.x;
+    int y = xi->base_y + xi->roi.y;
+    int w = xi->roi.width;
+    int h = xi->roi.height;
+    xiGetParamInt(xi->handle, XI_PRM_OFFSET_X, &x);
+    xiGetParamInt(xi->handle, XI_PRM_OFFSET_Y, &y);
+    xiGetParamInt(xi->handle, XI_PRM_WIDTH, &w);
+    xiGetParamInt(xi->handle, XI_PRM_HEIGHT, &h);
+    xi->roi = (SourceRoi){
+        .x = x - xi->base_x,
+        .y = y - xi->base_y,
+        .width = w,
+        .height = h,
+    };
+}
+
+static bool XimeaSetRoi(FrameSource* src, SourceRoi* roi) {
+    XimeaSource* xi = src->impl;
+    // Increments are even on colour sensors, so the Bayer phase holds
+    int x = RoundDown(roi->x < 0 ? 0 : roi->x, xi->x_inc);
+    int y = RoundDown(roi->y < 0 ? 0 : roi->y, xi->y_inc);
+    int w = RoundDown(roi->width, xi->w_inc);
+    int h = RoundDown(roi->height, xi->h_inc);
+    w = w > src->width - x ? RoundDown(src->width - x, xi->w_inc) : w;
+    h = h > src->height - y ? RoundDown(src->height - y, xi->h_inc) : h;
+    int w_min = 0;
+    int h_min = 0;
+    xiGetParamInt(xi->handle, XI_PRM_WIDTH XI_PRM_INFO_MIN, &w_min);
+    xiGetParamInt(xi->handle, XI_PRM_HEIGHT XI_PRM_INFO_MIN, &h_min);
+    if (w < w_min || h < h_min) {
+        *roi = xi->roi;
+        return false;
+    }
+
+    // The size can't change while streaming
+    HANDLE handle = xi->handle;
+    XI_RETURN status = xiStopAcquisition(handle);
+    if (status != XI_OK) {
+        Log(WARN,
+            "Failed to stop camera %d for a new ROI: %d\n",
+            xi->cam_id,
+            status);
+        *roi = xi->roi;
+        return false;
+    }
+    SourceRoi previous = xi->roi;
+    SourceRoi wanted = {.x = x, .y = y, .width = w, .height = h};
+    const char* failed = WriteRoi(xi, &wanted);
+    if (failed != NULL) {
+        Log(WARN,
+            "Failed to set %s for ROI %dx%d+%d+%d on camera %d\n",
+            failed,
+            w,
+            h,
+            x,
+            y,
+            xi->cam_id);
+        // Frames have to report the crop they really have, whichever part
+        // of either ROI that ends up being
+        WriteRoi(xi, &previous);
+        ReadRoi(xi);
+    } else {
+        xi->roi = wanted;
+    }
+    status = xiStartAcquisition(handle);
+    if (status != XI_OK && failed == NULL) {
+        Log(WARN,
+            "Camera %d won't start with ROI %dx%d+%d+%d, going back\n",
+            xi->cam_id,
+            w,
+            h,
+            x,
+            y);
+        failed = "acquisition start";
+        WriteRoi(xi, &previous);
+        ReadRoi(xi);
+        status = xiStartAcquisition(handle);
+    }
+    if (status != XI_OK) {
+        Log(ERROR,
+            "Failed to restart camera %d after a ROI change: %d\n",
+            xi->cam_id,
+            status);
+    }
+    *roi = xi->roi;
+    // Fewer rows read out means a higher rate in free run
+    float framerate = 0.0f;
+    if (xiGetParamFloat(handle, XI_PRM_FRAMERATE, &framerate) == XI_OK) {
+        src->rate_hz = framerate;
+    }
+    if (failed != NULL || status != XI_OK) {
+        return false;
+    }
+    Log(DEBUG,
+        "Camera %d ROI %dx%d+%d+%d, %.1f fps\n",
+        xi->cam_id,
+        w,
+        h,
+        x,
+        y,
+        src->rate_hz);
+    return true;
+}
+
+// Both are plain parameter writes the sensor picks up a frame or two later,
+// with no acquisition restart, so the driver keeps queueing meanwhile
+static bool XimeaSetExposure(FrameSource* src, int* exposure_us, float* gain) {
+    XimeaSource* xi = src->impl;
+    int e = *exposure_us;
+    e = e < src->exposure_min_us   ? src->exposure_min_us
+        : e > src->exposure_max_us ? src->exposure_max_us
+                                   : e;
+    float g = *gain;
+    g = g < src->gain_min_db   ? src->gain_min_db
+        : g > src->gain_max_db ? src->gain_max_db
+                               : g;
+    XI_RETURN status = XI_OK;
+    if (e != xi->exposure_us) {
+        status += xiSetParamInt(xi->handle, XI_PRM_EXPOSURE, e);
+        // The sensor rounds to its line time
+        xiGetParamInt(xi->handle, XI_PRM_EXPOSURE, &e);
+    }
+    if (g != xi->gain_db) {
+        status += xiSetParamFloat(xi->handle, XI_PRM_GAIN, g);
+        xiGetParamFloat(xi->handle, XI_PRM_GAIN, &g);
+    }
+    if (status != XI_OK) {
+        Log(WARN, "Failed to set exposure on camera %d\n", xi->cam_id);
+        return false;
+    }
+    xi->exposure_us = e;
+    xi->gain_db = g;
+    *exposure_us = e;
+    *gain = g;
+    return true;
+}
+
+// Only affects the RGB32 conversion in xiAPI, which takes parameter writes
+// from any thread while acquiring
+static bool XimeaSetWhiteBalance(
+    FrameSource* src, float kr, float kg, float kb) {
+    XimeaSource* xi = src->impl;
+    XI_RETURN status = XI_OK;
+    status += xiSetParamFloat(xi->handle, XI_PRM_WB_KR, kr);
+    status += xiSetParamFloat(xi->handle, XI_PRM_WB_KG, kg);
+    status += xiSetParamFloat(xi->handle, XI_PRM_WB_KB, kb);
+    if (status != XI_OK) {
+        Log(WARN, "Failed to set white balance on camera %d\n", xi->cam_id);
+        return false;
+    }
+    return true;
+}
+
+// Bins `factor` x `factor` pixels on the sensor, or skips them where binning
+// isn't supported, so only the preview resolution crosses the bus. Returns
+// the factor in effect, 1 if neither works.
+static int SetDownsampling(HANDLE handle, int cam_id, int factor) {
+    int dwn = factor >= 4 ? XI_DWN_4x4 : XI_DWN_2x2;
+    static const int TYPES[] = {XI_BINNING, XI_SKIPPING};
+    for (size_t i = 0; i < sizeof(TYPES) / sizeof(TYPES[0]); ++i) {
+        if (xiSetParamInt(handle, XI_PRM_DOWNSAMPLING_TYPE, TYPES[i]) ==
+                XI_OK &&
+            xiSetParamInt(handle, XI_PRM_DOWNSAMPLING, dwn) == XI_OK) {
+            Log(INFO,
+                "Camera %d: %dx%d %s on the sensor\n",
+                cam_id,
+                dwn,
+                dwn,
+                TYPES[i] == XI_BINNING ? "binning" : "skipping");
+            return dwn;
+        }
+    }
+    Log(WARN, "Camera %d: sensor downsampling not supported\n", cam_id);
+    xiSetParamInt(handle, XI_PRM_DOWNSAMPLING, XI_DWN_1x1);
+    return 1;
+}
+
+static void XimeaClose(FrameSource* src) {
+    XimeaSource* xi = src->impl;
+    xiStopAcquisition(xi->handle);
+    xiCloseDevice(xi->handle);
+    free(xi);
+    src->impl = NULL;
+}
+
+bool FrameSourceOpenXimea(
+    FrameSource* src, int cam_id, const SourceConfig* cfg) {
+    memset(src, 0, sizeof(*src));
+    HANDLE handle = NULL;
+    XI_RETURN status = XI_OK;
+    status = xiOpenDevice(cam_id, &handle);
+    if (status != XI_OK) {
+        Log(ERROR, "Failed to open camera %d\n", cam_id);
+        return false;
+    }
+
+    status += xiSetParamInt(handle, XI_PRM_EXPOSURE, cfg->exposure_us);
+    // RAW8 skips the driver's CPU demosaic and quarters the bytes per frame;
+    // the render loop debayers it in a shader instead
+    int xi_format = XI_RGB32;
+    if (cfg->format == FRAME_RAW8) {
+        xi_format = XI_RAW8;
+    } else if (cfg->format == FRAME_RAW16) {
+        xi_format = XI_RAW16;
+    }
+    status += xiSetParamInt(handle, XI_PRM_IMAGE_DATA_FORMAT, xi_format);
+    if (cfg->format == FRAME_RAW16) {
+        int sensor_bits = XI_BPP_8;
+        status += xiGetParamInt(
+            handle, XI_PRM_SENSOR_DATA_BIT_DEPTH, &sensor_bits);
+        status +=
+            xiSetParamInt(handle, XI_PRM_OUTPUT_DATA_BIT_DEPTH, sensor_bits);
+    } else {
+        status += xiSetParamInt(handle, XI_PRM_OUTPUT_DATA_BIT_DEPTH, XI_BPP_8);
+    }
+    // Sizes and offsets below are in downsampled pixels
+    int downsampling = 1;
+    if (cfg->downsampling > 1) {
+        downsampling = SetDownsampling(handle, cam_id, cfg->downsampling);
+    }
+    int want_w = cfg->width / downsampling;
+    int want_h = cfg->height / downsampling;
+    // Set width
+    int w_inc;
+    status += xiGetParamInt(handle, XI_PRM_WIDTH XI_PRM_INFO_INCREMENT, &w_inc);
+    Log(DEBUG, "Width inc: %d\n", w_inc);
+    int width = (want_w / w_inc) * w_inc;
+    status += xiSetParamInt(handle, XI_PRM_WIDTH, width);
+    if (status != XI_OK) {
+        Log(ERROR, "Failed to set width: %d\n", width);
+        xiCloseDevice(handle);
+        return false;
+    }
+    // Set height
+    int h_inc;
+    status +=
+        xiGetParamInt(handle, XI_PRM_HEIGHT XI_PRM_INFO_INCREMENT, &h_inc);
+    Log(DEBUG, "Height inc: %d\n", h_inc);
+    int height = (want_h / h_inc) * h_inc;
+    status += xiSetParamInt(handle, XI_PRM_HEIGHT, height);
+    if (status != XI_OK) {
+        Log(ERROR, "Failed to set height: %d\n", height);
+        xiCloseDevice(handle);
+        return false;
+    }
+    Log(DEBUG, "Image size: [%d, %d]\n", width, height);
+    // Set x-offset
+    int x_offset_inc;
+    status += xiGetParamInt(
+        handle, XI_PRM_OFFSET_X XI_PRM_INFO_INCREMENT, &x_offset_inc);
+    int x_offset = ((want_w - width) / 2 / x_offset_inc) * x_offset_inc;
+    status += xiSetParamInt(handle, XI_PRM_OFFSET_X, x_offset);
+    if (status != XI_OK) {
+        Log(ERROR, "Failed to set x-offset\n");
+        xiCloseDevice(handle);
+        return false;
+    }
+    // Set y-offset
+    int y_offset_inc;
+    status += xiGetParamInt(
+        handle, XI_PRM_OFFSET_Y XI_PRM_INFO_INCREMENT, &y_offset_inc);
+    int y_offset = ((want_h - height) / 2 / y_offset_inc) * y_offset_inc;
+    status += xiSetParamInt(handle, XI_PRM_OFFSET_Y, y_offset);
+    if (status != XI_OK) {
+        Log(ERROR, "Failed to set y-offset\n");
+        xiCloseDevice(handle);
+        return false;
+    }
+
+    // Split the controller's measured bandwidth between the cameras on it,
+    // within what this camera accepts
+    status += xiSetParamInt(handle, XI_PRM_LIMIT_BANDWIDTH_MODE, XI_ON);
+    int bw_min = 0;
+    int bw_max = 0;
+    status += xiGetParamInt(
+        handle, XI_PRM_LIMIT_BANDWIDTH XI_PRM_INFO_MIN, &bw_min);
+    status += xiGetParamInt(
+        handle, XI_PRM_LIMIT_BANDWIDTH XI_PRM_INFO_MAX, &bw_max);
+    int bandwidth = cfg->bandwidth_mbps;
+    bool adaptive = bandwidth <= 0;
+    if (adaptive) {
+        int peers = cfg->peers > 0 ? cfg->peers : 1;
+        int available = AvailableBandwidth(handle, cam_id);
+        bandwidth = available > 0
+                        ? (int)(available * BANDWIDTH_HEADROOM / peers)
+                        : bw_max;
+    }
+    bandwidth = bandwidth < bw_min   ? bw_min
+                : bandwidth > bw_max ? bw_max
+                                     : bandwidth;
+    status += xiSetParamInt(handle, XI_PRM_LIMIT_BANDWIDTH, bandwidth);
+    Log(INFO,
+        "Camera %d bandwidth limit: %d Mbit/s (%s, range %d-%d)\n",
+        cam_id,
+        bandwidth,
+        adaptive ? "calibrated" : "fixed",
+        bw_min,
+        bw_max);
+
+    // Set white balance
+    status += xiSetParamFloat(handle, XI_PRM_WB_KR, cfg->wb_kr);
+    status += xiSetParamFloat(handle, XI_PRM_WB_KG, cfg->wb_kg);
+    status += xiSetParamFloat(handle, XI_PRM_WB_KB, cfg->wb_kb);
+
+    if (cfg->zero_copy) {
+        status += xiSetParamInt(handle, XI_PRM_BUFFER_POLICY, XI_BP_UNSAFE);
+    }
+
+    // Set alpha default
+    if (cfg->format == FRAME_RGB32) {
+        status +=
+            xiSetParamInt(handle, XI_PRM_IMAGE_DATA_FORMAT_RGB32_ALPHA, 255);
+    }
+
+    int exposure_min = cfg->exposure_us;
+    int exposure_max = cfg->exposure_us;
+    xiGetParamInt(handle, XI_PRM_EXPOSURE XI_PRM_INFO_MIN, &exposure_min);
+    xiGetParamInt(handle, XI_PRM_EXPOSURE XI_PRM_INFO_MAX, &exposure_max);
+    float gain = 0.0f;
+    float gain_min = 0.0f;
+    float gain_max = 0.0f;
+    xiGetParamFloat(handle, XI_PRM_GAIN, &gain);
+    xiGetParamFloat(handle, XI_PRM_GAIN XI_PRM_INFO_MIN, &gain_min);
+    xiGetParamFloat(handle, XI_PRM_GAIN XI_PRM_INFO_MAX, &gain_max);
+
+    int cfa = XI_CFA_NONE;
+    xiGetParamInt(handle, XI_PRM_COLOR_FILTER_ARRAY, &cfa);
+    int bit_depth = XI_BPP_8;
+    xiGetParamInt(handle, XI_PRM_OUTPUT_DATA_BIT_DEPTH, &bit_depth);
+
+    // Start acquisition
+    status += xiStartAcquisition(handle);
+    if (status != XI_OK) {
+        Log(ERROR, "Failed to setup camera %d\n", cam_id);
+        xiCloseDevice(handle);
+        return false;
+    }
+
+    XimeaSource* xi = calloc(1, sizeof(XimeaSource));
+    if (xi == NULL) {
+        xiCloseDevice(handle);
+        return false;
+    }
+    xi->handle = handle;
+    xi->cam_id = cam_id;
+    xi->zero_copy = cfg->zero_copy;
+    xi->adaptive = adaptive;
+    xi->bw_min = bw_min;
+    xi->bw_target = bandwidth;
+    xi->bw_limit = bandwidth;
+    xi->base_x = x_offset;
+    xi->base_y = y_offset;
+    xi->w_inc = w_inc;
+    xi->h_inc = h_inc;
+    xi->x_inc = x_offset_inc;
+    xi->y_inc = y_offset_inc;
+    xi->roi = (SourceRoi){.width = width, .height = height};
+    xi->exposure_us = cfg->exposure_us;
+    xi->gain_db = gain;
+    xi->image.size = sizeof(XI_IMG);
+
+    src->name = "ximea";
+    src->downsampling = downsampling;
+    src->width = width;
+    src->height = height;
+    src->format = cfg->format;
+    src->pattern = PatternFromXi(cfa);
+    src->bit_depth = bit_depth;
+    src->frame_bytes =
+        (size_t)width * height * FrameBytesPerPixel(cfg->format);
+    float framerate = 0.0f;
+    if (xiGetParamFloat(handle, XI_PRM_FRAMERATE, &framerate) == XI_OK) {
+        src->rate_hz = framerate;
+    }
+    src->exposure_us = cfg->exposure_us;
+    src->exposure_min_us = exposure_min;
+    src->exposure_max_us = exposure_max;
+    src->gain_min_db = gain_min;
+    src->gain_max_db = gain_max;
+    src->wb_kr = cfg->wb_kr;
+    src->wb_kg = cfg->wb_kg;
+    src->wb_kb = cfg->wb_kb;
+    atomic_store(&src->bandwidth_mbps, bandwidth);
+    src->next = XimeaNext;
+    src->feedback = XimeaFeedback;
+    src->set_roi = XimeaSetRoi;
+    src->set_exposure = XimeaSetExposure;
+    src->set_white_balance = XimeaSetWhiteBalance;
+    src->close = XimeaClose;
+    src->impl = xi;
+    return true;
+}
@@ -0,0 +1,81 @@
+#include "stats.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define SUB_COUNT (1u << HISTOGRAM_SUB_BITS)
+
+static int BucketOf(uint64_t v) {
+    if (v < SUB_COUNT) {
+        return (int)v;
+    }
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - HISTOGRAM_SUB_BITS;
+    int sub = (int)((v >> shift) - SUB_COUNT);
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) + sub;
+}
+
+static uint64_t BucketFloor(int bucket) {
+    int octave = bucket >> HISTOGRAM_SUB_BITS;
+    uint64_t sub = bucket & (SUB_COUNT - 1);
+    if (octave == 0) {
+        return sub;
+    }
+    return (SUB_COUNT + sub) << (octave - 1);
+}
+
+void HistogramReset(Histogram* h) {
+    memset(h, 0, sizeof(*h));
+}
+
+void HistogramRecord(Histogram* h, uint64_t value) {
+    h->counts[BucketOf(value)] += 1;
+    if (h->count == 0 || value < h->min) {
+        h->min = value;
+    }
+    if (value > h->max) {
+        h->max = value;
+    }
+    h->count += 1;
+    h->sum += value;
+}
+
+uint64_t HistogramPercentile(const Histogram* h, double p) {
+    if (h->count == 0) {
+        return 0;
+    }
+    if (p <= 0.0) {
+        return h->min;
+    }
+    if (p >= 100.0) {
+        return h->max;
+    }
+    uint64_t rank = (uint64_t)(p / 100.0 * h->count);
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += h->counts[i];
+        if (seen > rank) {
+            uint64_t floor = BucketFloor(i);
+            return floor < h->min ? h->min : floor;
+        }
+    }
+    return h->max;
+}
+
+double HistogramMean(const Histogram* h) {
+    return h->count > 0 ? (double)h->sum / h->count : 0.0;
+}
+
+void HistogramPrintRow(const char* name, const Histogram* h) {
+    if (h->count == 0) {
+        printf("  %-16s %9s\n", name, "n/a");
+        return;
+    }
+    printf(
+        "  %-16s %9.3f %9.3f %9.3f %9.3f\n",
+        name,
+        h->min / 1e6,
+        HistogramPercentile(h, 50.0) / 1e6,
+        HistogramPercentile(h, 99.0) / 1e6,
+        h->max / 1e6);
+}
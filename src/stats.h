@@ -0,0 +1,30 @@
+#ifndef XICLOPS_STATS_H
+#define XICLOPS_STATS_H
+
+#include <stdint.h>
+
+// Log-linear histogram of nanosecond latencies: exact below 32 ns, then 32
+// buckets per power of two (about 3% resolution). Recording is a couple of
+// integer ops and never allocates, so it can sit on hot paths permanently.
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+typedef struct Histogram {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+} Histogram;
+
+void HistogramReset(Histogram* h);
+void HistogramRecord(Histogram* h, uint64_t value);
+// Lower bound of the bucket holding the p-th percentile (0..100); min/max
+// are exact
+uint64_t HistogramPercentile(const Histogram* h, double p);
+double HistogramMean(const Histogram* h);
+
+// Prints "name  min  p50  p99  max" in milliseconds, or n/a when empty
+void HistogramPrintRow(const char* name, const Histogram* h);
+
+#endif  // XICLOPS_STATS_H
@@ -0,0 +1,574 @@
+#include "stream.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock.h"
+#include "log.h"
+#include "trace.h"
+
+bool StreamOpen(Stream* s, int cam_id, const StreamConfig* cfg) {
+    memset(s, 0, sizeof(*s));
+    s->cam_id = cam_id;
+    s->demosaic = cfg->demosaic;
+    s->pbo_upload = cfg->pbo_upload;
+    s->pbo_depth = cfg->pbo_depth;
+    s->roi_follow = cfg->roi_follow;
+    HistogramReset(&s->convert_hist);
+    HistogramReset(&s->upload_hist);
+    HistogramReset(&s->stats_hist);
+    HistogramReset(&s->focus_hist);
+    if (cfg->focus != NULL) {
+        s->focus = true;
+        s->focus_cfg = *cfg->focus;
+        s->focus_peaking = true;
+    }
+
+    // The sensor can only downsample when nothing needs full frames
+    SourceConfig source_cfg = cfg->source;
+    bool full_frames =
+        cfg->record_path != NULL || cfg->pretrigger_path != NULL;
+    source_cfg.downsampling = full_frames ? 1 : cfg->preview;
+    bool opened;
+    if (cfg->play_path != NULL) {
+        Log(INFO, "Opening recording %s\n", cfg->play_path);
+        opened =
+            FrameSourceOpenPlayback(&s->source, cfg->play_path, cfg->play_mode);
+    } else {
+        Log(INFO, "Opening Camera %d\n", cam_id);
+        opened =
+            cfg->synthetic
+                ? FrameSourceOpenSynthetic(&s->source, cam_id, &source_cfg)
+                : FrameSourceOpenXimea(&s->source, cam_id, &source_cfg);
+    }
+    if (!opened) {
+        Log(ERROR,
+            "Failed to open %s source %d\n",
+            cfg->play_path != NULL ? "playback"
+            : cfg->synthetic       ? "synthetic"
+                                   : "camera",
+            cam_id);
+        return false;
+    }
+    if (s->roi_follow && (s->source.set_roi == NULL ||
+                          cfg->record_path != NULL ||
+                          cfg->pretrigger_path != NULL)) {
+        // Recordings keep one frame size throughout
+        Log(WARN,
+            "Camera %d: ROI follow needs a live source and no recording\n",
+            cam_id);
+        s->roi_follow = false;
+    }
+    // Whatever the sensor didn't downsample is done on the capture thread
+    s->preview = cfg->preview > 1 ? cfg->preview : 1;
+    s->scale = s->source.downsampling;
+    s->view_width = s->source.width * s->scale;
+    s->view_height = s->source.height * s->scale;
+    int cpu_preview = s->preview / s->scale;
+    if (s->preview > 1) {
+        Log(INFO,
+            "Camera %d: preview at 1/%d resolution (%dx on the sensor)\n",
+            cam_id,
+            s->preview,
+            s->scale);
+    }
+    s->roi_wanted = (SourceRoi){
+        .width = s->source.width,
+        .height = s->source.height,
+    };
+    s->wb_kr = s->source.wb_kr;
+    s->wb_kg = s->source.wb_kg;
+    s->wb_kb = s->source.wb_kb;
+    Log(DEBUG, "Payload size: %zu\n", s->source.frame_bytes);
+
+    // 16-bit mosaics always go through the CPU demosaic
+    FrameFormat format = s->source.format;
+    s->shader_debayer = format == FRAME_RAW8 && cfg->gpu_debayer;
+    s->cpu_debayer = format != FRAME_RGB32 && !s->shader_debayer;
+    if (s->cpu_debayer) {
+        s->rgba = malloc((size_t)s->source.width * s->source.height * 4);
+        if (s->rgba == NULL) {
+            FrameSourceClose(&s->source);
+            return false;
+        }
+        Log(INFO,
+            "Camera %d: CPU demosaic using %s kernels\n",
+            cam_id,
+            DemosaicIsaName(DemosaicBestIsa()));
+    }
+
+    // Dark and flat correction, from the references in the calibration file
+    // or, played back, those a raw recording was made with
+    if (cfg->calibration_path != NULL || cfg->play_path != NULL) {
+        Recording played;
+        bool playing =
+            cfg->play_path != NULL && RecordingOpen(&played, cfg->play_path);
+        s->calibrating = CalibratorInit(
+            &s->calibrator,
+            &s->source,
+            cfg->calibration_path,
+            playing ? &played : NULL,
+            cfg->calibration_frames);
+        if (playing) {
+            RecordingClose(&played);
+        }
+        if (s->calibrating && cfg->calibration_path == NULL &&
+            atomic_load(&s->calibrator.references) == 0) {
+            CalibratorFree(&s->calibrator);
+            s->calibrating = false;
+        }
+        if (!s->calibrating && cfg->calibration_path != NULL) {
+            Log(WARN, "Camera %d: calibration needs a raw source\n", cam_id);
+        }
+    }
+
+    RecordingInfo info = {
+        .width = s->source.width,
+        .height = s->source.height,
+        .format = s->source.format,
+        .pattern = s->source.pattern,
+        .bit_depth = s->source.bit_depth,
+        .exposure_us = s->source.exposure_us,
+        .wb_kr = s->source.wb_kr,
+        .wb_kg = s->source.wb_kg,
+        .wb_kb = s->source.wb_kb,
+        .frame_bytes = s->source.frame_bytes,
+        .calibration = s->calibrating ? s->calibrator.current : NULL,
+        .corrected = !cfg->record_raw,
+    };
+    if (cfg->record_path != NULL) {
+        s->recording = RecorderOpen(
+            &s->recorder,
+            cfg->record_path,
+            &info,
+            cfg->record_depth,
+            cfg->record_block);
+        if (!s->recording) {
+            if (s->calibrating) {
+                CalibratorFree(&s->calibrator);
+            }
+            free(s->rgba);
+            FrameSourceClose(&s->source);
+            return false;
+        }
+    }
+    // Playing a raw recording back needs the references it started with
+    // to hold for all of it
+    if (s->calibrating) {
+        s->calibrator.fixed = s->recording && cfg->record_raw;
+    }
+    if (cfg->pretrigger_path != NULL) {
+        s->pretriggering = PreTriggerInit(
+            &s->pretrigger,
+            cfg->pretrigger_path,
+            &info,
+            s->source.rate_hz,
+            cfg->pretrigger_pre_s,
+            cfg->pretrigger_post_s,
+            cfg->trigger_gpi,
+            cfg->record_depth);
+        if (!s->pretriggering) {
+            if (s->recording) {
+                RecorderClose(&s->recorder);
+            }
+            if (s->calibrating) {
+                CalibratorFree(&s->calibrator);
+            }
+            free(s->rgba);
+            FrameSourceClose(&s->source);
+            return false;
+        }
+    }
+
+    if (cfg->auto_exposure != NULL) {
+        s->auto_exposing =
+            AutoExposureInit(&s->auto_exposure, cfg->auto_exposure, &s->source);
+        if (!s->auto_exposing) {
+            Log(WARN,
+                "Camera %d: %s source has a fixed exposure\n",
+                cam_id,
+                s->source.name);
+        }
+    }
+
+    Recorder* recorder = s->recording ? &s->recorder : NULL;
+    PreTrigger* pretrigger = s->pretriggering ? &s->pretrigger : NULL;
+    AutoExposure* ae = s->auto_exposing ? &s->auto_exposure : NULL;
+    Calibrator* calibrator = s->calibrating ? &s->calibrator : NULL;
+    if (!CaptureStart(
+            &s->capture,
+            &s->source,
+            recorder,
+            pretrigger,
+            ae,
+            calibrator,
+            cfg->record_raw,
+            cpu_preview)) {
+        Log(ERROR, "Failed to start capture thread on camera %d\n", cam_id);
+        if (s->pretriggering) {
+            PreTriggerFree(&s->pretrigger);
+        }
+        if (s->recording) {
+            RecorderClose(&s->recorder);
+        }
+        if (s->calibrating) {
+            CalibratorFree(&s->calibrator);
+        }
+        free(s->rgba);
+        FrameSourceClose(&s->source);
+        return false;
+    }
+    s->capturing = true;
+
+    // Gains go where the colour is made; the CPU demosaic has none
+    AwbMethod awb = AWB_OFF;
+    if (cfg->awb != NULL && cfg->awb->method != AWB_OFF) {
+        s->awb = *cfg->awb;
+        s->awb_in_camera = s->source.format == FRAME_RGB32 &&
+                           s->source.set_white_balance != NULL;
+        if (s->awb_in_camera || s->shader_debayer) {
+            awb = s->awb.method;
+        } else if (s->source.format == FRAME_RGB32) {
+            Log(WARN,
+                "Camera %d: %s source has a fixed white balance\n",
+                cam_id,
+                s->source.name);
+        } else {
+            Log(WARN,
+                "Camera %d: the CPU demosaic applies no white balance\n",
+                cam_id);
+        }
+    }
+    if (cfg->image_stats || awb != AWB_OFF) {
+        s->stats_running = ImageStatsStart(
+            &s->stats_worker,
+            cfg->image_stats,
+            awb,
+            awb != AWB_OFF ? s->awb.period_s : 0.0);
+        if (!s->stats_running) {
+            Log(WARN, "Camera %d: no image statistics worker\n", cam_id);
+        }
+    }
+    s->auto_white_balance = s->stats_running && awb != AWB_OFF;
+    return true;
+}
+
+bool StreamInitGpu(Stream* s) {
+    if (s->shader_debayer) {
+        if (!DebayerShaderLoad(&s->debayer)) {
+            return false;
+        }
+        DebayerShaderSetPattern(&s->debayer, s->source.pattern);
+        DebayerShaderSetGains(&s->debayer, s->wb_kr, s->wb_kg, s->wb_kb);
+    }
+    s->gpu = true;
+    // The focus aids are a convenience, so the stream goes on without them
+    if (s->focus && PeakingShaderLoad(&s->peaking)) {
+        if (SharpnessMeterInit(&s->sharpness)) {
+            PeakingShaderSet(
+                &s->peaking, s->shader_debayer, s->focus_cfg.threshold, RED);
+            s->focus_ready = true;
+        } else {
+            PeakingShaderUnload(&s->peaking);
+        }
+    }
+    if (s->focus && !s->focus_ready) {
+        Log(WARN, "Camera %d: focus shaders failed to load\n", s->cam_id);
+    }
+    return true;
+}
+
+void StreamStop(Stream* s) {
+    if (s->capturing) {
+        CaptureStop(&s->capture);
+        s->capturing = false;
+        if (s->recording) {
+            RecorderClose(&s->recorder);
+        }
+        if (s->pretriggering) {
+            PreTriggerFree(&s->pretrigger);
+        }
+    }
+}
+
+void StreamClose(Stream* s) {
+    if (s->pbo_ready) {
+        Log(DEBUG,
+            "Camera %d: PBO slots reused while busy: %lu\n",
+            s->cam_id,
+            s->pbo.busy);
+        PboRingFree(&s->pbo);
+    }
+    if (s->has_texture) {
+        UnloadTexture(s->texture);
+    }
+    if (s->gpu && s->shader_debayer) {
+        DebayerShaderUnload(&s->debayer);
+    }
+    if (s->focus_ready) {
+        SharpnessMeterFree(&s->sharpness);
+        PeakingShaderUnload(&s->peaking);
+        s->focus_ready = false;
+    }
+    StreamStop(s);
+    if (s->stats_running) {
+        ImageStatsStop(&s->stats_worker);
+        s->stats_running = false;
+    }
+    if (s->calibrating) {
+        CalibratorFree(&s->calibrator);
+        s->calibrating = false;
+    }
+    free(s->rgba);
+    FrameSourceClose(&s->source);
+}
+
+const Frame* StreamPoll(Stream* s) {
+    const Frame* frame = CaptureLatest(&s->capture);
+    if (frame != NULL) {
+        Log(TRACE, "Camera %d: frame %u picked up\n", s->cam_id, frame->nframe);
+        TraceInstant("pickup", frame->nframe);
+    }
+    return frame;
+}
+
+static void Upload(Stream* s, const Frame* frame) {
+    unsigned char* pixels = frame->data;
+    if (s->cpu_debayer) {
+        TraceBegin("demosaic");
+        uint64_t t0 = NowNs();
+        Demosaic(frame, s->demosaic, s->rgba);
+        HistogramRecord(&s->convert_hist, NowNs() - t0);
+        TraceEnd("demosaic");
+        pixels = s->rgba;
+    }
+    if (!s->gpu) {
+        return;
+    }
+
+    if (s->has_texture && (frame->width != s->texture.width ||
+                           frame->height != s->texture.height)) {
+        // The sensor ROI changed size; start over at the new one
+        if (s->pbo_ready) {
+            PboRingFree(&s->pbo);
+            s->pbo_ready = false;
+        }
+        UnloadTexture(s->texture);
+        s->has_texture = false;
+    }
+    if (!s->has_texture) {
+        Log(TRACE, "Loading texture...\n");
+        Image image = {
+            .data = pixels,
+            .width = frame->width,
+            .height = frame->height,
+            .mipmaps = 1,
+            .format = s->shader_debayer ? PIXELFORMAT_UNCOMPRESSED_GRAYSCALE
+                                        : PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+        };
+        s->texture = LoadTextureFromImage(image);
+        s->has_texture = true;
+        s->draw_roi_x = frame->roi_x;
+        s->draw_roi_y = frame->roi_y;
+        // A new PBO ring has nothing staged, so the next upload leaves this
+        // frame in the texture
+        s->staged_roi_x = frame->roi_x;
+        s->staged_roi_y = frame->roi_y;
+        Log(TRACE, "Texture loaded\n");
+        if (s->pbo_upload) {
+            size_t bytes = (size_t)image.width * image.height *
+                           (s->shader_debayer ? 1 : 4);
+            s->pbo_ready =
+                PboRingInit(&s->pbo, s->texture, bytes, s->pbo_depth);
+            if (!s->pbo_ready) {
+                Log(WARN, "PBO ring unavailable, using sync uploads\n");
+            }
+        }
+        return;
+    }
+
+    Log(TRACE, "Updating texture...\n");
+    TraceBegin("texture update");
+    uint64_t t0 = NowNs();
+    if (s->pbo_ready) {
+        // The texture receives the previously staged frame
+        PboRingUpload(&s->pbo, pixels);
+        s->draw_roi_x = s->staged_roi_x;
+        s->draw_roi_y = s->staged_roi_y;
+    } else {
+        UpdateTexture(s->texture, pixels);
+        s->draw_roi_x = frame->roi_x;
+        s->draw_roi_y = frame->roi_y;
+    }
+    s->staged_roi_x = frame->roi_x;
+    s->staged_roi_y = frame->roi_y;
+    uint64_t dt = NowNs() - t0;
+    TraceEnd("texture update");
+    HistogramRecord(&s->upload_hist, dt);
+    s->upload_window_ns += dt;
+    s->upload_window_count += 1;
+    Log(TRACE, "Texture updated\n");
+}
+
+// Samples taken from the camera already carry its gains, the mosaic ones
+// come raw
+static void ApplyWhiteBalance(Stream* s, const float correction[3]) {
+    float gains[3] = {s->wb_kr, s->wb_kg, s->wb_kb};
+    if (!WhiteBalanceStep(&s->awb, s->awb_in_camera, correction, gains)) {
+        return;
+    }
+    if (s->awb_in_camera) {
+        if (!s->source.set_white_balance(
+                &s->source, gains[0], gains[1], gains[2])) {
+            return;
+        }
+    } else if (s->gpu) {
+        DebayerShaderSetGains(&s->debayer, gains[0], gains[1], gains[2]);
+    }
+    s->wb_kr = gains[0];
+    s->wb_kg = gains[1];
+    s->wb_kb = gains[2];
+    s->awb_steps += 1;
+    Log(DEBUG,
+        "Camera %d: white balance R %.3f G %.3f B %.3f\n",
+        s->cam_id,
+        s->wb_kr,
+        s->wb_kg,
+        s->wb_kb);
+}
+
+// The configured region of the full frame in texels of the texture, which
+// may hold a crop of it and be downsampled
+static Rectangle FocusRegion(const Stream* s) {
+    const FocusConfig* f = &s->focus_cfg;
+    float texel = (float)s->preview;
+    return (Rectangle){
+        .x = (f->region_x * s->view_width - s->draw_roi_x * s->scale) / texel,
+        .y = (f->region_y * s->view_height - s->draw_roi_y * s->scale) / texel,
+        .width = f->region_w * s->view_width / texel,
+        .height = f->region_h * s->view_height / texel,
+    };
+}
+
+void StreamUpload(Stream* s, const Frame* frame) {
+    if (s->stats_running) {
+        uint64_t t0 = NowNs();
+        if (ImageStatsSubmit(&s->stats_worker, frame)) {
+            HistogramRecord(&s->stats_hist, NowNs() - t0);
+        }
+        ImageStatsLatest(&s->stats_worker, &s->image_stats);
+        float correction[3];
+        if (s->auto_white_balance &&
+            ImageStatsLatestAwb(&s->stats_worker, correction)) {
+            ApplyWhiteBalance(s, correction);
+        }
+    }
+    Upload(s, frame);
+    // Both upload paths are done with the pixels once they return
+    CaptureRelease(&s->capture);
+    if (s->focus_ready && s->has_texture) {
+        TraceBegin("sharpness");
+        uint64_t t0 = NowNs();
+        SharpnessMeterPoll(&s->sharpness);
+        SharpnessMeterSubmit(
+            &s->sharpness, s->texture, s->shader_debayer, FocusRegion(s));
+        HistogramRecord(&s->focus_hist, NowNs() - t0);
+        TraceEnd("sharpness");
+    }
+}
+
+void StreamDraw(const Stream* s, int x, int y) {
+    if (!s->has_texture) {
+        return;
+    }
+    Vector2 position = {
+        .x = (float)(x + s->draw_roi_x * s->scale),
+        .y = (float)(y + s->draw_roi_y * s->scale),
+    };
+    if (s->shader_debayer) {
+        BeginShaderMode(s->debayer.shader);
+        DrawTextureEx(s->texture, position, 0.0f, (float)s->preview, WHITE);
+        EndShaderMode();
+    } else {
+        DrawTextureEx(s->texture, position, 0.0f, (float)s->preview, WHITE);
+    }
+    if (!s->focus_ready) {
+        return;
+    }
+    const FocusConfig* f = &s->focus_cfg;
+    Rectangle region = {
+        .x = x + f->region_x * s->view_width,
+        .y = y + f->region_y * s->view_height,
+        .width = f->region_w * s->view_width,
+        .height = f->region_h * s->view_height,
+    };
+    DrawRectangleLinesEx(region, (float)s->preview, Fade(RED, 0.5f));
+    if (s->focus_peaking) {
+        BeginShaderMode(s->peaking.shader);
+        DrawTextureEx(s->texture, position, 0.0f, (float)s->preview, WHITE);
+        EndShaderMode();
+    }
+}
+
+static bool RoiContains(const SourceRoi* a, const SourceRoi* b) {
+    return b->x >= a->x && b->y >= a->y &&
+           b->x + b->width <= a->x + a->width &&
+           b->y + b->height <= a->y + a->height;
+}
+
+// Visible part of the frame in source pixels, padded by `margin` of its size
+// on each side and clipped to the sensor
+static SourceRoi VisibleRoi(const Stream* s, Rectangle visible, float margin) {
+    visible.x /= s->scale;
+    visible.y /= s->scale;
+    visible.width /= s->scale;
+    visible.height /= s->scale;
+    float mx = visible.width * margin;
+    float my = visible.height * margin;
+    int x0 = (int)floorf(visible.x - mx);
+    int y0 = (int)floorf(visible.y - my);
+    int x1 = (int)ceilf(visible.x + visible.width + mx);
+    int y1 = (int)ceilf(visible.y + visible.height + my);
+    x0 = x0 < 0 ? 0 : x0 & ~1;
+    y0 = y0 < 0 ? 0 : y0 & ~1;
+    x1 = x1 > s->source.width ? s->source.width : x1;
+    y1 = y1 > s->source.height ? s->source.height : y1;
+    return (SourceRoi){
+        .x = x0,
+        .y = y0,
+        .width = x1 > x0 ? x1 - x0 : 0,
+        .height = y1 > y0 ? y1 - y0 : 0,
+    };
+}
+
+void StreamFollowView(Stream* s, Rectangle visible) {
+    if (!s->roi_follow) {
+        return;
+    }
+    SourceRoi needed = VisibleRoi(s, visible, 0.0f);
+    if (needed.width <= 0 || needed.height <= 0) {
+        // Scrolled out of view; keep what it has for when it comes back
+        return;
+    }
+    SourceRoi* current = &s->roi_wanted;
+    // The camera refused the last request and kept another crop; go on from
+    // that one, asking again if it doesn't cover the view
+    CaptureRoiRefused(&s->capture, current);
+    if (RoiContains(current, &needed) &&
+        (int64_t)current->width * current->height <=
+            2 * (int64_t)needed.width * needed.height) {
+        return;
+    }
+    // The margin lets small pans go by without restarting acquisition
+    SourceRoi roi = VisibleRoi(s, visible, 0.125f);
+    Log(DEBUG,
+        "Camera %d: ROI %dx%d+%d+%d\n",
+        s->cam_id,
+        roi.width,
+        roi.height,
+        roi.x,
+        roi.y);
+    *current = roi;
+    CaptureRequestRoi(&s->capture, &roi);
+}
@@ -0,0 +1,148 @@
+#ifndef XICLOPS_STREAM_H
+#define XICLOPS_STREAM_H
+
+#include <raylib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "auto_exposure.h"
+#include "calibration.h"
+#include "capture.h"
+#include "demosaic.h"
+#include "frame_source.h"
+#include "image_stats.h"
+#include "pbo_ring.h"
+#include "pretrigger.h"
+#include "recorder.h"
+#include "shaders.h"
+#include "sharpness.h"
+#include "stats.h"
+#include "white_balance.h"
+
+typedef struct StreamConfig {
+    bool synthetic;
+    const char* play_path;  // replay this recording instead of a camera
+    PlaybackMode play_mode;
+    SourceConfig source;
+    bool gpu_debayer;  // RAW8 only; RAW16 always goes through the CPU
+    DemosaicMethod demosaic;
+    bool pbo_upload;
+    int pbo_depth;
+    const char* record_path;  // NULL to not record
+    int record_depth;
+    bool record_block;  // wait for the disk instead of dropping frames
+    const char* pretrigger_path;  // NULL for no pre-trigger ring
+    double pretrigger_pre_s;
+    double pretrigger_post_s;
+    int trigger_gpi;  // 1-based input, 0 for keyboard triggers only
+    bool roi_follow;  // crop the sensor to the visible region, not recording
+    // 1, 2 or 4: downsample what reaches the screen, on the sensor when
+    // nothing records, else on the capture thread after the recorder
+    int preview;
+    bool image_stats;  // histograms of the displayed frames
+    const AutoExposureConfig* auto_exposure;  // NULL for a fixed exposure
+    const AwbConfig* awb;  // NULL for the fixed gains in `source`
+    const FocusConfig* focus;  // NULL for no focus peaking or score
+    // Dark and flat references, loaded if the file exists and saved when
+    // new ones are taken; NULL for no correction, except that playback
+    // applies the references a raw recording carries
+    const char* calibration_path;
+    int calibration_frames;  // averaged per reference
+    bool record_raw;  // record uncorrected frames, with the references
+} StreamConfig;
+
+// Everything one camera needs between its source and the screen: the capture
+// thread, the conversion path and the texture the render loop draws.
+typedef struct Stream {
+    int cam_id;
+    FrameSource source;
+    // Drawn size in world units, the full frame at full resolution
+    int view_width;
+    int view_height;
+    int scale;    // world units per source pixel (sensor downsampling)
+    int preview;  // world units per texture pixel
+    Capture capture;
+    bool capturing;
+    bool recording;
+    Recorder recorder;
+    bool pretriggering;
+    PreTrigger pretrigger;
+    bool auto_exposing;
+    AutoExposure auto_exposure;
+    bool calibrating;
+    Calibrator calibrator;
+    bool shader_debayer;  // mosaic uploaded as-is, debayered while drawing
+    bool cpu_debayer;     // mosaic converted into `rgba` before upload
+    DemosaicMethod demosaic;
+    unsigned char* rgba;
+    // White balance in effect: applied by the shader, or by the camera for
+    // RGB32; steered by the worker's estimates with auto_white_balance
+    float wb_kr;
+    float wb_kg;
+    float wb_kb;
+    bool auto_white_balance;
+    AwbConfig awb;
+    bool awb_in_camera;  // else the debayer shader applies the gains
+    uint64_t awb_steps;  // gain changes applied
+    bool gpu;  // GL resources were set up by StreamInitGpu()
+    bool pbo_upload;
+    int pbo_depth;
+    DebayerShader debayer;
+    bool has_texture;  // created from the first frame, again on ROI changes
+    Texture2D texture;
+    bool roi_follow;
+    SourceRoi roi_wanted;  // last ROI requested from the capture thread
+    int staged_roi_x;      // ROI offset of the frame in the PBO ring
+    int staged_roi_y;
+    int draw_roi_x;  // ROI offset of the frame in the texture
+    int draw_roi_y;
+    bool pbo_ready;
+    PboRing pbo;
+    bool focus;        // focus aids configured
+    bool focus_ready;  // and set up by StreamInitGpu()
+    FocusConfig focus_cfg;
+    bool focus_peaking;  // draw the peaking overlay; toggled at runtime
+    PeakingShader peaking;
+    SharpnessMeter sharpness;  // scores the region every frame or two
+    bool stats_running;
+    ImageStatsWorker stats_worker;
+    ImageStats image_stats;  // newest, refreshed by StreamUpload()
+    // Render thread time spent converting and uploading this stream
+    Histogram convert_hist;
+    Histogram upload_hist;
+    Histogram stats_hist;  // sampling frames for image_stats
+    Histogram focus_hist;  // queueing and collecting sharpness passes
+    uint64_t upload_window_ns;
+    uint64_t upload_window_count;
+} Stream;
+
+// Opens the source and starts its capture thread
+bool StreamOpen(Stream* s, int cam_id, const StreamConfig* cfg);
+// Loads the debayer shader; needs a GL context (after InitWindow). Streams
+// never set up for the GPU only acquire and convert.
+bool StreamInitGpu(Stream* s);
+// Stops the capture thread and finishes the recording and any pre-trigger
+// flush; StreamClose() does this too if still running
+void StreamStop(Stream* s);
+void StreamClose(Stream* s);
+
+// Newest frame since the previous call, or NULL. Pass it to StreamUpload()
+// before polling again, without delay: with zero-copy acquisition the
+// capture thread can't fetch the next frame until then.
+const Frame* StreamPoll(Stream* s);
+// Converts the frame if needed and uploads it to the stream texture; samples
+// it for image_stats and white balance first when the worker is free, and
+// applies the newest white balance estimate. With focus aids, queues the
+// sharpness passes over the new texture; call outside BeginMode2D().
+void StreamUpload(Stream* s, const Frame* frame);
+// Draws the texture with the full frame's top-left corner at (x, y), once one
+// exists, covering view_width x view_height however it was downsampled; a
+// cropped frame lands where it sits on the sensor. With focus aids, outlines
+// the scored region and paints the peaking overlay if focus_peaking.
+void StreamDraw(const Stream* s, int x, int y);
+// With roi_follow, crops the sensor to `visible` (world units relative to the
+// frame's corner, may extend past it) plus a margin, unless the current ROI
+// still covers it without being much larger
+void StreamFollowView(Stream* s, Rectangle visible);
+
+#endif  // XICLOPS_STREAM_H
@@ -0,0 +1,144 @@
+#include "trace.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_MAX_THREADS 32
+// Events at the tail of a live ring that a writer may be overwriting while we
+// read; skipped when dumping
+#define TRACE_LIVE_MARGIN 256
+
+bool TRACE_ENABLED = false;
+_Thread_local TraceRing* TRACE_RING = NULL;
+
+static TraceRing* RINGS[TRACE_MAX_THREADS];
+static int RING_COUNT = 0;
+static uint64_t RING_CAPACITY = 0;
+static pthread_mutex_t REGISTRY_LOCK = PTHREAD_MUTEX_INITIALIZER;
+static volatile sig_atomic_t DUMP_REQUESTED = 0;
+
+bool TraceInit(uint64_t events_per_thread) {
+    uint64_t capacity = 1;
+    while (capacity < events_per_thread) {
+        capacity <<= 1;
+    }
+    RING_CAPACITY = capacity;
+    TRACE_ENABLED = true;
+    return true;
+}
+
+void TraceShutdown(void) {
+    TRACE_ENABLED = false;
+    pthread_mutex_lock(&REGISTRY_LOCK);
+    for (int i = 0; i < RING_COUNT; ++i) {
+        free(RINGS[i]->events);
+        free(RINGS[i]);
+        RINGS[i] = NULL;
+    }
+    RING_COUNT = 0;
+    pthread_mutex_unlock(&REGISTRY_LOCK);
+    TRACE_RING = NULL;
+}
+
+TraceRing* TraceRegisterThread(void) {
+    if (TRACE_RING != NULL) {
+        return TRACE_RING;
+    }
+    pthread_mutex_lock(&REGISTRY_LOCK);
+    TraceRing* ring = NULL;
+    if (RING_COUNT < TRACE_MAX_THREADS) {
+        ring = calloc(1, sizeof(TraceRing));
+        if (ring != NULL) {
+            ring->events = calloc(RING_CAPACITY, sizeof(TraceEvent));
+            if (ring->events == NULL) {
+                free(ring);
+                ring = NULL;
+            }
+        }
+    }
+    if (ring != NULL) {
+        ring->mask = RING_CAPACITY - 1;
+        ring->tid = RING_COUNT + 1;
+        snprintf(ring->name, sizeof(ring->name), "thread %d", ring->tid);
+        RINGS[RING_COUNT++] = ring;
+    }
+    pthread_mutex_unlock(&REGISTRY_LOCK);
+    TRACE_RING = ring;
+    return ring;
+}
+
+void TraceSetThreadName(const char* name) {
+    if (!TRACE_ENABLED) {
+        return;
+    }
+    TraceRing* ring = TraceRegisterThread();
+    if (ring != NULL) {
+        snprintf(ring->name, sizeof(ring->name), "%s", name);
+    }
+}
+
+static void DumpRing(FILE* out, const TraceRing* ring, bool* first) {
+    fprintf(
+        out,
+        "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+        "\"args\":{\"name\":\"%s\"}}",
+        *first ? "" : ",",
+        ring->tid,
+        ring->name);
+    *first = false;
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t begin = 0;
+    if (head > ring->mask + 1) {
+        begin = head - (ring->mask + 1) + TRACE_LIVE_MARGIN;
+    }
+    for (uint64_t i = begin; i < head; ++i) {
+        const TraceEvent* e = &ring->events[i & ring->mask];
+        fprintf(
+            out,
+            ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,"
+            "\"tid\":%d",
+            e->name,
+            e->phase,
+            e->ts_ns / 1000.0,
+            ring->tid);
+        if (e->phase == 'i') {
+            fprintf(out, ",\"s\":\"t\"");
+        }
+        if (e->arg != 0) {
+            fprintf(out, ",\"args\":{\"frame\":%u}", e->arg);
+        }
+        fputc('}', out);
+    }
+}
+
+bool TraceDump(const char* path) {
+    FILE* out = fopen(path, "w");
+    if (out == NULL) {
+        return false;
+    }
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    bool first = true;
+    pthread_mutex_lock(&REGISTRY_LOCK);
+    for (int i = 0; i < RING_COUNT; ++i) {
+        DumpRing(out, RINGS[i], &first);
+    }
+    pthread_mutex_unlock(&REGISTRY_LOCK);
+    fprintf(out, "\n]}\n");
+    return fclose(out) == 0;
+}
+
+void TraceRequestDump(void) {
+    DUMP_REQUESTED = 1;
+}
+
+bool TraceTakeDumpRequest(void) {
+    if (!DUMP_REQUESTED) {
+        return false;
+    }
+    DUMP_REQUESTED = 0;
+    return true;
+}
@@ -0,0 +1,83 @@
+#ifndef XICLOPS_TRACE_H
+#define XICLOPS_TRACE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "clock.h"
+
+// Per-thread binary flight recorder for hot-path stages. Recording an event
+// is a clock read plus a 24-byte store into the calling thread's ring; the
+// rings are only turned into Chrome trace_event JSON by TraceDump(), off the
+// hot path. Load the output in Perfetto or chrome://tracing.
+
+typedef struct TraceEvent {
+    uint64_t ts_ns;
+    const char* name;  // must outlive the trace, use string literals
+    uint32_t arg;
+    char phase;  // 'B'egin, 'E'nd, 'i'nstant
+} TraceEvent;
+
+typedef struct TraceRing {
+    TraceEvent* events;
+    uint64_t mask;
+    atomic_uint_least64_t head;  // total events ever written
+    int tid;
+    char name[32];
+} TraceRing;
+
+extern bool TRACE_ENABLED;
+extern _Thread_local TraceRing* TRACE_RING;
+
+// Enables tracing with `events_per_thread` (rounded up to a power of two)
+// slots in every thread's ring. Call before any thread starts recording.
+bool TraceInit(uint64_t events_per_thread);
+void TraceShutdown(void);
+
+// Names the calling thread in the dump, registering its ring if needed
+void TraceSetThreadName(const char* name);
+TraceRing* TraceRegisterThread(void);
+
+// Writes every ring as Chrome trace_event JSON. Safe to call while other
+// threads keep recording; the oldest events of a live ring may be skipped.
+bool TraceDump(const char* path);
+
+// Async-signal-safe: ask the render loop to dump at its next opportunity
+void TraceRequestDump(void);
+bool TraceTakeDumpRequest(void);
+
+static inline void TraceEmit(const char* name, char phase, uint32_t arg) {
+    if (!TRACE_ENABLED) {
+        return;
+    }
+    TraceRing* ring = TRACE_RING != NULL ? TRACE_RING : TraceRegisterThread();
+    if (ring == NULL) {
+        return;
+    }
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    TraceEvent* e = &ring->events[head & ring->mask];
+    e->ts_ns = NowNs();
+    e->name = name;
+    e->arg = arg;
+    e->phase = phase;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+static inline void TraceBegin(const char* name) {
+    TraceEmit(name, 'B', 0);
+}
+
+static inline void TraceBeginArg(const char* name, uint32_t arg) {
+    TraceEmit(name, 'B', arg);
+}
+
+static inline void TraceEnd(const char* name) {
+    TraceEmit(name, 'E', 0);
+}
+
+static inline void TraceInstant(const char* name, uint32_t arg) {
+    TraceEmit(name, 'i', arg);
+}
+
+#endif  // XICLOPS_TRACE_H
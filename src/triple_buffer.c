@@ -0,0 +1,55 @@
+#include "triple_buffer.h"
+
+#include <string.h>
+
+#define TRIPLE_BUFFER_FRESH 0x4u
+#define TRIPLE_BUFFER_INDEX 0x3u
+
+bool TripleBufferInit(TripleBuffer* tb, size_t frame_bytes) {
+    memset(tb, 0, sizeof(*tb));
+    if (!FramePoolInit(&tb->pool, 3, frame_bytes)) {
+        return false;
+    }
+    for (int i = 0; i < 3; ++i) {
+        tb->slots[i].storage = FramePoolSlot(&tb->pool, i);
+        tb->slots[i].data = tb->slots[i].storage;
+        tb->slots[i].capacity = frame_bytes;
+    }
+    tb->back = 0;
+    atomic_init(&tb->middle, 1);
+    tb->front = 2;
+    atomic_init(&tb->skipped, 0);
+    return true;
+}
+
+void TripleBufferFree(TripleBuffer* tb) {
+    FramePoolFree(&tb->pool);
+    for (int i = 0; i < 3; ++i) {
+        tb->slots[i].storage = NULL;
+        tb->slots[i].data = NULL;
+    }
+}
+
+Frame* TripleBufferWriteSlot(TripleBuffer* tb) {
+    return &tb->slots[tb->back];
+}
+
+void TripleBufferPublish(TripleBuffer* tb) {
+    unsigned prev = atomic_exchange_explicit(
+        &tb->middle, tb->back | TRIPLE_BUFFER_FRESH, memory_order_acq_rel);
+    if (prev & TRIPLE_BUFFER_FRESH) {
+        atomic_fetch_add_explicit(&tb->skipped, 1, memory_order_relaxed);
+    }
+    tb->back = prev & TRIPLE_BUFFER_INDEX;
+}
+
+const Frame* TripleBufferLatest(TripleBuffer* tb) {
+    if (!(atomic_load_explicit(&tb->middle, memory_order_relaxed) &
+          TRIPLE_BUFFER_FRESH)) {
+        return NULL;
+    }
+    unsigned prev = atomic_exchange_explicit(
+        &tb->middle, tb->front, memory_order_acq_rel);
+    tb->front = prev & TRIPLE_BUFFER_INDEX;
+    return &tb->slots[tb->front];
+}
@@ -0,0 +1,35 @@
+#ifndef XICLOPS_TRIPLE_BUFFER_H
+#define XICLOPS_TRIPLE_BUFFER_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "frame.h"
+#include "frame_pool.h"
+
+// Single-producer/single-consumer triple buffer. The producer owns the back
+// slot, the consumer owns the front slot, and the third slot is exchanged
+// through one atomic word, so neither side ever waits on the other.
+typedef struct TripleBuffer {
+    Frame slots[3];
+    FramePool pool;
+    alignas(64) atomic_uint middle;  // slot index | TRIPLE_BUFFER_FRESH
+    alignas(64) unsigned back;       // producer only
+    atomic_uint_least64_t skipped;   // published but never read
+    alignas(64) unsigned front;      // consumer only
+} TripleBuffer;
+
+bool TripleBufferInit(TripleBuffer* tb, size_t frame_bytes);
+void TripleBufferFree(TripleBuffer* tb);
+
+// Producer side: fill the slot returned by TripleBufferWriteSlot(), then
+// publish it. The next call to TripleBufferWriteSlot() returns a new slot.
+Frame* TripleBufferWriteSlot(TripleBuffer* tb);
+void TripleBufferPublish(TripleBuffer* tb);
+
+// Consumer side: the most recently published frame, or NULL when nothing
+// new was published since the last call. Valid until the next call.
+const Frame* TripleBufferLatest(TripleBuffer* tb);
+
+#endif  // XICLOPS_TRIPLE_BUFFER_H
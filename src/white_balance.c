@@ -0,0 +1,111 @@
+#include "white_balance.h"
+
+#include <math.h>
+#include <string.h>
+
+// Samples with a channel this bright may be clipped, so their colour lies
+#define AWB_CLIP 250
+// Below this luma noise and black level dominate the colour
+#define AWB_DARK 16
+// Percentile of each channel taken as the white patch
+#define AWB_WHITE_SHARE 0.97
+#define AWB_MIN_SAMPLES 64
+#define AWB_MIN_GAIN 0.125
+#define AWB_MAX_GAIN 8.0
+// Changes below half a percent aren't visible
+#define AWB_MIN_STEP_STOPS 0.007
+
+static inline int Luma(int r, int g, int b) {
+    return (77 * r + 150 * g + 29 * b + 128) >> 8;
+}
+
+static inline bool Usable(int r, int g, int b) {
+    int max = r > g ? (r > b ? r : b) : (g > b ? g : b);
+    return max < AWB_CLIP && Luma(r, g, b) >= AWB_DARK;
+}
+
+// Value below which `share` of the `total` samples in `hist` fall
+static int Percentile(const uint32_t* hist, uint32_t total, double share) {
+    uint32_t want = (uint32_t)(total * share);
+    uint32_t below = 0;
+    for (int v = 0; v < 256; ++v) {
+        below += hist[v];
+        if (below > want) {
+            return v;
+        }
+    }
+    return 255;
+}
+
+bool WhiteBalanceEstimate(
+    AwbMethod method,
+    const uint8_t* r,
+    const uint8_t* g,
+    const uint8_t* b,
+    uint32_t n,
+    float correction[3]) {
+    // Gray world compares channel means, white patch a high percentile of
+    // each channel, which unlike the single brightest sample survives noise
+    // and specular highlights
+    uint64_t sum[3] = {0, 0, 0};
+    uint32_t hist[3][256];
+    if (method == AWB_WHITE_PATCH) {
+        memset(hist, 0, sizeof(hist));
+    }
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        if (!Usable(r[i], g[i], b[i])) {
+            continue;
+        }
+        if (method == AWB_WHITE_PATCH) {
+            hist[0][r[i]] += 1;
+            hist[1][g[i]] += 1;
+            hist[2][b[i]] += 1;
+        } else {
+            sum[0] += r[i];
+            sum[1] += g[i];
+            sum[2] += b[i];
+        }
+        used += 1;
+    }
+    if (used < AWB_MIN_SAMPLES) {
+        return false;
+    }
+    if (method == AWB_WHITE_PATCH) {
+        for (int c = 0; c < 3; ++c) {
+            sum[c] = (uint64_t)Percentile(hist[c], used, AWB_WHITE_SHARE);
+        }
+    }
+    if (sum[0] == 0 || sum[2] == 0) {
+        return false;
+    }
+    correction[0] = (float)((double)sum[1] / sum[0]);
+    correction[1] = 1.0f;
+    correction[2] = (float)((double)sum[1] / sum[2]);
+    return true;
+}
+
+bool WhiteBalanceStep(
+    const AwbConfig* cfg,
+    bool applied,
+    const float correction[3],
+    float gains[3]) {
+    float next[3];
+    bool changed = false;
+    for (int c = 0; c < 3; ++c) {
+        double base = applied ? gains[c] : gains[1];
+        double target = base * correction[c];
+        double k = gains[c] * pow(target / gains[c], cfg->damping);
+        k = k < AWB_MIN_GAIN   ? AWB_MIN_GAIN
+            : k > AWB_MAX_GAIN ? AWB_MAX_GAIN
+                               : k;
+        next[c] = (float)k;
+        changed |= fabs(log2(k / gains[c])) > AWB_MIN_STEP_STOPS;
+    }
+    if (changed) {
+        for (int c = 0; c < 3; ++c) {
+            gains[c] = next[c];
+        }
+    }
+    return changed;
+}
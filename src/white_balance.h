@@ -0,0 +1,49 @@
+#ifndef XICLOPS_WHITE_BALANCE_H
+#define XICLOPS_WHITE_BALANCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Auto white balance from the decimated samples the image statistics worker
+// already takes (see image_stats.h), so it costs the capture thread nothing
+// and the render thread only the sampling. Estimates come at a fixed cadence
+// and are applied where the colour is made: by the camera for RGB32, by the
+// debayer shader for RAW8.
+
+typedef enum AwbMethod {
+    AWB_OFF,
+    // The scene averages to gray
+    AWB_GRAY_WORLD,
+    // The brightest unclipped part of each channel is white
+    AWB_WHITE_PATCH,
+} AwbMethod;
+
+typedef struct AwbConfig {
+    AwbMethod method;
+    double period_s;  // between estimates
+    double damping;   // share of the correction (in stops) applied per step
+} AwbConfig;
+
+// Gains relative to the ones the samples were taken with that would make
+// them neutral, green fixed at 1. Clipped and near-black samples are left
+// out; false if too few remain.
+bool WhiteBalanceEstimate(
+    AwbMethod method,
+    const uint8_t* r,
+    const uint8_t* g,
+    const uint8_t* b,
+    uint32_t n,
+    float correction[3]);
+
+// One step toward the estimate: moves `gains` (kr, kg, kb in effect)
+// `cfg->damping` of the way, in stops, to neutralising `correction`, which
+// was measured on samples that already carry the gains if `applied`, else on
+// raw ones. Returns false, leaving `gains` alone, if the change is too small
+// to see.
+bool WhiteBalanceStep(
+    const AwbConfig* cfg,
+    bool applied,
+    const float correction[3],
+    float gains[3]);
+
+#endif  // XICLOPS_WHITE_BALANCE_H